@@ -0,0 +1,123 @@
+#include "../wyze/wyze.h"
+#include <algorithm>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<uint64_t>::ptr g_busy_poll_us =
+    wyze::Config::Lookup<uint64_t>("iomanager.busy_poll_us", 0, "");
+static wyze::ConfigVar<uint32_t>::ptr g_busy_poll_socket_us =
+    wyze::Config::Lookup<uint32_t>("iomanager.busy_poll_socket_us", 0, "");
+
+static const int ROUNDS = 20000;
+static const int MSG_SIZE = 64;
+static const uint64_t BUSY_POLL_US = 2000;
+
+class EchoServer : public wyze::TcpServer {
+public:
+    EchoServer(wyze::IOManager* worker) : wyze::TcpServer(worker, worker) {}
+
+protected:
+    void handleClient(wyze::Socket::ptr client) override {
+        char buf[MSG_SIZE];
+        while(true) {
+            int n = client->recv(buf, sizeof(buf));
+            if(n <= 0 || client->send(buf, n) != n) {
+                break;
+            }
+        }
+    }
+};
+
+//一个连接上一问一答，消息之间间隔 gap_us，服务端按 busy_us 忙轮询，返回每次往返的时间
+static std::vector<uint64_t> Run(uint64_t busy_us, uint64_t gap_us, uint64_t& parks)
+{
+    static int s_port = 18170;
+    std::vector<uint64_t> rtts;
+    g_busy_poll_us->setVal(busy_us);
+    g_busy_poll_socket_us->setVal(busy_us ? 50 : 0);
+    {
+        wyze::IOManager server_iom(1, false, "busy_server");
+        g_busy_poll_us->setVal(0);
+        g_busy_poll_socket_us->setVal(0);
+        WYZE_ASSERT(server_iom.getBusyPollUs() == busy_us);
+        wyze::IOManager client_iom(1, false, "busy_client");
+
+        wyze::Address::ptr addr = wyze::IPAddress::LookupAnyIPAddress("127.0.0.1:" + std::to_string(s_port++));
+        wyze::TcpServer::ptr server;
+        std::atomic<int> bound = {0};
+        server_iom.schedule([&]() {
+            server.reset(new EchoServer(&server_iom));
+            bound = server->bind(addr) && server->start() ? 1 : -1;
+        });
+        while(!bound) {
+            usleep(1000);
+        }
+        WYZE_ASSERT(bound == 1);
+
+        std::atomic<bool> done = {false};
+        uint64_t start_parks = server_iom.getWakeupStats().parks;
+        client_iom.schedule([&]() {
+            wyze::Socket::ptr sock = wyze::Socket::CreateTCP(addr);
+            WYZE_ASSERT(sock->connect(addr));
+            char out[MSG_SIZE], in[MSG_SIZE];
+            memset(out, 'b', sizeof(out));
+            rtts.reserve(ROUNDS);
+            for(int i = 0; i < ROUNDS; ++i) {
+                if(gap_us) {
+                    usleep(gap_us);
+                }
+                uint64_t start = wyze::GetMonotonicUS();
+                WYZE_ASSERT(sock->send(out, sizeof(out)) == (int)sizeof(out));
+                WYZE_ASSERT(sock->recv(in, sizeof(in), MSG_WAITALL) == (int)sizeof(in));
+                rtts.push_back(wyze::GetMonotonicUS() - start);
+            }
+            sock->close();
+            done = true;
+        });
+        while(!done) {
+            usleep(1000);
+        }
+        parks = server_iom.getWakeupStats().parks - start_parks;
+        server_iom.schedule([&server]() { server->stop(); });
+        client_iom.stop();
+        server_iom.stop();
+    }
+    WYZE_ASSERT(rtts.size() == (size_t)ROUNDS);
+    std::sort(rtts.begin(), rtts.end());
+    return rtts;
+}
+
+static void Report(const char* name, uint64_t gap_us, const std::vector<uint64_t>& rtts, uint64_t parks)
+{
+    uint64_t sum = 0;
+    for(auto& i : rtts) {
+        sum += i;
+    }
+    WYZE_LOG_INFO(g_logger) << name << " gap=" << gap_us << "us"
+                            << " avg=" << sum / rtts.size() << "us"
+                            << " p50=" << rtts[rtts.size() / 2] << "us"
+                            << " p99=" << rtts[rtts.size() * 99 / 100] << "us"
+                            << " p999=" << rtts[rtts.size() * 999 / 1000] << "us"
+                            << " max=" << rtts.back() << "us"
+                            << " server_parks=" << parks;
+}
+
+//连续请求和请求之间有空闲两种情况下，默认模式和忙轮询模式的往返延迟
+void bench(uint64_t gap_us)
+{
+    uint64_t parks = 0;
+    std::vector<uint64_t> rtts = Run(0, gap_us, parks);
+    Report("default", gap_us, rtts, parks);
+    rtts = Run(BUSY_POLL_US, gap_us, parks);
+    Report("busy_poll", gap_us, rtts, parks);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    bench(0);
+    bench(200);
+    return 0;
+}
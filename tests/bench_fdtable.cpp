@@ -0,0 +1,89 @@
+#include "../wyze/wyze.h"
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static const int THREADS = 4;
+
+//eventfd 代替空闲的连接：只注册读事件，不会触发。fd 编号从小到大，注册过程中 fd 表不断扩大
+static std::vector<int> OpenFds(size_t want)
+{
+    rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur < want + 64 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = std::min<rlim_t>(want + 64, rl.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    //留一些 fd 给 epoll、日志等使用
+    if(want + 64 > rl.rlim_cur) {
+        want = rl.rlim_cur > 128 ? rl.rlim_cur - 128 : 0;
+    }
+    std::vector<int> fds;
+    while(fds.size() < want) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(fd < 0) {
+            break;
+        }
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+//THREADS 个线程分别对交错的 fd 执行 fn，返回每秒的操作数
+static double RunThreads(const std::vector<int>& fds, std::function<void(int)> fn)
+{
+    std::vector<wyze::Thread::ptr> threads;
+    uint64_t start = wyze::GetMonotonicUS();
+    for(int t = 0; t < THREADS; ++t) {
+        threads.push_back(wyze::Thread::ptr(new wyze::Thread([&fds, &fn, t]() {
+            for(size_t i = t; i < fds.size(); i += THREADS) {
+                fn(fds[i]);
+            }
+        }, "fdtable_" + std::to_string(t))));
+    }
+    for(auto& i : threads) {
+        i->join();
+    }
+    return fds.size() * 1e6 / (wyze::GetMonotonicUS() - start);
+}
+
+//并发注册大量 fd（伴随表扩容），之后反复删除、注册
+void bench_register(size_t want)
+{
+    std::vector<int> fds;
+    {
+        wyze::IOManager iom(2, false, "fdtable");
+        fds = OpenFds(want);
+        auto add = [&iom](int fd) {
+            WYZE_ASSERT(iom.addEvent(fd, wyze::IOManager::READ, []() {}) == 0);
+        };
+        auto del = [&iom](int fd) {
+            WYZE_ASSERT(iom.delEvent(fd, wyze::IOManager::READ));
+        };
+
+        double first = RunThreads(fds, add);
+        double removed = RunThreads(fds, del);
+        double again = RunThreads(fds, add);
+        RunThreads(fds, del);
+        WYZE_LOG_INFO(g_logger) << "bench_register fds=" << fds.size() << " (want " << want << ")"
+                                << " threads=" << THREADS
+                                << " first_add=" << (uint64_t)first << "/s"
+                                << " del=" << (uint64_t)removed << "/s"
+                                << " add=" << (uint64_t)again << "/s";
+    }
+    for(auto& i : fds) {
+        close(i);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    //进程的 fd 上限不够时按上限能打开的数量测试
+    bench_register(argc > 1 ? atoi(argv[1]) : 200000);
+    return 0;
+}
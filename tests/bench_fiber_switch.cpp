@@ -0,0 +1,67 @@
+#include "../wyze/wyze.h"
+#include <ucontext.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static const int ROUNDS = 1000000;
+static const size_t STACK_SIZE = 128 * 1024;
+
+//glibc swapcontext 来回切换，作为对比
+static ucontext_t s_main_uc;
+static ucontext_t s_peer_uc;
+
+static void ucontext_peer()
+{
+    while(true) {
+        swapcontext(&s_peer_uc, &s_main_uc);
+    }
+}
+
+void bench_ucontext()
+{
+    void* stack = malloc(STACK_SIZE);
+    getcontext(&s_peer_uc);
+    s_peer_uc.uc_link = nullptr;
+    s_peer_uc.uc_stack.ss_sp = stack;
+    s_peer_uc.uc_stack.ss_size = STACK_SIZE;
+    makecontext(&s_peer_uc, &ucontext_peer, 0);
+
+    uint64_t start = wyze::GetCurrentUS();
+    for(int i = 0; i < ROUNDS; ++i) {
+        swapcontext(&s_main_uc, &s_peer_uc);
+    }
+    uint64_t used = wyze::GetCurrentUS() - start;
+    WYZE_LOG_INFO(g_logger) << "ucontext swapcontext rounds=" << ROUNDS
+        << " used=" << used << "us"
+        << " per_switch=" << used * 1000.0 / ROUNDS / 2 << "ns";
+    free(stack);
+}
+
+//Fiber::call/back 来回切换，使用编译时选择的实现
+void bench_fiber()
+{
+    wyze::Fiber::GetThis();
+    wyze::Fiber::ptr fiber(new wyze::Fiber([]() {
+        for(int i = 0; i < ROUNDS; ++i) {
+            wyze::Fiber::GetThis()->back();
+        }
+    }, STACK_SIZE, true));
+
+    uint64_t start = wyze::GetCurrentUS();
+    for(int i = 0; i < ROUNDS; ++i) {
+        fiber->call();
+    }
+    uint64_t used = wyze::GetCurrentUS() - start;
+    fiber->call();      //让协程执行结束
+    WYZE_LOG_INFO(g_logger) << "fiber " << wyze::ContextImplName()
+        << " rounds=" << ROUNDS
+        << " used=" << used << "us"
+        << " per_switch=" << used * 1000.0 / ROUNDS / 2 << "ns";
+}
+
+int main(int argc, char** argv)
+{
+    bench_ucontext();
+    bench_fiber();
+    return 0;
+}
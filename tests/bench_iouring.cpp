@@ -0,0 +1,147 @@
+#include "../wyze/wyze.h"
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static const int CONNS = 64;
+static const int ROUNDS = 500;
+static const int MSG_SIZE = 64;
+
+class EchoServer : public wyze::TcpServer {
+public:
+    EchoServer(wyze::IOManager* worker) : wyze::TcpServer(worker, worker) {}
+
+protected:
+    void handleClient(wyze::Socket::ptr client) override {
+        char buf[4096];
+        while(true) {
+            int n = client->recv(buf, sizeof(buf));
+            if(n <= 0) {
+                break;
+            }
+            if(client->send(buf, n) != n) {
+                break;
+            }
+        }
+    }
+};
+
+//每个连接上一问一答 ROUNDS 次，返回完成的请求数
+static int EchoClient(wyze::Address::ptr addr)
+{
+    wyze::Socket::ptr sock = wyze::Socket::CreateTCP(addr);
+    if(!sock->connect(addr)) {
+        return 0;
+    }
+    char out[MSG_SIZE], in[MSG_SIZE];
+    memset(out, 'e', sizeof(out));
+    int done = 0;
+    for(; done < ROUNDS; ++done) {
+        if(sock->send(out, sizeof(out)) != (int)sizeof(out)
+                || sock->recv(in, sizeof(in), MSG_WAITALL) != (int)sizeof(in)) {
+            break;
+        }
+    }
+    sock->close();
+    return done;
+}
+
+//keep-alive 连接上连续发送 GET，返回完成的请求数
+static int HttpClient(wyze::Address::ptr addr)
+{
+    wyze::Socket::ptr sock = wyze::Socket::CreateTCP(addr);
+    if(!sock->connect(addr)) {
+        return 0;
+    }
+    wyze::http::HttpConnection conn(sock);
+    int done = 0;
+    for(; done < ROUNDS; ++done) {
+        wyze::http::HttpRequest::ptr req(new wyze::http::HttpRequest(0x11, false));
+        req->setPath("/bench");
+        req->setHeader("Host", "127.0.0.1");
+        if(conn.sendRequest(req) <= 0) {
+            break;
+        }
+        wyze::http::HttpResponse::ptr rsp = conn.recvResponse();
+        if(!rsp || rsp->getStatus() != wyze::http::HttpStatus::OK) {
+            break;
+        }
+    }
+    return done;
+}
+
+//服务端使用 backend，客户端固定使用 epoll，返回每秒完成的请求数
+static double Run(wyze::IOManager::Backend backend, bool http, wyze::UringStats* stats)
+{
+    static int s_port = 18120;
+    std::atomic<int> done = {0};
+    std::atomic<int> finished = {0};
+    uint64_t used_us = 0;
+    {
+        wyze::IOManager server_iom(1, false, "bench_server", backend);
+        wyze::IOManager client_iom(1, false, "bench_client", wyze::IOManager::BACKEND_EPOLL);
+        wyze::Address::ptr addr = wyze::IPAddress::LookupAnyIPAddress("127.0.0.1:" + std::to_string(s_port++));
+        wyze::TcpServer::ptr server;
+        std::atomic<int> bound = {0};       //1 成功，-1 失败
+        server_iom.schedule([&]() {
+            if(http) {
+                wyze::http::HttpServer::ptr hs(new wyze::http::HttpServer(true, &server_iom, &server_iom));
+                hs->getServletDispatch()->addServlet("/bench", [](wyze::http::HttpRequest::ptr req
+                            , wyze::http::HttpResponse::ptr rsp, wyze::http::HttpSession::ptr session) {
+                    rsp->setBody("hello io_uring");
+                    return 0;
+                });
+                server = hs;
+            }
+            else {
+                server.reset(new EchoServer(&server_iom));
+            }
+            bound = server->bind(addr) && server->start() ? 1 : -1;
+        });
+        while(!bound) {
+            usleep(1000);
+        }
+        WYZE_ASSERT(bound == 1);
+
+        uint64_t start = wyze::GetMonotonicUS();
+        for(int i = 0; i < CONNS; ++i) {
+            client_iom.schedule([&]() {
+                done += http ? HttpClient(addr) : EchoClient(addr);
+                ++finished;
+            });
+        }
+        while(finished < CONNS) {
+            usleep(1000);
+        }
+        used_us = wyze::GetMonotonicUS() - start;
+        if(stats) {
+            *stats = server_iom.getUringStats();
+        }
+        server_iom.schedule([&server]() { server->stop(); });
+        client_iom.stop();
+        server_iom.stop();
+    }
+    WYZE_ASSERT(done == CONNS * ROUNDS);
+    return done * 1e6 / used_us;
+}
+
+void bench(bool http)
+{
+    double epoll_qps = Run(wyze::IOManager::BACKEND_EPOLL, http, nullptr);
+    wyze::UringStats stats;
+    double uring_qps = Run(wyze::IOManager::BACKEND_URING, http, &stats);
+    WYZE_LOG_INFO(g_logger) << (http ? "http" : "echo") << " conns=" << CONNS << " rounds=" << ROUNDS
+                            << " epoll=" << (uint64_t)epoll_qps << "/s"
+                            << " io_uring=" << (uint64_t)uring_qps << "/s"
+                            << " uring_ops=" << stats.ops << " submits=" << stats.submits
+                            << " eagain=" << stats.eagain;
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    bench(false);
+    bench(true);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "../wyze/wyze.h"
+#include <math.h>
+#include <stdexcept>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static const size_t COUNT = 2000000;
+static const size_t GRAIN = 4096;
+static const int THREADS = 4;
+
+//每个元素的计算量
+static double Work(size_t i)
+{
+    double x = (double)(i % 1000) + 1.0;
+    for(int k = 0; k < 8; ++k) {
+        x = sqrt(x) + 1.0 / x;
+    }
+    return x;
+}
+
+static double Single()
+{
+    double sum = 0;
+    for(size_t i = 0; i < COUNT; ++i) {
+        sum += Work(i);
+    }
+    return sum;
+}
+
+static double Parallel(wyze::Scheduler* sched)
+{
+    return wyze::parallel_reduce(sched, 0, COUNT, GRAIN, 0.0,
+        [](size_t i) { return Work(i); },
+        [](double a, double b) { return a + b; });
+}
+
+void bench_reduce()
+{
+    uint64_t start = wyze::GetMonotonicUS();
+    double expect = Single();
+    uint64_t single_us = wyze::GetMonotonicUS() - start;
+
+    wyze::Scheduler sched(THREADS, false, "parallel");
+    sched.start();
+
+    start = wyze::GetMonotonicUS();
+    double got = Parallel(&sched);      //调用者是普通线程
+    uint64_t thread_us = wyze::GetMonotonicUS() - start;
+
+    std::atomic<uint64_t> fiber_us = {0};
+    std::atomic<bool> fiber_ok = {false};
+    sched.schedule([&]() {              //调用者是调度器中的协程，等待时只挂起协程
+        uint64_t begin = wyze::GetMonotonicUS();
+        double v = Parallel(&sched);
+        fiber_us = wyze::GetMonotonicUS() - begin;
+        fiber_ok = fabs(v - expect) < 1e-6 * expect;
+    });
+    sched.stop();
+
+    WYZE_LOG_INFO(g_logger) << "bench_reduce count=" << COUNT << " grain=" << GRAIN
+        << " threads=" << THREADS << " cpus=" << sysconf(_SC_NPROCESSORS_ONLN)
+        << " single=" << single_us / 1000 << "ms"
+        << " parallel_from_thread=" << thread_us / 1000 << "ms"
+        << " parallel_from_fiber=" << fiber_us / 1000 << "ms"
+        << " speedup=" << (double)single_us / thread_us;
+    WYZE_ASSERT(fabs(got - expect) < 1e-6 * expect);
+    WYZE_ASSERT(fiber_ok);
+}
+
+void test_for()
+{
+    std::vector<int> out(100000, 0);
+    wyze::Scheduler sched(THREADS, false, "parallel_for");
+    sched.start();
+    wyze::parallel_for(&sched, 0, out.size(), 100, [&out](size_t i) {
+        out[i] += (int)i;
+    });
+
+    bool caught = false;
+    try {
+        wyze::parallel_for(&sched, 0, 1000, 10, [](size_t i) {
+            if(i == 500) {
+                throw std::runtime_error("parallel_for");
+            }
+        });
+    } catch(std::runtime_error& e) {
+        caught = true;
+    }
+    sched.stop();
+
+    for(size_t i = 0; i < out.size(); ++i) {
+        WYZE_ASSERT(out[i] == (int)i);      //每个下标恰好执行一次
+    }
+    WYZE_LOG_INFO(g_logger) << "test_for size=" << out.size() << " caught=" << caught;
+    WYZE_ASSERT(caught);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_for();
+    bench_reduce();
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "../wyze/wyze.h"
+#include <fstream>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<std::map<std::string, std::string>>::ptr g_cpus =
+    wyze::Config::Lookup<std::map<std::string, std::string>>("scheduler.cpus", {}, "");
+
+//从 /proc 读取线程实际生效的 cpu 列表
+static std::string ProcCpusAllowed(pid_t tid)
+{
+    std::ifstream ifs("/proc/self/task/" + std::to_string(tid) + "/status");
+    std::string line;
+    while(std::getline(ifs, line)) {
+        if(line.compare(0, 18, "Cpus_allowed_list:") == 0) {
+            return line.substr(line.find_first_not_of(" \t", 18));
+        }
+    }
+    return "";
+}
+
+void test_parse()
+{
+    std::vector<int> cpus;
+    WYZE_ASSERT(wyze::ParseCpuList("0-3,8, 10-11", cpus));
+    WYZE_ASSERT(wyze::CpuListToString(cpus) == "0,1,2,3,8,10,11");
+    WYZE_ASSERT(!wyze::ParseCpuList("3-1", cpus));
+    WYZE_ASSERT(!wyze::ParseCpuList("a", cpus));
+    WYZE_ASSERT(!wyze::ParseCpuList("", cpus));
+
+    std::vector<std::vector<int>> groups;
+    WYZE_ASSERT(wyze::ParseCpuGroups("0-2", groups));
+    WYZE_ASSERT(groups.size() == 3 && groups[2] == std::vector<int>(1, 2));
+    WYZE_ASSERT(wyze::ParseCpuGroups("0-1;2-3", groups));
+    WYZE_ASSERT(groups.size() == 2 && wyze::CpuListToString(groups[1]) == "2,3");
+    WYZE_LOG_INFO(g_logger) << "test_parse ok";
+}
+
+//每个调度线程在任务中检查 /proc 中的绑核结果
+void test_pin()
+{
+    std::vector<int> allowed = wyze::GetThreadAffinity();
+    int cpu = allowed.back();
+    std::map<std::string, std::string> cpus;
+    cpus["pinned"] = std::to_string(cpu);
+    g_cpus->setVal(cpus);
+
+    std::atomic<int> checked = {0};
+    {
+        wyze::IOManager iom(2, false, "pinned");
+        for(int i = 0; i < 2; ++i) {
+            iom.schedule([&checked, cpu]() {
+                std::string proc = ProcCpusAllowed(wyze::GetThreadId());
+                WYZE_LOG_INFO(g_logger) << "test_pin tid=" << wyze::GetThreadId()
+                    << " Cpus_allowed_list=" << proc << " running_on=" << wyze::GetCurrentCpu();
+                WYZE_ASSERT(proc == std::to_string(cpu));
+                WYZE_ASSERT(wyze::GetThreadAffinity() == std::vector<int>(1, cpu));
+                ++checked;
+            }, iom.getThreadIds()[i]);
+        }
+    }
+    WYZE_ASSERT(checked == 2);
+    //没有配置的调度器不绑核
+    WYZE_ASSERT(wyze::GetThreadAffinity() == allowed);
+    g_cpus->setVal({});
+}
+
+//每个线程反复扫描自己分配的缓冲区，对比绑核前后的耗时
+static uint64_t RunLocality(const std::string& name)
+{
+    static const int THREADS = 4;
+    static const size_t BYTES = 8 * 1024 * 1024;
+    static const int PASSES = 20;
+    std::atomic<uint64_t> sum = {0};
+    uint64_t start = wyze::GetMonotonicUS();
+    {
+        wyze::IOManager iom(THREADS, false, name);
+        for(int i = 0; i < THREADS; ++i) {
+            iom.schedule([&sum]() {
+                std::vector<uint64_t> buf(BYTES / sizeof(uint64_t), 1);  //在本线程首次访问
+                uint64_t local = 0;
+                for(int p = 0; p < PASSES; ++p) {
+                    for(size_t j = 0; j < buf.size(); j += 8) {
+                        local += buf[j];
+                    }
+                }
+                sum += local;
+            }, iom.getThreadIds()[i]);
+        }
+    }
+    WYZE_ASSERT(sum == THREADS * PASSES * BYTES / sizeof(uint64_t) / 8);
+    return wyze::GetMonotonicUS() - start;
+}
+
+void bench_locality()
+{
+    std::map<std::string, std::string> cpus;
+    cpus["locality_pinned"] = wyze::CpuListToString(wyze::GetThreadAffinity());
+    g_cpus->setVal(cpus);
+
+    uint64_t unpinned = RunLocality("locality");
+    uint64_t pinned = RunLocality("locality_pinned");
+    WYZE_LOG_INFO(g_logger) << "bench_locality numa_nodes=" << wyze::GetNumaNodeCount()
+        << " cpus=" << cpus["locality_pinned"]
+        << " unpinned=" << unpinned / 1000 << "ms"
+        << " pinned=" << pinned / 1000 << "ms";
+    g_cpus->setVal({});
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_parse();
+    test_pin();
+    bench_locality();
+    return 0;
+}
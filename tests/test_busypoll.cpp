@@ -0,0 +1,159 @@
+#include "../wyze/wyze.h"
+#include "../wyze/fdmanager.h"
+#include <sys/epoll.h>
+#include <dlfcn.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<uint64_t>::ptr g_busy_poll_us =
+    wyze::Config::Lookup<uint64_t>("iomanager.busy_poll_us", 0, "");
+
+static std::atomic<uint64_t> s_blocking_waits = {0};
+
+//统计会阻塞的 epoll_wait 调用，忙轮询的 epoll_wait 超时为 0，不计入
+extern "C" int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout)
+{
+    using epoll_wait_fun = int (*)(int, struct epoll_event*, int, int);
+    static epoll_wait_fun s_real = (epoll_wait_fun)dlsym(RTLD_NEXT, "epoll_wait");
+    if(timeout != 0) {
+        ++s_blocking_waits;
+    }
+    return s_real(epfd, events, maxevents, timeout);
+}
+
+//两个线程共享一个 epoll，服务端协程回显，外部线程每隔 gap 发一次请求。
+//返回稳定阶段进入阻塞 epoll_wait 的次数
+uint64_t test_shared(uint64_t busy_us)
+{
+    static const int WARMUP = 100;
+    static const int ROUNDS = 2000;
+    static const int GAP_US = 100;
+    uint64_t waits = 0;
+    g_busy_poll_us->setVal(busy_us);
+    {
+        wyze::IOManager iom(2, false, "busypoll");
+        g_busy_poll_us->setVal(0);
+        WYZE_ASSERT(iom.getBusyPollUs() == busy_us && !iom.isMultiReactor());
+
+        int fds[2];
+        WYZE_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        iom.schedule([fds]() {
+            wyze::FdMgr::GetInstance()->get(fds[0], true);
+            char buf[64];
+            int n;
+            while((n = recv(fds[0], buf, sizeof(buf), 0)) > 0) {
+                WYZE_ASSERT(send(fds[0], buf, n, 0) == n);
+            }
+            close(fds[0]);
+        });
+
+        //主线程没有 hook，读写真正阻塞
+        uint64_t start = 0;
+        for(int i = 0; i < WARMUP + ROUNDS; ++i) {
+            if(i == WARMUP) {
+                start = s_blocking_waits;
+            }
+            usleep(GAP_US);
+            char out[32], in[32];
+            int n = snprintf(out, sizeof(out), "round %d", i);
+            WYZE_ASSERT(write(fds[1], out, n) == n);
+            WYZE_ASSERT(recv(fds[1], in, n, MSG_WAITALL) == n && memcmp(in, out, n) == 0);
+        }
+        waits = s_blocking_waits - start;
+        close(fds[1]);
+    }
+    WYZE_LOG_INFO(g_logger) << "test_shared busy_poll_us=" << busy_us
+                            << " blocking_epoll_waits=" << waits;
+    return waits;
+}
+
+//忙轮询期间定时器照常触发，预算用完后线程回到 epoll_wait，IO 仍然能唤醒
+void test_budget()
+{
+    g_busy_poll_us->setVal(2000);
+    std::atomic<int> fired = {0};
+    {
+        wyze::IOManager iom(2, false, "busypoll_budget");
+        g_busy_poll_us->setVal(0);
+        for(int i = 0; i < 10; ++i) {
+            iom.addTimer(i, [&fired]() { ++fired; });
+        }
+        usleep(50 * 1000);
+        WYZE_ASSERT(fired == 10);
+
+        //预算早已用完，这次读等待只能由阻塞的 epoll_wait 唤醒
+        uint64_t before = s_blocking_waits;
+        std::atomic<bool> done = {false};
+        int fds[2];
+        WYZE_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        iom.schedule([fds, &done]() {
+            wyze::FdMgr::GetInstance()->get(fds[0], true);
+            char c = 0;
+            WYZE_ASSERT(recv(fds[0], &c, 1, 0) == 1 && c == 'x');
+            done = true;
+        });
+        usleep(50 * 1000);
+        WYZE_ASSERT(write(fds[1], "x", 1) == 1);
+        for(int i = 0; i < 100 && !done; ++i) {
+            usleep(1000);
+        }
+        WYZE_ASSERT(done && s_blocking_waits > before);
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+//忙轮询的线程去执行一个不让出的长任务时，另一个线程接替处理定时器和 IO，延迟不受长任务影响
+void test_long_task()
+{
+    static const uint64_t LONG_US = 500 * 1000;
+    g_busy_poll_us->setVal(200 * 1000);
+    uint64_t timer_late = ~0ull;
+    uint64_t io_late = ~0ull;
+    {
+        wyze::IOManager iom(2, false, "busypoll_long");
+        g_busy_poll_us->setVal(0);
+
+        int fds[2];
+        WYZE_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        std::atomic<uint64_t> sent_us = {0};
+        iom.schedule([fds, &sent_us, &io_late]() {
+            wyze::FdMgr::GetInstance()->get(fds[0], true);
+            char c = 0;
+            WYZE_ASSERT(recv(fds[0], &c, 1, 0) == 1);
+            io_late = wyze::GetMonotonicUS() - sent_us;
+        });
+        usleep(20 * 1000);
+
+        iom.schedule([]() {
+            uint64_t start = wyze::GetMonotonicUS();
+            while(wyze::GetMonotonicUS() - start < LONG_US);
+        });
+        usleep(10 * 1000);
+
+        uint64_t added_us = wyze::GetMonotonicUS();
+        iom.addTimer(50, [added_us, &timer_late]() {
+            timer_late = wyze::GetMonotonicUS() - added_us - 50 * 1000;
+        });
+        usleep(100 * 1000);
+        sent_us = wyze::GetMonotonicUS();
+        WYZE_ASSERT(write(fds[1], "x", 1) == 1);
+        usleep(LONG_US);
+        close(fds[0]);
+        close(fds[1]);
+    }
+    WYZE_LOG_INFO(g_logger) << "test_long_task timer_late=" << timer_late << "us io_late=" << io_late << "us";
+    WYZE_ASSERT(timer_late < 200 * 1000 && io_late < 200 * 1000);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    WYZE_ASSERT(test_shared(0) > 0);
+    WYZE_ASSERT(test_shared(1000 * 1000) == 0);
+    test_budget();
+    test_long_task();
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "../wyze/wyze.h"
+#include <stdlib.h>
+#include <new>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//统计全局的堆分配次数
+static std::atomic<uint64_t> g_allocs = {0};
+
+void* operator new(size_t size)
+{
+    ++g_allocs;
+    void* p = malloc(size ? size : 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void test_basic()
+{
+    int calls = 0;
+    uint64_t a = 1, b = 2, c = 3, d = 4;
+    wyze::Callable small([&calls, a, b, c, d]() { calls += a + b + c + d; });
+    WYZE_ASSERT(small.isInline() && small.copyable());
+    wyze::Callable moved(std::move(small));
+    WYZE_ASSERT(!small && moved);
+    moved();
+    WYZE_ASSERT(calls == 10);
+
+    struct MoveOnly {
+        std::unique_ptr<int> p;
+        int* out;
+        void operator()() { *out = *p; }
+    };
+    int got = 0;
+    wyze::Callable move_only(MoveOnly{std::unique_ptr<int>(new int(5)), &got});
+    WYZE_ASSERT(move_only.isInline() && !move_only.copyable() && !move_only.clone());
+    move_only();
+    WYZE_ASSERT(got == 5);
+
+    char big[128] = {0};
+    big[127] = 7;
+    wyze::Callable large([big, &got]() { got = big[127]; });
+    WYZE_ASSERT(!large.isInline());
+    wyze::Callable copy = large.clone();
+    large = nullptr;
+    copy();
+    WYZE_ASSERT(got == 7);
+
+    std::function<void()> empty;
+    WYZE_ASSERT(!wyze::Callable(empty));
+    WYZE_LOG_INFO(g_logger) << "test_basic ok sizeof(Callable)=" << sizeof(wyze::Callable);
+}
+
+//调度线程上 schedule 捕获 40 字节的 lambda，除了队列分块外不应该有堆分配
+void test_schedule_allocs()
+{
+    static const int COUNT = 10000;
+    std::atomic<int> done = {0};
+    uint64_t allocs = 0;
+    {
+        wyze::IOManager iom(1, false, "callable");
+        iom.schedule([&]() {
+            wyze::Scheduler* sched = wyze::Scheduler::GetThis();
+            uint64_t a = 1, b = 2, c = 3;
+            //先跑一轮，让协程池和队列分块预热
+            for(int i = 0; i < 100; ++i) {
+                sched->schedule([&done, a, b, c, sched]() { done += (a + b + c) / 6; });
+            }
+            wyze::Fiber::YeildToReady();
+            while(done < 100) {
+                wyze::Fiber::YeildToReady();
+            }
+
+            uint64_t before = g_allocs;
+            for(int i = 0; i < COUNT; ++i) {
+                sched->schedule([&done, a, b, c, sched]() { done += (a + b + c) / 6; });
+            }
+            while(done < 100 + COUNT) {
+                wyze::Fiber::YeildToReady();
+            }
+            allocs = g_allocs - before;
+        });
+    }
+    double per_task = (double)allocs / COUNT;
+    WYZE_LOG_INFO(g_logger) << "test_schedule_allocs tasks=" << COUNT
+                            << " allocs=" << allocs << " per_task=" << per_task;
+    WYZE_ASSERT(per_task < 0.5);    //只剩 deque 每几个任务一次的分块
+}
+
+//循环定时器每次超时都执行同一个只能移动的回调
+void test_timer()
+{
+    std::atomic<int> fired = {0};
+    {
+        wyze::IOManager iom(1, false, "callable_timer");
+        std::unique_ptr<int> step(new int(1));
+        struct Tick {
+            std::unique_ptr<int> step;
+            std::atomic<int>* fired;
+            void operator()() { *fired += *step; }
+        };
+        wyze::Timer::ptr timer = iom.addTimer(5, Tick{std::move(step), &fired}, true);
+        std::shared_ptr<int> cond = std::make_shared<int>(0);
+        iom.addConditionTimer(5, [&fired]() { fired += 100; }, cond);
+        cond.reset();   //条件失效，不执行
+        iom.addTimer(60, [timer]() { timer->cancel(); });
+    }
+    WYZE_LOG_INFO(g_logger) << "test_timer fired=" << fired;
+    WYZE_ASSERT(fired >= 3 && fired < 100);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_basic();
+    test_schedule_allocs();
+    test_timer();
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "../wyze/wyze.h"
+#include <arpa/inet.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//在 127.0.0.1 上建立一对连接好的 socket，需要在开启 hook 的协程中调用
+static bool MakeConnection(int& client, int& server)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 1)
+            || getsockname(listener, (sockaddr*)&addr, &len)) {
+        close(listener);
+        return false;
+    }
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(client, (sockaddr*)&addr, sizeof(addr))) {
+        close(listener);
+        close(client);
+        return false;
+    }
+    server = accept(listener, nullptr, nullptr);
+    close(listener);
+    return server >= 0;
+}
+
+//阻塞在 recv 上的协程被令牌唤醒，fd 之后还能正常使用
+void test_recv()
+{
+    bool checked = false;
+    {
+        wyze::IOManager iom(2, false, "cancel_recv");
+        iom.schedule([&checked]() {
+            int client = -1, server = -1;
+            WYZE_ASSERT(MakeConnection(client, server));
+            wyze::CancelToken::ptr token = wyze::CancelToken::Create();
+            wyze::IOManager::GetThis()->addTimer(50, [token]() { token->cancel(); });
+
+            wyze::CancelToken::SetCurrent(token);
+            char buf[16];
+            uint64_t start = wyze::GetCurrentMS();
+            int rt = recv(client, buf, sizeof(buf), 0);
+            int err = errno;
+            uint64_t used = wyze::GetCurrentMS() - start;
+            WYZE_LOG_INFO(g_logger) << "test_recv rt=" << rt << " errno=" << err << " used=" << used << "ms";
+            WYZE_ASSERT(rt == -1 && err == ECANCELED && used < 1000);
+
+            //已经取消的令牌让下一次等待立即返回
+            rt = recv(client, buf, sizeof(buf), 0);
+            WYZE_ASSERT(rt == -1 && errno == ECANCELED);
+
+            wyze::CancelToken::SetCurrent(nullptr);
+            WYZE_ASSERT(send(server, "ok", 2, 0) == 2);
+            rt = recv(client, buf, sizeof(buf), 0);
+            WYZE_ASSERT(rt == 2 && memcmp(buf, "ok", 2) == 0);
+            close(client);
+            close(server);
+            checked = true;
+        });
+    }
+    WYZE_ASSERT(checked);
+}
+
+//cancelAfter 作为截止时间，唤醒 sleep
+void test_sleep()
+{
+    bool checked = false;
+    {
+        wyze::IOManager iom(1, false, "cancel_sleep");
+        iom.schedule([&checked]() {
+            wyze::CancelToken::ptr token = wyze::CancelToken::Create();
+            wyze::CancelToken::SetCurrent(token);
+            WYZE_ASSERT(usleep(10 * 1000) == 0);     //没有取消时正常睡眠
+
+            token->cancelAfter(50);
+            uint64_t start = wyze::GetCurrentMS();
+            int rt = usleep(5 * 1000 * 1000);
+            int err = errno;
+            uint64_t used = wyze::GetCurrentMS() - start;
+            WYZE_LOG_INFO(g_logger) << "test_sleep rt=" << rt << " errno=" << err << " used=" << used << "ms";
+            WYZE_ASSERT(rt == -1 && err == ECANCELED && used < 1000);
+            WYZE_ASSERT(sleep(5) == 5 && errno == ECANCELED);
+            checked = true;
+        });
+    }
+    WYZE_ASSERT(checked);
+}
+
+//channel 的接收和 select 被取消，channel 之后还能正常使用
+void test_channel()
+{
+    int checked = 0;
+    {
+        wyze::IOManager iom(2, false, "cancel_channel");
+        auto ch = std::make_shared<wyze::Channel<int>>(1);
+        iom.schedule([ch, &checked]() {
+            wyze::CancelToken::ptr token = wyze::CancelToken::Create();
+            token->cancelAfter(30);
+            wyze::CancelToken::SetCurrent(token);
+            int v = 0;
+            WYZE_ASSERT(!ch->recv(v) && errno == ECANCELED);
+
+            wyze::CancelToken::SetCurrent(wyze::CancelToken::Create());
+            wyze::CancelToken::GetCurrent()->cancelAfter(30);
+            wyze::Select sel;
+            sel.recv(*ch, v);
+            WYZE_ASSERT(sel.wait() == -1 && errno == ECANCELED);
+
+            wyze::CancelToken::SetCurrent(nullptr);
+            WYZE_ASSERT(ch->recv(v) && v == 7);
+            ++checked;
+        });
+        iom.schedule([ch, &checked]() {
+            usleep(200 * 1000);
+            WYZE_ASSERT(ch->send(7));
+            ++checked;
+        });
+    }
+    WYZE_ASSERT(checked == 2);
+}
+
+//子协程通过 Bind 继承令牌，取消父令牌时子令牌一起取消
+void test_child()
+{
+    std::atomic<int> cancelled = {0};
+    {
+        wyze::IOManager iom(2, false, "cancel_child");
+        iom.schedule([&cancelled]() {
+            wyze::CancelToken::ptr parent = wyze::CancelToken::Create();
+            wyze::CancelToken::SetCurrent(parent);
+            wyze::Scheduler* sched = wyze::Scheduler::GetThis();
+            for(int i = 0; i < 4; ++i) {
+                //一半直接继承父令牌，一半使用子令牌
+                wyze::CancelToken::ptr token = i % 2 ? wyze::CancelToken::Create(parent) : parent;
+                sched->schedule(wyze::CancelToken::Bind([&cancelled]() {
+                    if(usleep(5 * 1000 * 1000) == -1 && errno == ECANCELED) {
+                        ++cancelled;
+                    }
+                }, token));
+            }
+            usleep(50 * 1000);
+            parent->cancel();
+            WYZE_ASSERT(wyze::CancelToken::Create(parent)->isCancelled());
+        });
+    }
+    WYZE_LOG_INFO(g_logger) << "test_child cancelled=" << cancelled;
+    WYZE_ASSERT(cancelled == 4);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_recv();
+    test_sleep();
+    test_channel();
+    test_child();
+    return 0;
+}
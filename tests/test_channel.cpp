@@ -0,0 +1,166 @@
+#include "../wyze/wyze.h"
+#include "../wyze/channel.h"
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//同一个线程上的两个协程来回传递
+void test_pingpong()
+{
+    static const int ROUNDS = 100000;
+    wyze::Channel<int> ping(1);
+    wyze::Channel<int> pong(1);
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(1, false, "pingpong");
+        iom.schedule([&]() {
+            int v = 0;
+            for(int i = 0; i < ROUNDS; ++i) {
+                ping.send(i);
+                pong.recv(v);
+                WYZE_ASSERT(v == i);
+            }
+            ping.close();
+        });
+        iom.schedule([&]() {
+            int v = 0;
+            while(ping.recv(v)) {
+                pong.send(v);
+            }
+        });
+    }
+    WYZE_LOG_INFO(g_logger) << "test_pingpong rounds=" << ROUNDS
+                            << " used=" << (wyze::GetCurrentMS() - start) << "ms";
+}
+
+//多个生产者多个消费者，跨线程
+void test_mpmc()
+{
+    static const int PRODUCERS = 4;
+    static const int CONSUMERS = 4;
+    static const int ITEMS = 20000;
+    wyze::Channel<int> ch(64);
+    std::atomic<int64_t> sum = {0};
+    std::atomic<int> count = {0};
+    std::atomic<int> producers = {PRODUCERS};
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(4, false, "mpmc");
+        for(int i = 0; i < CONSUMERS; ++i) {
+            iom.schedule([&]() {
+                int v = 0;
+                while(ch.recv(v)) {
+                    sum += v;
+                    ++count;
+                }
+            });
+        }
+        for(int i = 0; i < PRODUCERS; ++i) {
+            iom.schedule([&]() {
+                for(int j = 1; j <= ITEMS; ++j) {
+                    WYZE_ASSERT(ch.send(j));
+                }
+                if(--producers == 0) {
+                    ch.close();
+                }
+            });
+        }
+    }
+    WYZE_LOG_INFO(g_logger) << "test_mpmc count=" << count << " sum=" << sum
+                            << " used=" << (wyze::GetCurrentMS() - start) << "ms";
+    WYZE_ASSERT(count == PRODUCERS * ITEMS);
+    WYZE_ASSERT(sum == (int64_t)PRODUCERS * ITEMS * (ITEMS + 1) / 2);
+}
+
+//非阻塞操作、超时和关闭
+void test_timeout()
+{
+    wyze::IOManager iom(2, false, "timeout");
+    iom.schedule([]() {
+        wyze::Channel<std::string> ch(2);
+        std::string v;
+        WYZE_ASSERT(!ch.tryRecv(v));
+        WYZE_ASSERT(ch.trySend("a"));
+        WYZE_ASSERT(ch.trySend("b"));
+        WYZE_ASSERT(!ch.trySend("c"));
+
+        uint64_t start = wyze::GetCurrentMS();
+        WYZE_ASSERT(!ch.send("c", 50));     //满了，超时
+        uint64_t used = wyze::GetCurrentMS() - start;
+        WYZE_ASSERT(used >= 50);
+
+        WYZE_ASSERT(ch.recv(v) && v == "a");
+        ch.close();
+        WYZE_ASSERT(!ch.send("d"));
+        WYZE_ASSERT(ch.recv(v) && v == "b");    //关闭前的数据还能取到
+        WYZE_ASSERT(!ch.recv(v));
+
+        wyze::Channel<int> empty(1);
+        int i = 0;
+        start = wyze::GetCurrentMS();
+        WYZE_ASSERT(!empty.recv(i, 50));
+        WYZE_LOG_INFO(g_logger) << "test_timeout send_wait=" << used
+                                << "ms recv_wait=" << (wyze::GetCurrentMS() - start) << "ms";
+    });
+}
+
+//select 等待多个 channel
+void test_select()
+{
+    wyze::IOManager iom(2, false, "select");
+    std::shared_ptr<wyze::Channel<int>> a = std::make_shared<wyze::Channel<int>>(4);
+    std::shared_ptr<wyze::Channel<std::string>> b = std::make_shared<wyze::Channel<std::string>>(4);
+    iom.schedule([a, b]() {
+        int av = 0;
+        std::string bv;
+        int got_a = 0, got_b = 0, timeouts = 0;
+        while(got_a + got_b < 20) {
+            wyze::Select sel;
+            int ia = sel.recv(*a, av);
+            int ib = sel.recv(*b, bv);
+            int rt = sel.wait(100);
+            if(rt == ia) {
+                ++got_a;
+            }
+            else if(rt == ib) {
+                ++got_b;
+            }
+            else {
+                ++timeouts;
+            }
+        }
+
+        wyze::Select sel;
+        sel.recv(*a, av);
+        uint64_t start = wyze::GetCurrentMS();
+        int rt = sel.wait(30);
+        WYZE_LOG_INFO(g_logger) << "test_select a=" << got_a << " b=" << got_b
+                                << " timeouts=" << timeouts
+                                << " empty_wait=" << (wyze::GetCurrentMS() - start) << "ms";
+        WYZE_ASSERT(got_a == 10 && got_b == 10 && rt == -1);
+
+        bool ok = true;
+        a->close();
+        wyze::Select closed;
+        closed.recv(*a, av, &ok);
+        WYZE_ASSERT(closed.wait() == 0 && !ok);
+    });
+    iom.schedule([a, b]() {
+        for(int i = 0; i < 10; ++i) {
+            a->send(i);
+            usleep(1000);
+            b->send(std::to_string(i));
+        }
+    });
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_pingpong();
+    test_mpmc();
+    test_timeout();
+    test_select();
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "../wyze/wyze.h"
+#include "../wyze/coroutine.h"
+#include <sys/socket.h>
+#include <stdexcept>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+using namespace std::chrono_literals;
+
+wyze::task<int> add_later(int a, int b)
+{
+    co_await wyze::sleep(1ms);
+    co_return a + b;
+}
+
+wyze::task<int> fail_later()
+{
+    co_await wyze::sleep(1ms);
+    throw std::runtime_error("fail_later");
+    co_return 0;
+}
+
+//嵌套 task、返回值和异常
+void test_task()
+{
+    std::atomic<int> result = {0};
+    std::atomic<bool> caught = {false};
+    {
+        wyze::IOManager iom(2, false, "task");
+        wyze::co_spawn(&iom, [&]() -> wyze::task<> {
+            int sum = 0;
+            for(int i = 0; i < 10; ++i) {
+                sum += co_await add_later(i, 1);
+            }
+            result = sum;
+            try {
+                co_await fail_later();
+            } catch(std::exception& e) {
+                caught = true;
+            }
+        }());
+    }
+    WYZE_LOG_INFO(g_logger) << "test_task result=" << result << " caught=" << caught;
+    WYZE_ASSERT(result == 55 && caught);
+}
+
+//大量并发的协程只占用协程帧
+void test_fanout()
+{
+    static const int COUNT = 10000;
+    std::atomic<int> done = {0};
+    uint64_t fibers = 0;
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(2, false, "fanout");
+        for(int i = 0; i < COUNT; ++i) {
+            wyze::co_spawn(&iom, [&]() -> wyze::task<> {
+                co_await wyze::sleep(50ms);
+                ++done;
+            }());
+        }
+        usleep(20 * 1000);
+        fibers = wyze::Fiber::TotalFibers();    //所有协程都在等待定时器
+    }
+    WYZE_LOG_INFO(g_logger) << "test_fanout coroutines=" << COUNT << " done=" << done
+                            << " fibers_while_waiting=" << fibers
+                            << " used=" << (wyze::GetCurrentMS() - start) << "ms";
+    WYZE_ASSERT(done == COUNT);
+}
+
+//socketpair 上的 echo，协程和 hook 的 Fiber 混用
+void test_socket()
+{
+    static const int ROUNDS = 1000;
+    int fds[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    WYZE_ASSERT(!rt);
+    std::atomic<int> ok = {0};
+    std::atomic<bool> timed_out = {false};
+    {
+        wyze::IOManager iom(2, false, "socket");
+        //服务端是协程
+        wyze::co_spawn(&iom, [&]() -> wyze::task<> {
+            char buf[64];
+            while(true) {
+                ssize_t n = co_await wyze::async_recv(fds[0], buf, sizeof(buf));
+                if(n <= 0) {
+                    break;
+                }
+                co_await wyze::async_send(fds[0], buf, n);
+            }
+            close(fds[0]);
+        }());
+        //没有数据的 fd 等待超时
+        wyze::co_spawn(&iom, [&]() -> wyze::task<> {
+            int idle[2];
+            WYZE_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, idle));
+            char c;
+            ssize_t n = co_await wyze::async_recv(idle[0], &c, 1, 0, 20);
+            timed_out = (n == -1 && errno == ETIMEDOUT);
+            close(idle[0]);
+            close(idle[1]);
+        }());
+        //客户端是 Fiber，使用 hook 的阻塞调用
+        iom.schedule([&]() {
+            fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+            for(int i = 0; i < ROUNDS; ++i) {
+                std::string msg = "hello " + std::to_string(i);
+                write(fds[1], msg.c_str(), msg.size());
+                char buf[64] = {0};
+                size_t got = 0;
+                while(got < msg.size()) {
+                    ssize_t n = read(fds[1], buf + got, sizeof(buf) - got);
+                    if(n > 0) {
+                        got += n;
+                    }
+                    else {
+                        wyze::Fiber::YeildToReady();
+                    }
+                }
+                if(msg == std::string(buf, got)) {
+                    ++ok;
+                }
+            }
+            shutdown(fds[1], SHUT_WR);
+        });
+    }
+    close(fds[1]);
+    WYZE_LOG_INFO(g_logger) << "test_socket ok=" << ok << " timed_out=" << timed_out;
+    WYZE_ASSERT(ok == ROUNDS && timed_out);
+}
+
+//Socket::ptr 版本的 task 开始执行前调用者已经释放了 socket，fd 仍然有效
+void test_socket_lifetime()
+{
+    wyze::Address::ptr addr = wyze::IPAddress::LookupAnyIPAddress("127.0.0.1:0");
+    wyze::Socket::ptr listener = wyze::Socket::CreateTCP(addr);
+    WYZE_ASSERT(listener->bind(addr) && listener->listen());
+    wyze::Socket::ptr client = wyze::Socket::CreateTCP(addr);
+    WYZE_ASSERT(client->connect(listener->getLocalAddress()));
+    wyze::Socket::ptr conn = listener->accept();
+    WYZE_ASSERT(conn);
+
+    std::atomic<ssize_t> n = {0};
+    {
+        wyze::IOManager iom(1, false, "lifetime");
+        wyze::co_spawn(&iom, [&]() -> wyze::task<> {
+            char buf[16];
+            wyze::task<ssize_t> t = wyze::async_recv(client, buf, sizeof(buf));
+            client.reset();     //只剩 task 持有 socket
+            n = co_await t;
+        }());
+        usleep(20 * 1000);
+        WYZE_ASSERT(conn->send("ping", 4) == 4);
+    }
+    WYZE_LOG_INFO(g_logger) << "test_socket_lifetime n=" << n;
+    WYZE_ASSERT(n == 4);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_task();
+    test_fanout();
+    test_socket();
+    test_socket_lifetime();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "../wyze/wyze.h"
+#include <algorithm>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<std::map<std::string, std::string>>::ptr g_elastic =
+    wyze::Config::Lookup<std::map<std::string, std::string>>("scheduler.elastic", {}, "");
+
+//没有 hook 的阻塞调用卡住唯一的线程时增加线程，空闲后退回最小线程数
+void test_grow_and_retire()
+{
+    wyze::Config::Lookup<uint64_t>("scheduler.slice_warn_ms", 100, "")->setVal(0);
+    wyze::Config::Lookup<uint64_t>("scheduler.elastic_stuck_ms", 200, "")->setVal(50);
+    wyze::Config::Lookup<uint64_t>("scheduler.elastic_queue_wait_ms", 20, "")->setVal(5);
+    wyze::Config::Lookup<uint64_t>("scheduler.elastic_idle_ms", 10000, "")->setVal(300);
+    std::map<std::string, std::string> elastic;
+    elastic["elastic"] = "1-4";
+    g_elastic->setVal(elastic);
+
+    static const int SMALL = 20;
+    std::atomic<int> small_done = {0};
+    std::atomic<int> small_before_blocker = {0};
+    std::atomic<bool> blocker_done = {false};
+    wyze::IOManager iom(1, false, "elastic");
+    WYZE_ASSERT(iom.getStats().workers == 1);
+
+    iom.schedule([&blocker_done]() {
+        wyze::set_hook_enable(false);
+        usleep(500 * 1000);     //真正阻塞线程，不会让出
+        wyze::set_hook_enable(true);
+        blocker_done = true;
+    });
+    usleep(10 * 1000);
+    uint64_t start = wyze::GetMonotonicUS();
+    for(int i = 0; i < SMALL; ++i) {
+        iom.schedule([&]() {
+            if(!blocker_done) {
+                ++small_before_blocker;
+            }
+            ++small_done;
+        });
+    }
+    while(small_done < SMALL) {
+        usleep(1000);
+    }
+    uint64_t latency = wyze::GetMonotonicUS() - start;
+    wyze::SchedulerStats stats = iom.getStats();
+    WYZE_LOG_INFO(g_logger) << "test_grow small_latency=" << latency / 1000 << "ms "
+                            << "before_blocker=" << small_before_blocker << "\n" << stats.toString();
+    WYZE_ASSERT(small_before_blocker == SMALL);
+    WYZE_ASSERT(stats.grow_stuck >= 1 && stats.workers >= 2);
+    std::vector<int> grown = iom.getThreadIds();
+
+    while(!blocker_done) {
+        usleep(10 * 1000);
+    }
+    //空闲超过 elastic_idle_ms 后多出来的线程退出
+    for(int i = 0; i < 200 && iom.getStats().workers > 1; ++i) {
+        usleep(10 * 1000);
+    }
+    stats = iom.getStats();
+    WYZE_LOG_INFO(g_logger) << "test_retire\n" << stats.toString();
+    WYZE_ASSERT(stats.retired >= 1 && stats.workers == 1);
+
+    //指定给已经退出的线程的任务由任意线程执行，不会让 stop 一直等待
+    std::vector<int> live = iom.getThreadIds();
+    int retired_tid = -1;
+    for(auto& i : grown) {
+        if(std::find(live.begin(), live.end(), i) == live.end()) {
+            retired_tid = i;
+        }
+    }
+    WYZE_ASSERT(retired_tid != -1);
+    std::atomic<bool> pinned_done = {false};
+    iom.schedule([&pinned_done]() { pinned_done = true; }, retired_tid);
+    for(int i = 0; i < 200 && !pinned_done; ++i) {
+        usleep(10 * 1000);
+    }
+    WYZE_LOG_INFO(g_logger) << "test_retired_pin tid=" << retired_tid << " done=" << pinned_done;
+    WYZE_ASSERT(pinned_done);
+
+    //退出后仍然可以正常调度，必要时再次增加线程
+    std::atomic<int> after = {0};
+    for(int i = 0; i < SMALL; ++i) {
+        iom.schedule([&after]() { ++after; });
+    }
+    while(after < SMALL) {
+        usleep(1000);
+    }
+    iom.stop();
+    g_elastic->setVal({});
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_grow_and_retire();
+    return 0;
+}
@@ -67,29 +67,29 @@ void test3()
 
 static wyze::Logger::ptr g_logger = WYZE_LOG_NAME("system");
 
-void test_fiber_fun()
+void test_fiber_fun(std::atomic<int>& total)
 {
     int count = 0;
     for(; count < 10; count++) {
         WYZE_LOG_INFO(g_logger) << "test_fiber count = " << count ;
+        ++total;
         wyze::Fiber::YeildToReady();
     }
 
 }
 
+//swapIn 需要调度协程，线程自己作为唯一的调度线程，两个协程交替执行
 void test_fiber()
 {
-    // wyze::Thread::SetName("main");
-    wyze::Fiber::GetThis();
-    wyze::Fiber::ptr fiber(new wyze::Fiber(&test_fiber_fun, 1024 * 1024));
-    wyze::Fiber::ptr fiber2(new wyze::Fiber(&test_fiber_fun, 1024 * 1024));
-
-    for(int i = 0; i < 12; ++i) {
-        WYZE_LOG_INFO(g_logger) << "main fiber i " << i ;
-        fiber->swapIn();
-        fiber2->swapIn();
+    std::atomic<int> total = {0};
+    wyze::Scheduler sc(1, true, wyze::Thread::GetName());
+    for(int i = 0; i < 2; ++i) {
+        sc.schedule(wyze::Fiber::ptr(new wyze::Fiber([&total]() { test_fiber_fun(total); }, 1024 * 1024)));
     }
+    sc.start();
+    sc.stop();
     WYZE_LOG_INFO(g_logger) << "test_fiber  end" ;
+    WYZE_ASSERT(total == 20);
 }
 
 void test_thread_fiber()
@@ -108,6 +108,113 @@ void test_thread_fiber()
 }
 
 
+//大量短任务，结束的协程会放回缓存，再次调度时复用
+void test_fiber_pool()
+{
+    wyze::Scheduler sc(2, false, "pool");
+    sc.start();
+    uint64_t start = wyze::GetCurrentMS();
+    std::atomic<uint64_t> hits = {0};
+    for(int i = 0; i < 100000; ++i) {
+        sc.schedule([]() { });
+    }
+    for(int i = 0; i < 2; ++i) {
+        sc.schedule([&hits]() {
+            wyze::FiberPool::Stats stats = wyze::FiberPool::GetStats();
+            hits += stats.hits;
+            WYZE_LOG_INFO(g_logger) << "fiber pool hits=" << stats.hits
+                << " misses=" << stats.misses
+                << " drops=" << stats.drops
+                << " size=" << stats.size
+                << " high_water=" << stats.highWater;
+        });
+    }
+    sc.stop();
+    WYZE_LOG_INFO(g_logger) << "test_fiber_pool used=" << (wyze::GetCurrentMS() - start) << "ms"
+        << " total_fibers=" << wyze::Fiber::TotalFibers();
+    WYZE_ASSERT(hits > 0);
+}
+
+//mmap 分配 128K 的栈，协程只用到很少的栈时，实际占用的物理内存只有几页
+void test_stack_allocator()
+{
+    wyze::Config::Lookup<std::string>("fiber.stack_allocator")->setVal("mmap");
+
+    static const int COUNT = 1000;
+    std::vector<wyze::Fiber::ptr> fibers;
+    wyze::Scheduler sc(1, false, "stack");
+    sc.start();
+    for(int i = 0; i < COUNT; ++i) {
+        wyze::Fiber::ptr fiber(new wyze::Fiber([]() {
+            char buf[1024];
+            memset(buf, 0, sizeof(buf));
+            wyze::Fiber::YeildToHold();
+        }, 128 * 1024));
+        fibers.push_back(fiber);
+        sc.schedule(fiber);
+    }
+    sleep(1);
+
+    size_t resident = 0;
+    for(auto& i : fibers) {
+        resident += i->getStackResident();
+    }
+    WYZE_LOG_INFO(g_logger) << "fibers=" << COUNT
+        << " stack_total=" << wyze::Fiber::TotalStackSize()
+        << " resident=" << resident
+        << " resident_per_fiber=" << resident / COUNT;
+    WYZE_ASSERT(resident > 0 && resident / COUNT <= 16 * 1024);
+
+    for(auto& i : fibers) {
+        sc.schedule(i);
+    }
+    fibers.clear();
+    sc.stop();
+    wyze::Config::Lookup<std::string>("fiber.stack_allocator")->setVal("malloc");
+}
+
+//共享栈协程挂起时只保存用到的栈，检查恢复后栈上的数据没有被其他协程破坏
+void test_shared_stack()
+{
+    static const int COUNT = 1000;
+    static std::atomic<int> s_ok = {0};
+    std::vector<wyze::Fiber::ptr> fibers;
+    wyze::Scheduler sc(2, false, "shared");
+    sc.start();
+    for(int i = 0; i < COUNT; ++i) {
+        wyze::Fiber::ptr fiber(new wyze::Fiber([i]() {
+            char buf[512];
+            memset(buf, i % 128, sizeof(buf));
+            wyze::Fiber::YeildToHold();
+            for(auto& c : buf) {
+                if(c != i % 128)
+                    return;
+            }
+            ++s_ok;
+        }, 0, false, true));
+        fibers.push_back(fiber);
+        sc.schedule(fiber);
+    }
+    sleep(1);
+
+    size_t saved = 0;
+    for(auto& i : fibers) {
+        saved += i->getStackResident();
+    }
+    WYZE_LOG_INFO(g_logger) << "shared stack fibers=" << COUNT
+        << " saved=" << saved
+        << " saved_per_fiber=" << saved / COUNT;
+    WYZE_ASSERT(saved > 0 && saved / COUNT <= 16 * 1024);
+
+    for(auto& i : fibers) {
+        sc.schedule(i);
+    }
+    fibers.clear();
+    sc.stop();
+    WYZE_LOG_INFO(g_logger) << "shared stack ok=" << s_ok;
+    WYZE_ASSERT(s_ok == COUNT);
+}
+
 int main(int argc, char** argv)
 {
     std::cout << "main start\n";
@@ -115,7 +222,10 @@ int main(int argc, char** argv)
     // test2();
     // test3();
     // test_fiber();
+    test_fiber_pool();
+    test_stack_allocator();
+    test_shared_stack();
     test_thread_fiber();
-    std::cout << "main endl\n"; //这里也不会在执行
+    std::cout << "main endl\n";
     return 0;
 }
\ No newline at end of file
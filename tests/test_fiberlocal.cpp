@@ -0,0 +1,108 @@
+#include "../wyze/wyze.h"
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//请求上下文，统计构造和析构次数
+struct RequestContext {
+    RequestContext() { ++s_alive; }
+    RequestContext(const RequestContext& rhs) : trace_id(rhs.trace_id), deadline_ms(rhs.deadline_ms) { ++s_alive; }
+    ~RequestContext() { --s_alive; }
+    RequestContext& operator=(const RequestContext& rhs) = default;
+
+    std::string trace_id;
+    uint64_t deadline_ms = 0;
+    static std::atomic<int> s_alive;
+};
+std::atomic<int> RequestContext::s_alive = {0};
+
+static wyze::FiberLocal<RequestContext> s_context;
+static wyze::FiberLocal<int> s_depth;
+
+//每个协程设置自己的上下文，多次让出后(可能迁移到其他线程)读到的仍然是自己的
+void test_isolation()
+{
+    static const int FIBERS = 200;
+    std::atomic<int> ok = {0};
+    std::atomic<int> migrated = {0};
+    {
+        wyze::IOManager iom(4, false, "fiberlocal");
+        for(int i = 0; i < FIBERS; ++i) {
+            iom.schedule([i, &ok, &migrated]() {
+                WYZE_ASSERT(!s_context.tryGet());
+                s_context->trace_id = "req-" + std::to_string(i);
+                s_context->deadline_ms = i;
+                int first_thread = wyze::GetThreadId();
+                bool same = true;
+                for(int k = 0; k < 10; ++k) {
+                    ++s_depth.get();
+                    wyze::Fiber::YeildToReady();
+                    same = same && s_context->trace_id == "req-" + std::to_string(i)
+                                && s_context->deadline_ms == (uint64_t)i;
+                }
+                if(wyze::GetThreadId() != first_thread) {
+                    ++migrated;
+                }
+                if(same && s_depth.get() == 10) {
+                    ++ok;
+                }
+            });
+        }
+    }
+    WYZE_LOG_INFO(g_logger) << "test_isolation ok=" << ok << " migrated=" << migrated
+                            << " alive=" << RequestContext::s_alive;
+    WYZE_ASSERT(ok == FIBERS);
+    WYZE_ASSERT(RequestContext::s_alive == 0);  //协程结束时全部销毁
+}
+
+//复用的协程看不到上一个任务的值，reset 和 set 的行为
+void test_reuse()
+{
+    std::atomic<int> checked = {0};
+    {
+        wyze::IOManager iom(1, false, "fiberlocal_reuse");
+        for(int i = 0; i < 100; ++i) {
+            iom.schedule([&checked]() {
+                WYZE_ASSERT(!s_context.tryGet() && !s_depth.tryGet());
+                RequestContext ctx;
+                ctx.trace_id = "set";
+                s_context.set(ctx);
+                s_context.set(ctx);     //已有值时原地赋值
+                WYZE_ASSERT(RequestContext::s_alive == 2);
+                s_context.reset();
+                WYZE_ASSERT(!s_context.tryGet() && RequestContext::s_alive == 1);
+                s_context.get();
+                ++checked;
+            });
+        }
+    }
+    WYZE_LOG_INFO(g_logger) << "test_reuse checked=" << checked;
+    WYZE_ASSERT(checked == 100 && RequestContext::s_alive == 0);
+}
+
+//异常退出的协程不在 MainFunc 中清理，析构时销毁局部变量
+void test_except()
+{
+    wyze::Fiber::GetThis();
+    wyze::Fiber::ptr fiber(new wyze::Fiber([]() {
+        s_context->trace_id = "except";
+        throw std::logic_error("test_except");
+    }, 0, true));
+    fiber->call();
+    WYZE_ASSERT(fiber->getState() == wyze::Fiber::EXCEPT);
+    WYZE_ASSERT(RequestContext::s_alive == 1);
+    WYZE_ASSERT(!s_context.tryGet());   //主协程有自己的一份
+    fiber.reset();
+    WYZE_ASSERT(RequestContext::s_alive == 0);
+    WYZE_LOG_INFO(g_logger) << "test_except ok";
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_isolation();
+    test_reuse();
+    test_except();
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "../wyze/wyze.h"
+#include "../wyze/fibersync.h"
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//多个协程争用同一把锁，持有锁时让出协程，其他协程只能挂起等待
+void test_mutex()
+{
+    static const int FIBERS = 32;
+    static const int LOOPS = 1000;
+    wyze::FiberMutex mutex;
+    int64_t count = 0;
+    {
+        wyze::IOManager iom(4, false, "mutex");
+        for(int i = 0; i < FIBERS; ++i) {
+            iom.schedule([&mutex, &count]() {
+                for(int j = 0; j < LOOPS; ++j) {
+                    wyze::FiberMutex::Lock lock(mutex);
+                    int64_t v = count;
+                    if(j % 100 == 0) {
+                        wyze::Fiber::YeildToReady();
+                    }
+                    count = v + 1;
+                }
+            });
+        }
+    }
+    WYZE_LOG_INFO(g_logger) << "test_mutex count=" << count;
+    WYZE_ASSERT(count == FIBERS * LOOPS);
+}
+
+//生产者消费者
+void test_condition()
+{
+    static const int ITEMS = 10000;
+    wyze::FiberMutex mutex;
+    wyze::FiberConditionVariable cond;
+    std::deque<int> queue;
+    int64_t sum = 0;
+    {
+        wyze::IOManager iom(2, false, "cond");
+        iom.schedule([&]() {
+            for(int i = 1; i <= ITEMS; ++i) {
+                wyze::FiberMutex::Lock lock(mutex);
+                queue.push_back(i);
+                cond.notifyOne();
+            }
+            wyze::FiberMutex::Lock lock(mutex);
+            queue.push_back(0);
+            cond.notifyOne();
+        });
+        iom.schedule([&]() {
+            while(true) {
+                wyze::FiberMutex::Lock lock(mutex);
+                while(queue.empty()) {
+                    cond.wait(lock);
+                }
+                int v = queue.front();
+                queue.pop_front();
+                if(v == 0) {
+                    break;
+                }
+                sum += v;
+            }
+        });
+    }
+    WYZE_LOG_INFO(g_logger) << "test_condition sum=" << sum;
+    WYZE_ASSERT(sum == (int64_t)ITEMS * (ITEMS + 1) / 2);
+}
+
+//WaitGroup 等待一组协程，信号量限制同时进入的协程数
+void test_waitgroup()
+{
+    static const int FIBERS = 100;
+    std::atomic<int> done = {0};
+    std::atomic<int> inside = {0};
+    std::atomic<int> max_inside = {0};
+    wyze::FiberSemaphore sem(3);
+    wyze::WaitGroup wg;
+    {
+        wyze::IOManager iom(4, false, "wg");
+        iom.schedule([&]() {
+            wg.add(FIBERS);
+            for(int i = 0; i < FIBERS; ++i) {
+                wyze::IOManager::GetThis()->schedule([&]() {
+                    sem.wait();
+                    int n = ++inside;
+                    int m = max_inside;
+                    while(n > m && !max_inside.compare_exchange_weak(m, n));
+                    usleep(1000);       //hook 后只挂起协程
+                    --inside;
+                    sem.notify();
+                    ++done;
+                    wg.done();
+                });
+            }
+            wg.wait();
+            WYZE_LOG_INFO(g_logger) << "test_waitgroup done=" << done
+                                    << " max_inside=" << max_inside;
+            WYZE_ASSERT(done == FIBERS);
+            WYZE_ASSERT(max_inside <= 3);
+        });
+    }
+}
+
+//和线程锁对比：每个协程反复加锁解锁，每次都在锁外让出，制造争用
+template<class MutexType>
+uint64_t bench_mutex(int threads, int fibers, int loops)
+{
+    MutexType mutex;
+    int64_t count = 0;
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(threads, false, "bench");
+        for(int i = 0; i < fibers; ++i) {
+            iom.schedule([&mutex, &count, loops]() {
+                for(int j = 0; j < loops; ++j) {
+                    {
+                        typename MutexType::Lock lock(mutex);
+                        ++count;
+                    }
+                    wyze::Fiber::YeildToReady();
+                }
+            });
+        }
+    }
+    WYZE_ASSERT(count == (int64_t)fibers * loops);
+    return wyze::GetCurrentMS() - start;
+}
+
+//两个协程用信号量来回交替，线程信号量等待时会阻塞整个调度线程
+template<class SemaphoreType>
+uint64_t bench_pingpong(int threads, int rounds)
+{
+    SemaphoreType ping;
+    SemaphoreType pong;
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(threads, false, "bench");
+        iom.schedule([&]() {
+            for(int i = 0; i < rounds; ++i) {
+                ping.notify();
+                pong.wait();
+            }
+        });
+        iom.schedule([&]() {
+            for(int i = 0; i < rounds; ++i) {
+                ping.wait();
+                pong.notify();
+            }
+        });
+    }
+    return wyze::GetCurrentMS() - start;
+}
+
+void test_bench()
+{
+    WYZE_LOG_INFO(g_logger) << "bench mutex threads=4 fibers=64 loops=2000"
+        << " pthread=" << bench_mutex<wyze::Mutex>(4, 64, 2000) << "ms"
+        << " fiber=" << bench_mutex<wyze::FiberMutex>(4, 64, 2000) << "ms";
+    WYZE_LOG_INFO(g_logger) << "bench pingpong threads=2 rounds=20000"
+        << " sem_t=" << bench_pingpong<wyze::Semaphore>(2, 20000) << "ms"
+        << " fiber=" << bench_pingpong<wyze::FiberSemaphore>(2, 20000) << "ms";
+    //只有一个调度线程时，线程信号量会死锁，协程信号量不受影响
+    WYZE_LOG_INFO(g_logger) << "bench pingpong threads=1 rounds=20000"
+        << " fiber=" << bench_pingpong<wyze::FiberSemaphore>(1, 20000) << "ms";
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_mutex();
+    test_condition();
+    test_waitgroup();
+    test_bench();
+    return 0;
+}
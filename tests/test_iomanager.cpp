@@ -255,6 +255,37 @@ void test_iomanager()
     });
 }
 
+//定向唤醒：每次 schedule 最多唤醒一个线程，唤醒次数应该远小于任务数
+void test_wakeup()
+{
+    static const int ROUNDS = 200;
+    static const int BATCH = 10;
+    std::atomic<int> done = {0};
+    wyze::Scheduler::WakeupStats stats;
+    {
+        wyze::IOManager iom(4, false, "wakeup");
+        for(int i = 0; i < ROUNDS; ++i) {
+            for(int j = 0; j < BATCH; ++j) {
+                iom.schedule([&done](){
+                    ++done;
+                });
+            }
+            usleep(500);        //让线程停车，下一轮需要重新唤醒
+        }
+        while(done != ROUNDS * BATCH) {
+            usleep(1000);
+        }
+        stats = iom.getWakeupStats();
+    }
+    WYZE_LOG_INFO(g_logger) << "test_wakeup done=" << done
+                            << " tickles=" << stats.tickles
+                            << " useful=" << stats.useful
+                            << " suppressed=" << stats.suppressed
+                            << " promotions=" << stats.promotions;
+    WYZE_ASSERT(stats.useful <= stats.tickles);
+    WYZE_ASSERT(stats.tickles < (uint64_t)ROUNDS * BATCH);
+}
+
 int main() {
     // bool a = true;
     // while(a) {
@@ -262,6 +293,7 @@ int main() {
     //     sleep(3);
     // }
     test_iomanager();
+    test_wakeup();
     // wyze::IOManager::GetThis()->schedule([](){
     //     WYZE_LOG_INFO(g_logger) << "这里不会出现，为了让程序 挂掉";
     // });
@@ -0,0 +1,205 @@
+#include "../wyze/wyze.h"
+#include "../wyze/fdmanager.h"
+#include <arpa/inet.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//在 127.0.0.1 上监听，返回监听 socket 和地址
+static int Listen(sockaddr_in& addr)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 16)
+            || getsockname(listener, (sockaddr*)&addr, &len)) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+//accept 先挂起在 io_uring 上，connect 之后完成
+static bool MakeConnection(int& client, int& server)
+{
+    sockaddr_in addr;
+    int listener = Listen(addr);
+    if(listener < 0) {
+        return false;
+    }
+    auto ch = std::make_shared<wyze::Channel<int>>(1);
+    wyze::IOManager::GetThis()->schedule([listener, ch]() {
+        ch->send(accept(listener, nullptr, nullptr));
+    });
+    usleep(10 * 1000);
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    int rt = connect(client, (sockaddr*)&addr, sizeof(addr));
+    ch->recv(server);
+    close(listener);
+    if(rt || server < 0) {
+        close(client);
+        return false;
+    }
+    return true;
+}
+
+static bool UringAvailable(wyze::IOManager& iom)
+{
+    if(iom.getBackend() != wyze::IOManager::BACKEND_URING) {
+        WYZE_LOG_WARN(g_logger) << "io_uring unavailable, skip";
+        return false;
+    }
+    return true;
+}
+
+//读写、accept、connect 都经过 io_uring，数据正确
+void test_echo()
+{
+    static const int ROUNDS = 200;
+    bool checked = false;
+    wyze::UringStats stats;
+    {
+        wyze::IOManager iom(2, false, "uring_echo", wyze::IOManager::BACKEND_URING);
+        if(!UringAvailable(iom)) {
+            return;
+        }
+        iom.schedule([&checked]() {
+            int client = -1, server = -1;
+            WYZE_ASSERT(MakeConnection(client, server));
+            wyze::IOManager::GetThis()->schedule([server]() {
+                char buf[64];
+                while(true) {
+                    int n = recv(server, buf, sizeof(buf), 0);
+                    if(n <= 0) {
+                        break;
+                    }
+                    WYZE_ASSERT(write(server, buf, n) == n);
+                }
+                close(server);
+            });
+            for(int i = 0; i < ROUNDS; ++i) {
+                char out[32], in[32];
+                int n = snprintf(out, sizeof(out), "ping %d", i);
+                WYZE_ASSERT(send(client, out, n, 0) == n);
+                int got = 0;
+                while(got < n) {
+                    int k = read(client, in + got, n - got);
+                    WYZE_ASSERT(k > 0);
+                    got += k;
+                }
+                WYZE_ASSERT(memcmp(in, out, n) == 0);
+            }
+            close(client);
+            checked = true;
+        });
+        while(!checked) {
+            usleep(1000);
+        }
+        stats = iom.getUringStats();
+    }
+    WYZE_LOG_INFO(g_logger) << "test_echo ops=" << stats.ops << " submits=" << stats.submits
+                            << " eagain=" << stats.eagain;
+    WYZE_ASSERT(checked && stats.ops >= ROUNDS);
+}
+
+//SO_RCVTIMEO 超时、令牌取消和 close 都能唤醒在 io_uring 上等待的 recv
+void test_wakeup()
+{
+    bool checked = false;
+    {
+        wyze::IOManager iom(2, false, "uring_wakeup", wyze::IOManager::BACKEND_URING);
+        if(!UringAvailable(iom)) {
+            return;
+        }
+        iom.schedule([&checked]() {
+            int client = -1, server = -1;
+            WYZE_ASSERT(MakeConnection(client, server));
+            char buf[16];
+
+            timeval tv = {0, 50 * 1000};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            uint64_t start = wyze::GetCurrentMS();
+            int rt = recv(client, buf, sizeof(buf), 0);
+            WYZE_LOG_INFO(g_logger) << "test_wakeup timeout rt=" << rt << " errno=" << errno
+                                    << " used=" << wyze::GetCurrentMS() - start << "ms";
+            WYZE_ASSERT(rt == -1 && errno == ETIMEDOUT);
+            tv.tv_usec = 0;
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            wyze::CancelToken::ptr token = wyze::CancelToken::Create();
+            token->cancelAfter(50);
+            wyze::CancelToken::SetCurrent(token);
+            rt = recv(client, buf, sizeof(buf), 0);
+            WYZE_ASSERT(rt == -1 && errno == ECANCELED);
+            wyze::CancelToken::SetCurrent(nullptr);
+
+            //被取消的请求没有读走数据
+            WYZE_ASSERT(send(server, "ok", 2, 0) == 2);
+            WYZE_ASSERT(recv(client, buf, sizeof(buf), 0) == 2 && memcmp(buf, "ok", 2) == 0);
+
+            auto ch = std::make_shared<wyze::Channel<int>>(1);
+            wyze::IOManager::GetThis()->schedule([client, ch]() {
+                char b[16];
+                int n = recv(client, b, sizeof(b), 0);
+                ch->send(n == -1 ? errno : 0);
+            });
+            usleep(20 * 1000);
+            close(client);
+            //另一个协程 close 时正在等待的 recv 返回 EBADF
+            WYZE_ASSERT(ch->recv(rt) && rt == EBADF);
+            close(server);
+
+            //对端关闭时等待中的 recv 返回 0
+            WYZE_ASSERT(MakeConnection(client, server));
+            wyze::IOManager::GetThis()->addTimer(50, [server]() { close(server); });
+            WYZE_ASSERT(recv(client, buf, sizeof(buf), 0) == 0);
+            close(client);
+            checked = true;
+        });
+    }
+    WYZE_ASSERT(checked);
+}
+
+//共享栈协程不使用 io_uring
+void test_shared_stack()
+{
+    bool checked = false;
+    wyze::UringStats stats;
+    {
+        wyze::IOManager iom(1, false, "uring_shared", wyze::IOManager::BACKEND_URING);
+        if(!UringAvailable(iom)) {
+            return;
+        }
+        wyze::Fiber::ptr fiber(new wyze::Fiber([&checked]() {
+            int fds[2];
+            WYZE_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            wyze::FdMgr::GetInstance()->get(fds[0], true);
+            wyze::IOManager::GetThis()->addTimer(20, [fds]() {
+                WYZE_ASSERT(write(fds[1], "x", 1) == 1);
+            });
+            char c = 0;
+            WYZE_ASSERT(read(fds[0], &c, 1) == 1 && c == 'x');
+            close(fds[0]);
+            close(fds[1]);
+            checked = true;
+        }, 0, false, true));
+        iom.schedule(fiber);
+        while(!checked) {
+            usleep(1000);
+        }
+        stats = iom.getUringStats();
+    }
+    WYZE_ASSERT(checked && stats.ops == 0);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_echo();
+    test_wakeup();
+    test_shared_stack();
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "../wyze/wyze.h"
+#include <stdexcept>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+//阻塞调用放到线程池后，单个调度线程上的其他协程不受影响
+void test_offload()
+{
+    static const int BLOCKERS = 8;
+    wyze::OffloadPool pool(4, 4, "test_offload");
+    std::atomic<int> done = {0};
+    std::atomic<int> ticks = {0};
+    uint64_t start = wyze::GetCurrentMS();
+    {
+        wyze::IOManager iom(1, false, "offload");
+        for(int i = 0; i < BLOCKERS; ++i) {
+            iom.schedule([&pool, &done, i]() {
+                int rt = pool.run([i]() {
+                    usleep(50 * 1000);  //模拟慢磁盘、DNS 等阻塞调用
+                    return i * 2;
+                });
+                WYZE_ASSERT(rt == i * 2);
+                ++done;
+            });
+        }
+        iom.schedule([&ticks, &done]() {
+            while(done < BLOCKERS) {
+                ++ticks;
+                usleep(1000);   //hook 后只挂起当前协程
+            }
+        });
+    }
+    uint64_t used = wyze::GetCurrentMS() - start;
+    wyze::OffloadPool::Stats stats = pool.getStats();
+    WYZE_LOG_INFO(g_logger) << "test_offload done=" << done << " ticks=" << ticks
+                            << " used=" << used << "ms submitted=" << stats.submitted
+                            << " queue_full=" << stats.queue_full
+                            << " max_depth=" << stats.max_queue_depth
+                            << " max_wait=" << stats.max_wait_us << "us"
+                            << " max_run=" << stats.max_run_us << "us";
+    WYZE_ASSERT(done == BLOCKERS && ticks > 20);
+    WYZE_ASSERT(stats.submitted == BLOCKERS && stats.completed == BLOCKERS);
+    WYZE_ASSERT(stats.max_queue_depth <= 4 && stats.queue_full > 0);
+}
+
+//异常在调用协程中重新抛出，不在协程中时直接执行
+void test_exception()
+{
+    wyze::OffloadPool pool(1, 16, "test_exception");
+    WYZE_ASSERT(pool.run([]() { return 1; }) == 1);
+    WYZE_ASSERT(pool.getStats().inlined == 1);
+
+    std::atomic<bool> caught = {false};
+    {
+        wyze::IOManager iom(1, false, "exception");
+        iom.schedule([&pool, &caught]() {
+            try {
+                pool.run([]() { throw std::runtime_error("offload"); });
+            } catch(std::runtime_error& e) {
+                caught = true;
+            }
+        });
+    }
+    WYZE_LOG_INFO(g_logger) << "test_exception caught=" << caught;
+    WYZE_ASSERT(caught);
+}
+
+//Address::Lookup 中的 getaddrinfo 交给默认线程池
+void test_lookup()
+{
+    wyze::IOManager iom(1, false, "lookup");
+    iom.schedule([]() {
+        std::vector<wyze::Address::ptr> addrs;
+        bool rt = wyze::Address::Lookup(addrs, "localhost:80");
+        WYZE_LOG_INFO(g_logger) << "test_lookup rt=" << rt << " count=" << addrs.size()
+                                << " offloaded=" << wyze::OffloadPool::GetDefault()->getStats().completed;
+    });
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_offload();
+    test_exception();
+    test_lookup();
+    return 0;
+}
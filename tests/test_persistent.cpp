@@ -0,0 +1,152 @@
+#include "../wyze/wyze.h"
+#include "../wyze/fdmanager.h"
+#include <sys/epoll.h>
+#include <dlfcn.h>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<bool>::ptr g_persistent_et =
+    wyze::Config::Lookup<bool>("iomanager.persistent_et", false, "");
+static wyze::ConfigVar<bool>::ptr g_multi_reactor =
+    wyze::Config::Lookup<bool>("iomanager.multi_reactor", false, "");
+
+static std::atomic<uint64_t> s_epoll_ctls = {0};
+
+//统计 IOManager 调用 epoll_ctl 的次数
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+{
+    using epoll_ctl_fun = int (*)(int, int, int, struct epoll_event*);
+    static epoll_ctl_fun s_real = (epoll_ctl_fun)dlsym(RTLD_NEXT, "epoll_ctl");
+    ++s_epoll_ctls;
+    return s_real(epfd, op, fd, event);
+}
+
+//hook 的 socket 对，两端都是非阻塞的
+static void SocketPair(int fds[2])
+{
+    WYZE_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    wyze::FdMgr::GetInstance()->get(fds[0], true);
+    wyze::FdMgr::GetInstance()->get(fds[1], true);
+}
+
+//一问一答 ROUNDS 次，服务端每次都挂起在 recv 上，返回稳定阶段的 epoll_ctl 次数
+uint64_t test_echo(bool persistent, bool multi)
+{
+    static const int ROUNDS = 2000;
+    static const int WARMUP = 10;
+    g_persistent_et->setVal(persistent);
+    g_multi_reactor->setVal(multi);
+    std::atomic<int> done = {0};
+    uint64_t ctls = 0;
+    uint64_t used_us = 0;
+    {
+        wyze::IOManager iom(2, false, "persistent");
+        g_persistent_et->setVal(false);
+        g_multi_reactor->setVal(false);
+        WYZE_ASSERT(iom.isPersistentEt() == persistent && iom.isMultiReactor() == multi);
+        iom.schedule([&]() {
+            int fds[2];
+            SocketPair(fds);
+            wyze::IOManager::GetThis()->schedule([fds, &done]() {
+                char buf[64];
+                int n;
+                while((n = recv(fds[0], buf, sizeof(buf), 0)) > 0) {
+                    WYZE_ASSERT(send(fds[0], buf, n, 0) == n);
+                }
+                close(fds[0]);
+                ++done;
+            });
+            uint64_t start = 0;
+            uint64_t start_us = 0;
+            for(int i = 0; i < ROUNDS; ++i) {
+                if(i == WARMUP) {
+                    start = s_epoll_ctls;
+                    start_us = wyze::GetMonotonicUS();
+                }
+                char out[32], in[32];
+                int n = snprintf(out, sizeof(out), "round %d", i);
+                WYZE_ASSERT(send(fds[1], out, n, 0) == n);
+                WYZE_ASSERT(recv(fds[1], in, n, MSG_WAITALL) == n && memcmp(in, out, n) == 0);
+            }
+            ctls = s_epoll_ctls - start;
+            used_us = wyze::GetMonotonicUS() - start_us;
+            close(fds[1]);
+            ++done;
+        });
+        while(done < 2) {
+            usleep(1000);
+        }
+    }
+    WYZE_LOG_INFO(g_logger) << "test_echo persistent=" << persistent << " multi=" << multi
+                            << " epoll_ctl=" << ctls << " rounds=" << ROUNDS - WARMUP
+                            << " " << (uint64_t)((ROUNDS - WARMUP) * 1e6 / used_us) << "/s";
+    return ctls;
+}
+
+//超时、取消和 close 之后常驻注册的 fd 仍然能正确等待，复用 fd 编号的新连接会重新注册
+void test_wakeup()
+{
+    g_persistent_et->setVal(true);
+    bool checked = false;
+    {
+        wyze::IOManager iom(2, false, "persistent_wakeup");
+        g_persistent_et->setVal(false);
+        iom.schedule([&checked]() {
+            int fds[2];
+            SocketPair(fds);
+            char buf[16];
+
+            timeval tv = {0, 50 * 1000};
+            setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            WYZE_ASSERT(recv(fds[1], buf, sizeof(buf), 0) == -1 && errno == ETIMEDOUT);
+            tv.tv_usec = 0;
+            setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            wyze::CancelToken::ptr token = wyze::CancelToken::Create();
+            token->cancelAfter(20);
+            wyze::CancelToken::SetCurrent(token);
+            WYZE_ASSERT(recv(fds[1], buf, sizeof(buf), 0) == -1 && errno == ECANCELED);
+            wyze::CancelToken::SetCurrent(nullptr);
+
+            //超时和取消之后到达的数据照常唤醒
+            wyze::IOManager::GetThis()->addTimer(20, [fds]() {
+                WYZE_ASSERT(send(fds[0], "ok", 2, 0) == 2);
+            });
+            WYZE_ASSERT(recv(fds[1], buf, sizeof(buf), 0) == 2 && memcmp(buf, "ok", 2) == 0);
+
+            //没有等待者时到达的边沿留给下一次等待
+            WYZE_ASSERT(send(fds[0], "late", 4, 0) == 4);
+            usleep(20 * 1000);
+            WYZE_ASSERT(recv(fds[1], buf, sizeof(buf), 0) == 4);
+
+            int old = fds[1];
+            close(fds[0]);
+            close(fds[1]);
+            SocketPair(fds);
+            WYZE_LOG_INFO(g_logger) << "test_wakeup reuse old=" << old << " new=" << fds[0] << "," << fds[1];
+            wyze::IOManager::GetThis()->addTimer(20, [fds]() {
+                WYZE_ASSERT(send(fds[1], "again", 5, 0) == 5);
+            });
+            WYZE_ASSERT(recv(fds[0], buf, sizeof(buf), 0) == 5);
+
+            //对端关闭时等待中的 recv 返回 0
+            wyze::IOManager::GetThis()->addTimer(20, [fds]() { close(fds[1]); });
+            WYZE_ASSERT(recv(fds[0], buf, sizeof(buf), 0) == 0);
+            close(fds[0]);
+            checked = true;
+        });
+    }
+    WYZE_ASSERT(checked);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    WYZE_ASSERT(test_echo(false, false) > 0);
+    WYZE_ASSERT(test_echo(true, false) == 0);
+    WYZE_ASSERT(test_echo(true, true) == 0);
+    test_wakeup();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "../wyze/wyze.h"
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<uint64_t>::ptr g_high_burst =
+    wyze::Config::Lookup<uint64_t>("scheduler.high_priority_burst", 16, "");
+static wyze::ConfigVar<uint64_t>::ptr g_low_aging =
+    wyze::Config::Lookup<uint64_t>("scheduler.low_priority_aging_ms", 100, "");
+
+//只有一个调度线程，由 seed 在调度线程上一次放入所有任务，记录任务结束的顺序
+struct OrderRecorder {
+    wyze::Mutex mutex;
+    std::string order;
+
+    void add(char c) {
+        wyze::Mutex::Lock lock(mutex);
+        order.push_back(c);
+    }
+};
+
+static std::string RunSeed(const std::string& name, std::function<void(wyze::Scheduler*, OrderRecorder&)> seed
+                            , wyze::SchedulerStats* stats = nullptr)
+{
+    OrderRecorder rec;
+    {
+        wyze::IOManager iom(1, false, name);
+        iom.schedule([&]() {
+            seed(wyze::Scheduler::GetThis(), rec);
+        });
+        while(true) {
+            usleep(1000);
+            wyze::SchedulerStats s = iom.getStats();
+            if(s.pending_tasks == 0 && s.active_threads == 0 && !rec.order.empty()) {
+                if(stats) {
+                    *stats = s;
+                }
+                break;
+            }
+        }
+    }
+    return rec.order;
+}
+
+//高优先级任务让出后仍然是高优先级，低优先级任务在最后执行
+void test_order()
+{
+    std::string order = RunSeed("priority", [](wyze::Scheduler* sched, OrderRecorder& rec) {
+        for(int i = 0; i < 30; ++i) {
+            sched->schedule([&rec]() { rec.add('N'); });
+        }
+        for(int i = 0; i < 10; ++i) {
+            sched->schedule([&rec]() { rec.add('L'); }, -1, wyze::Scheduler::PRIORITY_LOW);
+        }
+        for(int i = 0; i < 10; ++i) {
+            sched->schedule([&rec]() {
+                wyze::Fiber::YeildToReady();
+                rec.add('H');
+            }, -1, wyze::Scheduler::PRIORITY_HIGH);
+        }
+    });
+    WYZE_LOG_INFO(g_logger) << "test_order " << order;
+    WYZE_ASSERT(order.size() == 50);
+    WYZE_ASSERT(order.rfind('H') < 12);     //20 次高优先级调度中最多穿插一个普通任务
+    WYZE_ASSERT(order.substr(40) == std::string(10, 'L'));
+}
+
+//连续执行 burst 个高优先级任务后执行一个普通任务
+void test_burst()
+{
+    g_high_burst->setVal(4);
+    std::string order = RunSeed("priority_burst", [](wyze::Scheduler* sched, OrderRecorder& rec) {
+        for(int i = 0; i < 20; ++i) {
+            sched->schedule([&rec]() { rec.add('H'); }, -1, wyze::Scheduler::PRIORITY_HIGH);
+            sched->schedule([&rec]() { rec.add('N'); });
+        }
+    });
+    WYZE_LOG_INFO(g_logger) << "test_burst " << order;
+    WYZE_ASSERT(order.compare(0, 15, "HHHHNHHHHNHHHHN") == 0);
+    g_high_burst->setVal(16);
+}
+
+//低优先级任务等待超过 low_priority_aging_ms 后先于普通任务执行
+void test_aging()
+{
+    g_low_aging->setVal(20);
+    wyze::SchedulerStats stats;
+    std::string order = RunSeed("priority_aging", [](wyze::Scheduler* sched, OrderRecorder& rec) {
+        sched->schedule([&rec]() { rec.add('L'); }, -1, wyze::Scheduler::PRIORITY_LOW);
+        for(int i = 0; i < 40; ++i) {
+            sched->schedule([&rec]() {
+                uint64_t start = wyze::GetMonotonicUS();
+                while(wyze::GetMonotonicUS() - start < 2000);
+                rec.add('N');
+            });
+        }
+    }, &stats);
+    size_t pos = order.find('L');
+    WYZE_LOG_INFO(g_logger) << "test_aging low_at=" << pos << "\n" << stats.toString();
+    WYZE_ASSERT(pos < 40 && stats.low_aged == 1 && stats.low_dispatches == 1);
+    g_low_aging->setVal(100);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_order();
+    test_burst();
+    test_aging();
+    return 0;
+}
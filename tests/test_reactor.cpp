@@ -0,0 +1,138 @@
+#include "../wyze/wyze.h"
+#include <set>
+
+static wyze::Logger::ptr g_logger = WYZE_LOG_ROOT();
+
+static wyze::ConfigVar<bool>::ptr g_multi_reactor =
+    wyze::Config::Lookup<bool>("iomanager.multi_reactor", false, "");
+
+static const int CONNS = 16;
+static const int ROUNDS = 100;
+
+//记录每个连接的处理协程在哪些线程上执行过
+class OwnerEchoServer : public wyze::TcpServer {
+public:
+    OwnerEchoServer(wyze::IOManager* worker) : wyze::TcpServer(worker, worker), m_iom(worker) {}
+
+    std::atomic<int> misplaced = {0};   //在不属于连接的线程上恢复的次数
+    wyze::Mutex mutex;
+    std::set<int> threads;              //处理过连接的线程
+
+protected:
+    void handleClient(wyze::Socket::ptr client) override {
+        int owner = m_iom->getOwnerThread(client->getSocket());
+        {
+            wyze::Mutex::Lock lock(mutex);
+            threads.insert(wyze::GetThreadId());
+        }
+        char buf[256];
+        while(true) {
+            if(wyze::GetThreadId() != owner) {
+                ++misplaced;
+            }
+            int n = client->recv(buf, sizeof(buf));
+            if(n <= 0 || client->send(buf, n) != n) {
+                break;
+            }
+        }
+    }
+
+private:
+    wyze::IOManager* m_iom;
+};
+
+//连接分给不同的线程，连接上的读写和超时都在所属线程恢复
+void test_owner()
+{
+    g_multi_reactor->setVal(true);
+    std::atomic<int> done = {0};
+    std::shared_ptr<OwnerEchoServer> server;
+    {
+        wyze::IOManager server_iom(3, false, "reactor");
+        WYZE_ASSERT(server_iom.isMultiReactor());
+        g_multi_reactor->setVal(false);
+        wyze::IOManager client_iom(2, false, "reactor_client");
+        WYZE_ASSERT(!client_iom.isMultiReactor());
+
+        wyze::Address::ptr addr = wyze::IPAddress::LookupAnyIPAddress("127.0.0.1:18140");
+        std::atomic<int> bound = {0};
+        server_iom.schedule([&]() {
+            server.reset(new OwnerEchoServer(&server_iom));
+            bound = server->bind(addr) && server->start() ? 1 : -1;
+        });
+        while(!bound) {
+            usleep(1000);
+        }
+        WYZE_ASSERT(bound == 1);
+
+        for(int i = 0; i < CONNS; ++i) {
+            client_iom.schedule([&done, addr]() {
+                wyze::Socket::ptr sock = wyze::Socket::CreateTCP(addr);
+                WYZE_ASSERT(sock->connect(addr));
+                char out[32], in[32];
+                for(int r = 0; r < ROUNDS; ++r) {
+                    int n = snprintf(out, sizeof(out), "round %d", r);
+                    WYZE_ASSERT(sock->send(out, n) == n);
+                    WYZE_ASSERT(sock->recv(in, n, MSG_WAITALL) == n && memcmp(in, out, n) == 0);
+                    if(r % 10 == 0) {
+                        usleep(1000);   //让服务端的 recv 挂起在 epoll 上
+                    }
+                }
+                sock->close();
+                ++done;
+            });
+        }
+        while(done < CONNS) {
+            usleep(1000);
+        }
+        server_iom.schedule([&server]() { server->stop(); });
+        client_iom.stop();
+        server_iom.stop();
+    }
+    WYZE_LOG_INFO(g_logger) << "test_owner threads=" << server->threads.size()
+                            << " misplaced=" << server->misplaced;
+    WYZE_ASSERT(server->misplaced == 0 && server->threads.size() == 3);
+}
+
+//定时器和 hook 的 sleep 在多 reactor 模式下照常工作
+void test_timer()
+{
+    g_multi_reactor->setVal(true);
+    std::atomic<int> fired = {0};
+    {
+        wyze::IOManager iom(2, false, "reactor_timer");
+        g_multi_reactor->setVal(false);
+        WYZE_ASSERT(iom.isMultiReactor());
+        for(int i = 0; i < 10; ++i) {
+            iom.schedule([&fired, i]() {
+                usleep((10 + i) * 1000);
+                ++fired;
+            });
+        }
+        iom.addTimer(30, [&fired]() { ++fired; });
+    }
+    WYZE_ASSERT(fired == 11);
+}
+
+//use_caller 且只有一个线程时没有可以拥有 fd 的线程，退回共享 epoll
+void test_fallback()
+{
+    g_multi_reactor->setVal(true);
+    wyze::IOManager iom(1, true, "reactor_fallback");
+    g_multi_reactor->setVal(false);
+    WYZE_ASSERT(!iom.isMultiReactor());
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    WYZE_ASSERT(iom.getOwnerThread(fd) == -1);
+    close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    auto logger = WYZE_LOG_NAME("system");
+    logger->setLevel(wyze::LogLevel::ERROR);
+
+    test_owner();
+    test_timer();
+    test_fallback();
+    return 0;
+}
@@ -62,11 +62,104 @@ void test_threads()
 }
 
 
+//每个任务再 schedule 一个指定到当前线程的任务，检查指定线程的任务不会被其他线程窃取
+void test_steal()
+{
+    static std::atomic<int> s_done = {0};
+    static std::atomic<int> s_wrong_thread = {0};
+
+    wyze::Scheduler sc(4, false, "steal");
+    sc.start();
+    uint64_t start = wyze::GetCurrentMS();
+    for(int i = 0; i < 10000; ++i) {
+        sc.schedule([&sc]() {
+            int tid = wyze::GetThreadId();
+            sc.schedule([tid]() {
+                if(tid != wyze::GetThreadId())
+                    ++s_wrong_thread;
+                ++s_done;
+            }, tid);
+            ++s_done;
+        });
+    }
+    sc.stop();
+    WYZE_LOG_INFO(g_logger) << "test_steal done=" << s_done
+        << " wrong_thread=" << s_wrong_thread
+        << " used=" << (wyze::GetCurrentMS() - start) << "ms";
+}
+
+//排队时间、执行时间和切换次数统计
+void test_stats()
+{
+    wyze::set_hook_enable(false);   //test_threads 在主线程执行过 run，打开了 hook
+    wyze::Scheduler sc(2, false, "stats");
+    sc.start();
+    for(int i = 0; i < 1000; ++i) {
+        sc.schedule([i]() {
+            if(i % 100 == 0) {  //占用调度线程 2ms，hook 的 usleep 需要 IOManager
+                uint64_t start = wyze::GetMonotonicUS();
+                while(wyze::GetMonotonicUS() - start < 2000);
+            }
+        });
+    }
+    usleep(100 * 1000);
+    WYZE_LOG_INFO(g_logger) << "test_stats\n" << sc.dumpStats();
+    for(int i = 0; i < 100; ++i) {
+        sc.schedule([]() { wyze::Fiber::YeildToReady(); });
+    }
+    usleep(50 * 1000);
+    wyze::SchedulerStats stats = sc.getStats();
+    WYZE_LOG_INFO(g_logger) << "test_stats\n" << sc.dumpStats();
+    sc.stop();
+#ifdef WYZE_SCHED_STATS
+    WYZE_ASSERT(stats.total.switches == 1200);
+    WYZE_ASSERT(stats.total.queue_wait.count == 1200);
+    WYZE_ASSERT(stats.total.run_slice.max >= 2000);
+    WYZE_ASSERT(stats.total.idles < 1000);  //空闲时停车，不会反复切入 idle 协程
+#endif
+}
+
+//计算密集的协程调用 maybe_yield 后，同一个线程上的其他协程不会被饿死
+void test_slice()
+{
+    wyze::Config::Lookup<uint64_t>("scheduler.slice_warn_ms")->setVal(30);
+    std::atomic<uint64_t> hog_done = {0};
+    std::atomic<uint64_t> other_done = {0};
+    std::atomic<int> yields = {0};
+
+    wyze::Scheduler sc(1, false, "slice");
+    sc.start();
+    uint64_t start = wyze::GetMonotonicUS();
+    sc.schedule([&]() {     //调用 maybe_yield 的计算任务，运行 100ms
+        while(wyze::GetMonotonicUS() - start < 100 * 1000) {
+            if(wyze::maybe_yield()) {
+                ++yields;
+            }
+        }
+        hog_done = wyze::GetMonotonicUS() - start;
+    });
+    sc.schedule([&]() {
+        other_done = wyze::GetMonotonicUS() - start;
+    });
+    sc.schedule([&]() {     //不让出的任务，watchdog 会在执行中告警
+        uint64_t begin = wyze::GetMonotonicUS();
+        while(wyze::GetMonotonicUS() - begin < 50 * 1000);
+    });
+    sc.stop();
+    WYZE_LOG_INFO(g_logger) << "test_slice yields=" << yields << " hog_done=" << hog_done / 1000
+                            << "ms other_done=" << other_done / 1000 << "ms";
+    WYZE_ASSERT(yields > 0 && other_done < 50 * 1000 && other_done < hog_done);
+    wyze::Config::Lookup<uint64_t>("scheduler.slice_warn_ms")->setVal(100);
+}
+
 int main(int argc, char** argv) 
 {
     WYZE_LOG_INFO(g_logger) << "main";
     // test_user_caller();
     test_threads();
+    test_steal();
+    test_stats();
+    test_slice();
     WYZE_LOG_INFO(g_logger) << "over";
     
     return 0;
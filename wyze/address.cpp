@@ -1,6 +1,7 @@
 #include "log.h"
 #include "macro.h"
 #include "address.h"
+#include "offload.h"
 
 #include <arpa/inet.h>
 #include <stddef.h>
@@ -94,7 +95,10 @@ namespace wyze {
             node = host;
         }
 
-        int rt = getaddrinfo(node.c_str(), service, &hints, &results);
+        //DNS 查询可能阻塞很久，放到 offload 线程池执行
+        int rt = Offload([&]() {
+            return getaddrinfo(node.c_str(), service, &hints, &results);
+        });
         if(rt) {
             WYZE_LOG_ERROR(g_logger) << "Address::Lookup getaddress(" << host << ", "
                 << family << ", " << type << ") err=" << rt << "errstr=" 
@@ -0,0 +1,181 @@
+#include "affinity.h"
+#include "log.h"
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+#include <sstream>
+
+namespace wyze {
+
+    static Logger::ptr g_logger = WYZE_LOG_NAME("system");
+
+    static bool ParseInt(const std::string& str, int& v)
+    {
+        if(str.empty() || str.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        v = atoi(str.c_str());
+        return true;
+    }
+
+    bool ParseCpuList(const std::string& str, std::vector<int>& cpus)
+    {
+        cpus.clear();
+        std::stringstream ss(str);
+        std::string item;
+        while(std::getline(ss, item, ',')) {
+            item.erase(0, item.find_first_not_of(" \t\n"));
+            item.erase(item.find_last_not_of(" \t\n") + 1);
+            if(item.empty()) {
+                continue;
+            }
+            size_t pos = item.find('-');
+            int first = 0;
+            int last = 0;
+            if(pos == std::string::npos) {
+                if(!ParseInt(item, first)) {
+                    return false;
+                }
+                last = first;
+            }
+            else if(!ParseInt(item.substr(0, pos), first)
+                    || !ParseInt(item.substr(pos + 1), last)
+                    || first > last) {
+                return false;
+            }
+            for(int i = first; i <= last; ++i) {
+                cpus.push_back(i);
+            }
+        }
+        return !cpus.empty();
+    }
+
+    bool ParseCpuGroups(const std::string& str, std::vector<std::vector<int>>& groups)
+    {
+        groups.clear();
+        std::vector<int> cpus;
+        if(str.find(';') == std::string::npos) {
+            if(!ParseCpuList(str, cpus)) {
+                return false;
+            }
+            for(int i : cpus) {
+                groups.push_back(std::vector<int>(1, i));
+            }
+            return true;
+        }
+
+        std::stringstream ss(str);
+        std::string item;
+        while(std::getline(ss, item, ';')) {
+            if(item.find_first_not_of(" \t\n") == std::string::npos) {
+                continue;
+            }
+            if(!ParseCpuList(item, cpus)) {
+                groups.clear();
+                return false;
+            }
+            groups.push_back(cpus);
+        }
+        return !groups.empty();
+    }
+
+    std::string CpuListToString(const std::vector<int>& cpus)
+    {
+        std::stringstream ss;
+        for(size_t i = 0; i < cpus.size(); ++i) {
+            if(i) {
+                ss << ",";
+            }
+            ss << cpus[i];
+        }
+        return ss.str();
+    }
+
+    bool SetThreadAffinity(const std::vector<int>& cpus)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int i : cpus) {
+            if(i >= 0 && i < CPU_SETSIZE) {
+                CPU_SET(i, &set);
+            }
+        }
+        int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(rt) {
+            WYZE_LOG_ERROR(g_logger) << "pthread_setaffinity_np cpus=" << CpuListToString(cpus)
+                << " rt=" << rt << " errstr=" << strerror(rt);
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<int> GetThreadAffinity()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+            return cpus;
+        }
+        for(int i = 0; i < CPU_SETSIZE; ++i) {
+            if(CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+        return cpus;
+    }
+
+    int GetNumaNodeCount()
+    {
+        static int s_count = []() {
+            std::ifstream ifs("/sys/devices/system/node/online");
+            std::string line;
+            std::vector<int> nodes;
+            if(!std::getline(ifs, line) || !ParseCpuList(line, nodes)) {
+                return 1;
+            }
+            return nodes.back() + 1;
+        }();
+        return s_count;
+    }
+
+    int GetCurrentCpu()
+    {
+        return sched_getcpu();
+    }
+
+    int GetCurrentNumaNode()
+    {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if(syscall(SYS_getcpu, &cpu, &node, nullptr)) {
+            return 0;
+        }
+        return node;
+    }
+
+    bool NumaBindLocal(void* addr, size_t len)
+    {
+        if(GetNumaNodeCount() <= 1) {
+            return true;
+        }
+        int node = GetCurrentNumaNode();
+        const size_t bits = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask(node / bits + 1, 0);
+        mask[node / bits] |= 1ul << (node % bits);
+        //MPOL_PREFERRED 在本节点内存不足时仍可以从其他节点分配
+        if(syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask[0], mask.size() * bits + 1, 0)) {
+            WYZE_LOG_ERROR(g_logger) << "mbind addr=" << addr << " len=" << len
+                << " node=" << node << " errno=" << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,32 @@
+#ifndef _WYZE_AFFINITY_H_
+#define _WYZE_AFFINITY_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace wyze {
+
+    //解析 "0-3,8,10-11" 格式的 cpu 列表，格式错误返回 false
+    bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+
+    //解析调度线程的绑核配置，每组之间用 ';' 分隔，例如 "0-1;2-3" 表示两组核集合；
+    //没有 ';' 时每个 cpu 单独成组，"0-3" 等价于 "0;1;2;3"。第 i 个调度线程绑定到第 i % 组数 组
+    bool ParseCpuGroups(const std::string& str, std::vector<std::vector<int>>& groups);
+    std::string CpuListToString(const std::vector<int>& cpus);
+
+    //设置/获取当前线程可以运行的 cpu
+    bool SetThreadAffinity(const std::vector<int>& cpus);
+    std::vector<int> GetThreadAffinity();
+
+    int GetNumaNodeCount();         //在线的 NUMA 节点数，读取失败时返回 1
+    int GetCurrentCpu();
+    int GetCurrentNumaNode();
+
+    //让 [addr, addr + len) 优先从当前线程所在的 NUMA 节点分配物理页，
+    //只有一个节点时什么也不做。addr 需要按页对齐
+    bool NumaBindLocal(void* addr, size_t len);
+
+}
+
+#endif // !_WYZE_AFFINITY_H_
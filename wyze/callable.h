@@ -0,0 +1,192 @@
+#ifndef _WYZE_CALLABLE_H_
+#define _WYZE_CALLABLE_H_
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+namespace wyze {
+
+    namespace detail {
+        template<class F, class = void>
+        struct IsVoidCallable : std::false_type {};
+
+        template<class F>
+        struct IsVoidCallable<F, decltype((void)std::declval<F&>()())> : std::true_type {};
+
+        //空的 std::function 和函数指针转换后仍然是空的 Callable
+        template<class F>
+        bool IsEmptyCallable(const F&) { return false; }
+        template<class Sig>
+        bool IsEmptyCallable(const std::function<Sig>& f) { return !f; }
+        template<class R>
+        bool IsEmptyCallable(R (*f)()) { return f == nullptr; }
+    }
+
+    //只能移动的 void() 可调用对象，用于调度器、定时器和 IO 事件的回调。
+    //不超过 INLINE_SIZE 字节且移动不抛异常的函数对象直接放在对象内部，更大的才在堆上分配，
+    //整个调度路径上只移动不拷贝，常见的 lambda 从 schedule 到执行都不会分配内存
+    class Callable {
+    public:
+        static const size_t INLINE_SIZE = 6 * sizeof(void*);
+
+        Callable() noexcept {}
+        Callable(std::nullptr_t) noexcept {}
+
+        template<class F, class D = typename std::decay<F>::type,
+                 class = typename std::enable_if<!std::is_same<D, Callable>::value
+                                                 && detail::IsVoidCallable<D>::value>::type>
+        Callable(F&& f) {
+            if(detail::IsEmptyCallable(f)) {
+                return;
+            }
+            init(std::forward<F>(f), Fits<D>());
+        }
+
+        Callable(Callable&& rhs) noexcept {
+            moveFrom(rhs);
+        }
+
+        Callable& operator=(Callable&& rhs) noexcept {
+            if(this != &rhs) {
+                reset();
+                moveFrom(rhs);
+            }
+            return *this;
+        }
+
+        Callable& operator=(std::nullptr_t) noexcept {
+            reset();
+            return *this;
+        }
+
+        Callable(const Callable&) = delete;
+        Callable& operator=(const Callable&) = delete;
+
+        ~Callable() { reset(); }
+
+        explicit operator bool() const { return m_ops != nullptr; }
+        void operator()() { m_ops->invoke(&m_storage); }
+
+        void swap(Callable& rhs) noexcept {
+            Callable tmp(std::move(rhs));
+            rhs = std::move(*this);
+            *this = std::move(tmp);
+        }
+
+        void reset() noexcept {
+            if(m_ops) {
+                m_ops->destroy(&m_storage);
+                m_ops = nullptr;
+            }
+        }
+
+        bool isInline() const { return m_ops && m_ops->is_inline; }     //是否存放在对象内部
+        bool copyable() const { return m_ops && m_ops->copy; }          //保存的函数对象是否可以拷贝
+        Callable clone() const {            //拷贝保存的函数对象，不可拷贝时返回空对象
+            Callable c;
+            if(copyable()) {
+                m_ops->copy(&c.m_storage, &m_storage);
+                c.m_ops = m_ops;
+            }
+            return c;
+        }
+
+    private:
+        using Storage = typename std::aligned_storage<INLINE_SIZE, alignof(void*)>::type;
+
+        struct Ops {
+            void (*invoke)(void* p);
+            void (*move)(void* dst, void* src);     //移动到 dst 并析构 src
+            void (*destroy)(void* p);
+            void (*copy)(void* dst, const void* src);
+            bool is_inline;
+        };
+
+        template<class D>
+        struct Fits : std::integral_constant<bool,
+                        sizeof(D) <= INLINE_SIZE
+                        && alignof(D) <= alignof(Storage)
+                        && std::is_nothrow_move_constructible<D>::value> {};
+
+        //不可拷贝的类型不能实例化拷贝函数，按是否可拷贝选择，constexpr 保证 Ops 表是常量初始化
+        template<class D, bool C = std::is_copy_constructible<D>::value>
+        struct CopyOps {
+            static void inlineCopy(void* dst, const void* src) { new (dst) D(*static_cast<const D*>(src)); }
+            static void heapCopy(void* dst, const void* src) {
+                *static_cast<D**>(dst) = new D(**static_cast<D* const*>(src));
+            }
+            static constexpr void (*inlineFn())(void*, const void*) { return &inlineCopy; }
+            static constexpr void (*heapFn())(void*, const void*) { return &heapCopy; }
+        };
+
+        template<class D>
+        struct CopyOps<D, false> {
+            static constexpr void (*inlineFn())(void*, const void*) { return nullptr; }
+            static constexpr void (*heapFn())(void*, const void*) { return nullptr; }
+        };
+
+        template<class D>
+        struct InlineOps {
+            static void invoke(void* p) { (*static_cast<D*>(p))(); }
+            static void move(void* dst, void* src) {
+                new (dst) D(std::move(*static_cast<D*>(src)));
+                static_cast<D*>(src)->~D();
+            }
+            static void destroy(void* p) { static_cast<D*>(p)->~D(); }
+            static const Ops s_ops;
+        };
+
+        template<class D>
+        struct HeapOps {
+            static D*& get(void* p) { return *static_cast<D**>(p); }
+            static void invoke(void* p) { (*get(p))(); }
+            static void move(void* dst, void* src) { *static_cast<D**>(dst) = get(src); }
+            static void destroy(void* p) { delete get(p); }
+            static const Ops s_ops;
+        };
+
+        template<class F>
+        void init(F&& f, std::true_type) {
+            using D = typename std::decay<F>::type;
+            new (&m_storage) D(std::forward<F>(f));
+            m_ops = &InlineOps<D>::s_ops;
+        }
+
+        template<class F>
+        void init(F&& f, std::false_type) {
+            using D = typename std::decay<F>::type;
+            *reinterpret_cast<D**>(&m_storage) = new D(std::forward<F>(f));
+            m_ops = &HeapOps<D>::s_ops;
+        }
+
+        void moveFrom(Callable& rhs) noexcept {
+            if(rhs.m_ops) {
+                rhs.m_ops->move(&m_storage, &rhs.m_storage);
+                m_ops = rhs.m_ops;
+                rhs.m_ops = nullptr;
+            }
+        }
+
+    private:
+        Storage m_storage;
+        const Ops* m_ops = nullptr;
+    };
+
+    template<class D>
+    const Callable::Ops Callable::InlineOps<D>::s_ops = {
+        &InlineOps<D>::invoke, &InlineOps<D>::move, &InlineOps<D>::destroy,
+        CopyOps<D>::inlineFn(), true
+    };
+
+    template<class D>
+    const Callable::Ops Callable::HeapOps<D>::s_ops = {
+        &HeapOps<D>::invoke, &HeapOps<D>::move, &HeapOps<D>::destroy,
+        CopyOps<D>::heapFn(), false
+    };
+
+}
+
+#endif // !_WYZE_CALLABLE_H_
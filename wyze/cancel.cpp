@@ -0,0 +1,167 @@
+#include "cancel.h"
+#include "fiberlocal.h"
+#include "iomanager.h"
+#include "util.h"
+#include "macro.h"
+#include <sched.h>
+
+namespace wyze {
+
+    static FiberLocal<CancelToken::ptr> s_current;     //每个协程挂着的令牌
+
+    CancelToken::ptr CancelToken::Create(const ptr& parent)
+    {
+        ptr token(new CancelToken);
+        if(parent) {
+            std::weak_ptr<CancelToken> weak(token);
+            token->m_parent = parent;
+            token->m_parentCallback = parent->addCallback([weak]() {
+                ptr t = weak.lock();
+                if(t) {
+                    t->cancel();
+                }
+            });
+        }
+        return token;
+    }
+
+    CancelToken::~CancelToken()
+    {
+        if(m_parent) {
+            m_parent->removeCallback(m_parentCallback);
+        }
+        if(m_timer) {
+            m_timer->cancel();
+        }
+    }
+
+    //回调在锁外执行：回调中释放子令牌时，子令牌析构会回到本令牌的 removeCallback
+    void CancelToken::cancel()
+    {
+        std::vector<std::pair<uint64_t, Callable>> cbs;
+        Timer::ptr timer;
+        {
+            Mutex::Lock lock(m_mutex);
+            if(m_cancelled) {
+                return;
+            }
+            m_cancelThread = GetThreadId();
+            m_cancelled = true;
+            cbs.swap(m_callbacks);
+            timer.swap(m_timer);
+        }
+        for(auto& i : cbs) {
+            i.second();
+        }
+        m_callbacksDone = true;
+        if(timer) {
+            timer->cancel();
+        }
+    }
+
+    void CancelToken::cancelAfter(uint64_t ms, IOManager* iom)
+    {
+        if(!iom) {
+            iom = IOManager::GetThis();
+        }
+        WYZE_ASSERT2(iom, "cancelAfter needs IOManager");
+        std::weak_ptr<CancelToken> weak(shared_from_this());
+        Timer::ptr timer = iom->addTimer(ms, [weak]() {
+            ptr t = weak.lock();
+            if(t) {
+                t->cancel();
+            }
+        });
+        {
+            Mutex::Lock lock(m_mutex);
+            if(!m_cancelled) {
+                timer.swap(m_timer);    //换出之前的定时器
+            }
+        }
+        if(timer) {
+            timer->cancel();
+        }
+    }
+
+    uint64_t CancelToken::addCallback(Callable cb)
+    {
+        {
+            Mutex::Lock lock(m_mutex);
+            if(!m_cancelled) {
+                uint64_t id = m_nextId++;
+                m_callbacks.emplace_back(id, std::move(cb));
+                return id;
+            }
+        }
+        cb();
+        return 0;
+    }
+
+    void CancelToken::removeCallback(uint64_t id)
+    {
+        if(id == 0) {
+            return;
+        }
+        {
+            Mutex::Lock lock(m_mutex);
+            for(auto it = m_callbacks.begin(); it != m_callbacks.end(); ++it) {
+                if(it->first == id) {
+                    m_callbacks.erase(it);
+                    return;
+                }
+            }
+            if(!m_cancelled) {
+                return;
+            }
+        }
+        //cancel 已经取走了回调，等它执行完。在回调中(同一个线程)注销时不用等
+        if(m_cancelThread != GetThreadId()) {
+            while(!m_callbacksDone) {
+                sched_yield();
+            }
+        }
+    }
+
+    CancelToken::ptr CancelToken::GetCurrent()
+    {
+        ptr* p = s_current.tryGet();
+        return p ? *p : nullptr;
+    }
+
+    void CancelToken::SetCurrent(ptr token)
+    {
+        if(token) {
+            s_current.set(std::move(token));
+        }
+        else {
+            s_current.reset();
+        }
+    }
+
+    bool CancelToken::IsCurrentCancelled()
+    {
+        ptr* p = s_current.tryGet();
+        return p && *p && (*p)->isCancelled();
+    }
+
+    namespace {
+        struct TokenCallback {
+            CancelToken::ptr token;
+            Callable cb;
+
+            void operator()() {
+                CancelToken::SetCurrent(token);
+                cb();
+            }
+        };
+    }
+
+    Callable CancelToken::Bind(Callable cb, ptr token)
+    {
+        if(!token || !cb) {
+            return cb;
+        }
+        return Callable(TokenCallback{std::move(token), std::move(cb)});
+    }
+
+}
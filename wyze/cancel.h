@@ -0,0 +1,64 @@
+#ifndef _WYZE_CANCEL_H_
+#define _WYZE_CANCEL_H_
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include "thread.h"
+#include "callable.h"
+#include "timer.h"
+#include "noncopyable.h"
+
+namespace wyze {
+
+    class IOManager;
+
+    //取消令牌：挂到协程上后，取消会唤醒该协程在 hook 的 IO、connect、sleep 和 channel 上的等待，
+    //这些调用返回失败并设置 errno 为 ECANCELED。子令牌在父令牌取消时一起取消，
+    //用于把请求的取消传递给它派生出的协程
+    class CancelToken : public std::enable_shared_from_this<CancelToken>, Noncopyable {
+    public:
+        using ptr = std::shared_ptr<CancelToken>;
+
+        //parent 不为空时创建子令牌，父令牌已经取消时子令牌直接处于取消状态
+        static ptr Create(const ptr& parent = nullptr);
+        ~CancelToken();
+
+        //取消并执行所有回调，只有第一次调用生效，可以在任意线程调用
+        void cancel();
+        bool isCancelled() const { return m_cancelled; }
+        //ms 毫秒后自动取消，使用 iom 的定时器(默认当前线程的 IOManager)。
+        //令牌析构时会取消定时器，所以不能比 iom 活得更久
+        void cancelAfter(uint64_t ms, IOManager* iom = nullptr);
+
+        //注册取消时执行的回调，返回用于 removeCallback 的 id。已经取消时在当前线程立即执行并返回 0。
+        //回调在调用 cancel 的线程上执行，应当很短，并且不能操作同一个令牌
+        uint64_t addCallback(Callable cb);
+        //注销回调。返回后回调不会再执行，也不在执行中
+        void removeCallback(uint64_t id);
+
+        //当前协程的令牌，没有时返回 nullptr
+        static ptr GetCurrent();
+        static void SetCurrent(ptr token);
+        static bool IsCurrentCancelled();
+        //包装 cb，让执行它的协程使用 token，用于把令牌传给 schedule 出去的子协程
+        static Callable Bind(Callable cb, ptr token = GetCurrent());
+
+    private:
+        CancelToken() {}
+
+    private:
+        Mutex m_mutex;      //保护回调列表
+        std::vector<std::pair<uint64_t, Callable>> m_callbacks;
+        uint64_t m_nextId = 1;
+        std::atomic<bool> m_cancelled = {false};
+        std::atomic<bool> m_callbacksDone = {false};    //cancel 已经执行完所有回调
+        std::atomic<int> m_cancelThread = {-1};         //执行回调的线程
+        ptr m_parent;
+        uint64_t m_parentCallback = 0;  //在父令牌中注册的回调
+        Timer::ptr m_timer;             //cancelAfter 的定时器
+    };
+
+}
+
+#endif // !_WYZE_CANCEL_H_
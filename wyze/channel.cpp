@@ -0,0 +1,193 @@
+#include "channel.h"
+#include "cancel.h"
+#include "macro.h"
+#include <algorithm>
+
+namespace wyze {
+
+    ChannelWaiter::ptr ChannelWaiter::Create()
+    {
+        ChannelWaiter::ptr w = std::make_shared<ChannelWaiter>();
+        w->waiter.scheduler = Scheduler::GetThis();
+        WYZE_ASSERT2(w->waiter.scheduler, "channel wait outside scheduler");
+        w->waiter.fiber = Fiber::GetThis();
+        WYZE_ASSERT2(w->waiter.fiber.get() != Scheduler::GetMainFiber(), "channel wait in scheduler fiber");
+        return w;
+    }
+
+    bool ChannelWaiter::Fire(const ptr& w)
+    {
+        if(w->fired.exchange(true)) {
+            return false;
+        }
+        w->waiter.wake();
+        return true;
+    }
+
+    bool ChannelWaiter::Park(const ptr& w, uint64_t timeout_ms)
+    {
+        CancelToken::ptr token = CancelToken::GetCurrent();
+        uint64_t cancel_id = 0;
+        if(token) {
+            std::weak_ptr<ChannelWaiter> weak(w);
+            cancel_id = token->addCallback([weak]() {   //已经取消时立即执行，下面的切出消耗掉这次唤醒
+                ChannelWaiter::ptr w = weak.lock();
+                if(w && !w->fired.exchange(true)) {
+                    w->cancelled = true;
+                    w->waiter.wake();
+                }
+            });
+        }
+        Timer::ptr timer;
+        if(timeout_ms != ~0ull) {
+            IOManager* iom = IOManager::GetThis();
+            WYZE_ASSERT2(iom, "channel timeout needs IOManager");
+            std::weak_ptr<ChannelWaiter> weak(w);
+            timer = iom->addTimer(timeout_ms, [weak]() {
+                ChannelWaiter::ptr w = weak.lock();
+                if(w) {
+                    Fire(w);
+                }
+            });
+        }
+        Fiber::YeildToHold();
+        if(timer) {
+            timer->cancel();
+        }
+        if(token) {
+            token->removeCallback(cancel_id);
+        }
+        return w->cancelled;
+    }
+
+    bool ChannelWaiter::Cancel(const ptr& w)
+    {
+        if(w->fired.exchange(true)) {
+            Fiber::YeildToHold();   //已经被 schedule，切出一次，否则以后会被错误地恢复
+            return true;
+        }
+        return false;
+    }
+
+    void ChannelWaitList::add(const ChannelWaiter::ptr& w)
+    {
+        {
+            SpinLock::Lock lock(m_mutex);
+            m_waiters.push_back(w);
+            ++m_count;
+        }
+        //与 wakeOne 中的屏障配对：注册后再检查一次 channel，唤醒方先修改 channel 再检查等待者
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void ChannelWaitList::remove(const ChannelWaiter::ptr& w)
+    {
+        SpinLock::Lock lock(m_mutex);
+        auto it = std::find(m_waiters.begin(), m_waiters.end(), w);
+        if(it != m_waiters.end()) {
+            m_waiters.erase(it);
+            --m_count;
+        }
+    }
+
+    void ChannelWaitList::wakeOne()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_count == 0) {
+            return;
+        }
+
+        ChannelWaiter::ptr w;
+        SpinLock::Lock lock(m_mutex);
+        while(!m_waiters.empty()) {
+            w = std::move(m_waiters.front());
+            m_waiters.pop_front();
+            --m_count;
+            if(!w->fired.exchange(true)) {  //select 的等待者可能已经被其他 channel 唤醒
+                break;
+            }
+            w.reset();
+        }
+        lock.unlock();
+        if(w) {
+            w->waiter.wake();
+        }
+    }
+
+    void ChannelWaitList::wakeAll()
+    {
+        std::list<ChannelWaiter::ptr> waiters;
+        {
+            SpinLock::Lock lock(m_mutex);
+            waiters.swap(m_waiters);
+            m_count = 0;
+        }
+        for(auto& i : waiters) {
+            ChannelWaiter::Fire(i);
+        }
+    }
+
+    int Select::tryWait()
+    {
+        static thread_local size_t s_round = 0;     //轮换起点，避免总是先选中前面的 channel
+        size_t n = m_cases.size();
+        size_t start = n ? (s_round++ % n) : 0;
+        for(size_t i = 0; i < n; ++i) {
+            size_t idx = (start + i) % n;
+            if(m_cases[idx].op()) {
+                return idx;
+            }
+        }
+        return -1;
+    }
+
+    int Select::wait(uint64_t timeout_ms)
+    {
+        WYZE_ASSERT2(!m_cases.empty() || timeout_ms != ~0ull, "select without case");
+        uint64_t deadline = timeout_ms == ~0ull ? ~0ull : GetCurrentMS() + timeout_ms;
+        while(true) {
+            int idx = tryWait();
+            if(idx >= 0) {
+                return idx;
+            }
+
+            ChannelWaiter::ptr w = ChannelWaiter::Create();
+            for(auto& i : m_cases) {
+                i.list->add(w);
+            }
+            idx = tryWait();
+            uint64_t left = ~0ull;
+            if(deadline != ~0ull) {
+                uint64_t now = GetCurrentMS();
+                left = now >= deadline ? 0 : deadline - now;
+            }
+            bool fired = false;
+            bool cancelled = false;
+            if(idx >= 0 || left == 0) {
+                fired = ChannelWaiter::Cancel(w);
+            }
+            else {
+                cancelled = ChannelWaiter::Park(w, left);
+            }
+            for(auto& i : m_cases) {
+                i.list->remove(w);
+            }
+            if(fired) {     //不知道是哪个 channel 唤醒的，都转交一次
+                for(auto& i : m_cases) {
+                    i.list->wakeOne();
+                }
+            }
+            if(idx >= 0) {
+                return idx;
+            }
+            if(left == 0) {
+                return -1;
+            }
+            if(cancelled) {
+                errno = ECANCELED;
+                return -1;
+            }
+        }
+    }
+
+}
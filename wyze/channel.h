@@ -0,0 +1,324 @@
+#ifndef _WYZE_CHANNEL_H_
+#define _WYZE_CHANNEL_H_
+
+#include <memory>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <errno.h>
+#include "fibersync.h"
+#include "iomanager.h"
+#include "util.h"
+#include "macro.h"
+
+namespace wyze {
+
+    //挂在一个或多个 channel 上的等待者，唤醒时不传递数据，被唤醒的协程重新尝试收发。
+    //等待者在堆上，共享栈协程挂起时栈会被换出，不能让其他线程访问协程栈上的对象
+    struct ChannelWaiter {
+        using ptr = std::shared_ptr<ChannelWaiter>;
+
+        FiberWaiter waiter;
+        std::atomic<bool> fired = {false};  //只能被唤醒一次
+        bool cancelled = false;             //被当前协程的取消令牌唤醒
+
+        static ptr Create();                            //为当前协程创建等待者
+        static bool Fire(const ptr& w);                 //第一次调用时把协程放回调度器
+        //挂起，超时由 IOManager 的定时器唤醒，当前协程的 CancelToken 取消时也会唤醒，返回是否被取消
+        static bool Park(const ptr& w, uint64_t timeout_ms);
+        static bool Cancel(const ptr& w);               //不再挂起，如果已经被唤醒需要切出一次，消耗掉那次调度，返回是否被唤醒过
+    };
+
+    class ChannelWaitList : Noncopyable {
+    public:
+        void add(const ChannelWaiter::ptr& w);
+        void remove(const ChannelWaiter::ptr& w);
+        void wakeOne();     //唤醒一个还没有被唤醒的等待者，没有等待者时不加锁
+        void wakeAll();
+
+    private:
+        SpinLock m_mutex;
+        std::list<ChannelWaiter::ptr> m_waiters;
+        std::atomic<size_t> m_count = {0};
+    };
+
+    //有界的多生产者多消费者 channel。缓冲区是无锁环形队列，只有需要挂起或唤醒协程时才加锁
+    template<class T>
+    class Channel : Noncopyable {
+    public:
+        using ptr = std::shared_ptr<Channel>;
+
+        explicit Channel(size_t capacity)
+            : m_capacity(capacity) {
+            WYZE_ASSERT2(capacity > 0, "Channel capacity must > 0");
+            m_cells = new Cell[m_capacity];
+            for(size_t i = 0; i < m_capacity; ++i) {
+                m_cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~Channel() {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            for(size_t pos = m_head.load(std::memory_order_relaxed); pos < tail; ++pos) {
+                reinterpret_cast<T*>(&m_cells[pos % m_capacity].storage)->~T();
+            }
+            delete[] m_cells;
+        }
+
+        bool trySend(const T& v) {
+            T tmp(v);
+            return trySend(std::move(tmp));
+        }
+
+        //失败时不会移动 v
+        bool trySend(T&& v) {
+            if(m_closed || !push(v)) {
+                return false;
+            }
+            m_recvWaiters.wakeOne();
+            return true;
+        }
+
+        bool tryRecv(T& v) {
+            if(!pop(v)) {
+                return false;
+            }
+            m_sendWaiters.wakeOne();
+            return true;
+        }
+
+        //缓冲区满时挂起当前协程，返回 false 表示 channel 已经关闭、超时或者被取消(errno 为 ECANCELED)
+        bool send(T v, uint64_t timeout_ms = ~0ull) {
+            uint64_t deadline = Deadline(timeout_ms);
+            while(true) {
+                if(trySend(std::move(v))) {
+                    return true;
+                }
+                if(m_closed) {
+                    return false;
+                }
+
+                ChannelWaiter::ptr w = ChannelWaiter::Create();
+                m_sendWaiters.add(w);
+                bool done = trySend(std::move(v));
+                uint64_t left = Remaining(deadline);
+                bool fired = false;
+                bool cancelled = false;
+                if(done || m_closed || left == 0) {
+                    fired = ChannelWaiter::Cancel(w);
+                }
+                else {
+                    cancelled = ChannelWaiter::Park(w, left);
+                }
+                m_sendWaiters.remove(w);
+                if(fired) {
+                    m_sendWaiters.wakeOne();  //这次唤醒没有用上，交给其他等待者
+                }
+                if(done) {
+                    return true;
+                }
+                if(left == 0) {
+                    return false;
+                }
+                if(cancelled) {
+                    errno = ECANCELED;
+                    return false;
+                }
+            }
+        }
+
+        //缓冲区空时挂起当前协程，返回 false 表示 channel 已经关闭且没有数据、超时或者被取消
+        bool recv(T& v, uint64_t timeout_ms = ~0ull) {
+            uint64_t deadline = Deadline(timeout_ms);
+            while(true) {
+                if(tryRecv(v)) {
+                    return true;
+                }
+                if(m_closed) {
+                    return tryRecv(v);  //关闭前写入的数据
+                }
+
+                ChannelWaiter::ptr w = ChannelWaiter::Create();
+                m_recvWaiters.add(w);
+                bool done = tryRecv(v);
+                uint64_t left = Remaining(deadline);
+                bool fired = false;
+                bool cancelled = false;
+                if(done || m_closed || left == 0) {
+                    fired = ChannelWaiter::Cancel(w);
+                }
+                else {
+                    cancelled = ChannelWaiter::Park(w, left);
+                }
+                m_recvWaiters.remove(w);
+                if(fired) {
+                    m_recvWaiters.wakeOne();  //这次唤醒没有用上，交给其他等待者
+                }
+                if(done) {
+                    return true;
+                }
+                if(left == 0) {
+                    return false;
+                }
+                if(cancelled) {
+                    errno = ECANCELED;
+                    return false;
+                }
+            }
+        }
+
+        //关闭后不能再发送，接收方可以取完剩余的数据
+        void close() {
+            if(m_closed.exchange(true)) {
+                return;
+            }
+            m_recvWaiters.wakeAll();
+            m_sendWaiters.wakeAll();
+        }
+
+        bool isClosed() const { return m_closed; }
+        size_t getCapacity() const { return m_capacity; }
+        size_t getSize() const {    //并发时只是一个近似值
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t head = m_head.load(std::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+
+    private:
+        friend class Select;
+
+        static uint64_t Deadline(uint64_t timeout_ms) {
+            return timeout_ms == ~0ull ? ~0ull : GetCurrentMS() + timeout_ms;
+        }
+
+        static uint64_t Remaining(uint64_t deadline) {
+            if(deadline == ~0ull) {
+                return ~0ull;
+            }
+            uint64_t now = GetCurrentMS();
+            return now >= deadline ? 0 : deadline - now;
+        }
+
+        //每个格子的 seq 表示该格子可以写入（seq == pos）或可以读取（seq == pos + 1）
+        struct Cell {
+            std::atomic<size_t> seq;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+
+        bool push(T& v) {
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+            while(true) {
+                Cell& cell = m_cells[pos % m_capacity];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if(diff == 0) {
+                    if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        new (&cell.storage) T(std::move(v));
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(diff < 0) {     //满了
+                    return false;
+                }
+                else {
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(T& v) {
+            size_t pos = m_head.load(std::memory_order_relaxed);
+            while(true) {
+                Cell& cell = m_cells[pos % m_capacity];
+                size_t seq = cell.seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+                if(diff == 0) {
+                    if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        T* p = reinterpret_cast<T*>(&cell.storage);
+                        v = std::move(*p);
+                        p->~T();
+                        cell.seq.store(pos + m_capacity, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if(diff < 0) {     //空的
+                    return false;
+                }
+                else {
+                    pos = m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        size_t m_capacity;
+        Cell* m_cells = nullptr;
+        std::atomic<size_t> m_head = {0};   //下一个读取的位置
+        std::atomic<size_t> m_tail = {0};   //下一个写入的位置
+        std::atomic<bool> m_closed = {false};
+        ChannelWaitList m_recvWaiters;      //等待数据的协程
+        ChannelWaitList m_sendWaiters;      //等待空位的协程
+    };
+
+    //在多个 channel 上等待，任意一个可以收发时返回它的下标。
+    //已经关闭的 channel 也算就绪，收发结果通过 ok 返回
+    class Select : Noncopyable {
+    public:
+        template<class T>
+        int recv(Channel<T>& ch, T& v, bool* ok = nullptr) {
+            Case c;
+            c.list = &ch.m_recvWaiters;
+            c.op = [&ch, &v, ok]() {
+                bool rt = ch.tryRecv(v);
+                if(!rt && !ch.isClosed()) {
+                    return false;
+                }
+                if(!rt) {
+                    rt = ch.tryRecv(v);
+                }
+                if(ok) {
+                    *ok = rt;
+                }
+                return true;
+            };
+            m_cases.push_back(std::move(c));
+            return m_cases.size() - 1;
+        }
+
+        template<class T>
+        int send(Channel<T>& ch, T v, bool* ok = nullptr) {
+            std::shared_ptr<T> val = std::make_shared<T>(std::move(v));
+            Case c;
+            c.list = &ch.m_sendWaiters;
+            c.op = [&ch, val, ok]() {
+                bool rt = ch.trySend(std::move(*val));
+                if(!rt && !ch.isClosed()) {
+                    return false;
+                }
+                if(ok) {
+                    *ok = rt;
+                }
+                return true;
+            };
+            m_cases.push_back(std::move(c));
+            return m_cases.size() - 1;
+        }
+
+        int tryWait();                          //不挂起，没有就绪的返回 -1
+        int wait(uint64_t timeout_ms = ~0ull);  //超时或者被取消(errno 为 ECANCELED)返回 -1
+
+    private:
+        struct Case {
+            ChannelWaitList* list = nullptr;    //挂起时注册到的等待队列
+            std::function<bool()> op;           //尝试收发，就绪返回 true
+        };
+        std::vector<Case> m_cases;
+    };
+
+}
+
+#endif // !_WYZE_CHANNEL_H_
@@ -0,0 +1,160 @@
+#include "context.h"
+#include <stdint.h>
+#include <string.h>
+
+#if WYZE_CONTEXT_ASM
+
+#if defined(__x86_64__)
+//栈上的布局(从低地址到高地址)：mxcsr/x87 控制字(16)  r15 r14 r13 r12 rbx rbp  返回地址
+asm(R"(
+    .text
+    .globl wyze_swap_context
+    .type wyze_swap_context, @function
+    .align 16
+wyze_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $16, %rsp
+    stmxcsr 8(%rsp)
+    fnstcw 12(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr 8(%rsp)
+    fldcw 12(%rsp)
+    addq $16, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size wyze_swap_context, .-wyze_swap_context
+
+    .globl wyze_context_entry
+    .type wyze_context_entry, @function
+    .align 16
+wyze_context_entry:
+    .cfi_startproc
+    .cfi_undefined rip
+    movq %r12, %rax
+    callq *%rax
+    ud2
+    .cfi_endproc
+    .size wyze_context_entry, .-wyze_context_entry
+)");
+
+#elif defined(__aarch64__)
+//栈上的布局(从低地址到高地址)：x19-x28  x29 x30(返回地址)  d8-d15
+asm(R"(
+    .text
+    .globl wyze_swap_context
+    .type wyze_swap_context, %function
+    .align 4
+wyze_swap_context:
+    sub sp, sp, #160
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size wyze_swap_context, .-wyze_swap_context
+
+    .globl wyze_context_entry
+    .type wyze_context_entry, %function
+    .align 4
+wyze_context_entry:
+    .cfi_startproc
+    .cfi_undefined x30
+    blr x19
+    brk #0
+    .cfi_endproc
+    .size wyze_context_entry, .-wyze_context_entry
+)");
+#endif
+
+extern "C" void wyze_context_entry();
+
+#endif
+
+namespace wyze {
+
+#if WYZE_CONTEXT_ASM
+
+    bool MakeContext(FiberContext* ctx, void* stack, size_t size, void (*fn)())
+    {
+        uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;     //栈顶 16 字节对齐
+    #if defined(__x86_64__)
+        //ret 到 wyze_context_entry 后 rsp 为 top - 16，call fn 时满足 16 字节对齐
+        uint64_t* sp = (uint64_t*)(top - 88);
+        memset(sp, 0, 88);
+        uint32_t* ctrl = (uint32_t*)sp;
+        ctrl[2] = 0x1F80;                   //mxcsr 默认值
+        ctrl[3] = 0x037F;                   //x87 控制字默认值
+        sp[5] = (uint64_t)fn;               //r12
+        sp[8] = (uint64_t)&wyze_context_entry;  //返回地址
+    #elif defined(__aarch64__)
+        uint64_t* sp = (uint64_t*)(top - 160);
+        memset(sp, 0, 160);
+        sp[0] = (uint64_t)fn;               //x19
+        sp[11] = (uint64_t)&wyze_context_entry; //x30
+    #endif
+        ctx->sp = sp;
+        return true;
+    }
+
+    const char* ContextImplName()
+    {
+    #if defined(__x86_64__)
+        return "asm-x86_64";
+    #else
+        return "asm-aarch64";
+    #endif
+    }
+
+#else
+
+    bool MakeContext(FiberContext* ctx, void* stack, size_t size, void (*fn)())
+    {
+        if(getcontext(&ctx->uc)) {
+            return false;
+        }
+        ctx->uc.uc_link = nullptr;
+        ctx->uc.uc_stack.ss_size = size;
+        ctx->uc.uc_stack.ss_sp = stack;
+        makecontext(&ctx->uc, fn, 0);
+        return true;
+    }
+
+    const char* ContextImplName()
+    {
+        return "ucontext";
+    }
+
+#endif
+
+}
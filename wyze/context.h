@@ -0,0 +1,49 @@
+#ifndef _WYZE_CONTEXT_H_
+#define _WYZE_CONTEXT_H_
+
+#include <stddef.h>
+
+//编译时打开 WYZE_FIBER_ASM 并且是 x86-64/aarch64 时，使用汇编实现的上下文切换，
+//只保存被调用者保存的寄存器，不像 swapcontext 每次切换都调用 rt_sigprocmask
+#if defined(WYZE_FIBER_ASM) && (defined(__x86_64__) || defined(__aarch64__))
+    #define WYZE_CONTEXT_ASM 1
+#else
+    #define WYZE_CONTEXT_ASM 0
+    #include <ucontext.h>
+#endif
+
+#if WYZE_CONTEXT_ASM
+extern "C" {
+    //保存当前寄存器到当前栈上，栈顶写入 *from_sp，再从 to_sp 恢复寄存器
+    void wyze_swap_context(void** from_sp, void* to_sp);
+}
+#endif
+
+namespace wyze {
+
+    struct FiberContext {
+    #if WYZE_CONTEXT_ASM
+        void* sp = nullptr;     //切出时的栈顶，寄存器保存在栈上
+    #else
+        ucontext_t uc;
+    #endif
+    };
+
+    //初始化上下文，第一次切换进来时在 stack 上执行 fn，fn 不能返回
+    bool MakeContext(FiberContext* ctx, void* stack, size_t size, void (*fn)());
+
+    //保存当前上下文到 from， 切换到 to
+    inline bool SwapContext(FiberContext* from, FiberContext* to) {
+    #if WYZE_CONTEXT_ASM
+        wyze_swap_context(&from->sp, to->sp);
+        return true;
+    #else
+        return swapcontext(&from->uc, &to->uc) == 0;
+    #endif
+    }
+
+    //当前使用的上下文切换实现
+    const char* ContextImplName();
+}
+
+#endif // !_WYZE_CONTEXT_H_
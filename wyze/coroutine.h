@@ -0,0 +1,300 @@
+#ifndef _WYZE_COROUTINE_H_
+#define _WYZE_COROUTINE_H_
+
+//无栈协程前端，需要使用 C++20 编译包含该头文件的源文件，库本身仍然是 C++11。
+//协程挂起时只占用协程帧，恢复时在调度器的线程上（某个执行回调的 Fiber 中）继续运行，
+//因此可以和 Fiber 以及 hook 的阻塞调用混用
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "wyze/coroutine.h requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <coroutine>
+#include <chrono>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <memory>
+#include <errno.h>
+#include <sys/socket.h>
+#include "iomanager.h"
+#include "hook.h"
+#include "socket.h"
+#include "log.h"
+#include "macro.h"
+
+namespace wyze {
+
+    template<class T = void>
+    class task;
+
+    namespace detail {
+
+        struct promise_base {
+            std::coroutine_handle<> continuation;   //co_await 该 task 的协程，结束时切回去
+            std::exception_ptr exception;
+
+            //结束时对称转移到等待者，嵌套很深也不会增加调用栈
+            struct final_awaiter {
+                bool await_ready() noexcept { return false; }
+                template<class P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                    std::coroutine_handle<> c = h.promise().continuation;
+                    return c ? c : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+
+            std::suspend_always initial_suspend() noexcept { return {}; }   //惰性启动，被 co_await 时才执行
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        template<class T>
+        struct promise : promise_base {
+            std::optional<T> value;
+
+            task<T> get_return_object();
+            template<class U>
+            void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+            T result() {
+                if(exception) {
+                    std::rethrow_exception(exception);
+                }
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct promise<void> : promise_base {
+            task<void> get_return_object();
+            void return_void() {}
+            void result() {
+                if(exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+    }
+
+    //惰性执行的协程任务，co_await 时开始执行，结束后恢复等待者
+    template<class T>
+    class task {
+    public:
+        using promise_type = detail::promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        explicit task(handle_type h) : m_handle(h) {}
+        task(task&& rhs) noexcept : m_handle(std::exchange(rhs.m_handle, nullptr)) {}
+        task& operator=(task&& rhs) noexcept {
+            if(this != &rhs) {
+                if(m_handle) {
+                    m_handle.destroy();
+                }
+                m_handle = std::exchange(rhs.m_handle, nullptr);
+            }
+            return *this;
+        }
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+        ~task() {
+            if(m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        struct awaiter {
+            handle_type handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+                handle.promise().continuation = c;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+
+        awaiter operator co_await() && noexcept { return awaiter{m_handle}; }
+        awaiter operator co_await() & noexcept { return awaiter{m_handle}; }
+
+        bool isDone() const { return !m_handle || m_handle.done(); }
+
+    private:
+        handle_type m_handle;
+    };
+
+    namespace detail {
+
+        template<class T>
+        inline task<T> promise<T>::get_return_object() {
+            return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> promise<void>::get_return_object() {
+            return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+        }
+
+        //co_spawn 的根协程，结束时自己释放
+        struct detached {
+            struct promise_type {
+                detached get_return_object() {
+                    return detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+                }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() {
+                    static Logger::ptr s_logger = WYZE_LOG_NAME("system");
+                    try {
+                        std::rethrow_exception(std::current_exception());
+                    } catch(std::exception& e) {
+                        WYZE_LOG_ERROR(s_logger) << "co_spawn task exception: " << e.what();
+                    } catch(...) {
+                        WYZE_LOG_ERROR(s_logger) << "co_spawn task exception";
+                    }
+                }
+            };
+            std::coroutine_handle<promise_type> handle;
+        };
+
+        inline detached RunDetached(task<void> t) {
+            co_await std::move(t);
+        }
+
+        inline IOManager* CurrentIOManager() {
+            IOManager* iom = IOManager::GetThis();
+            WYZE_ASSERT2(iom, "coroutine awaiter needs IOManager");
+            return iom;
+        }
+
+    }
+
+    //把协程交给调度器执行，不等待结果，异常只记录日志
+    inline void co_spawn(Scheduler* sched, task<void> t) {
+        std::coroutine_handle<> h = detail::RunDetached(std::move(t)).handle;
+        sched->schedule([h]() { h.resume(); });
+    }
+
+    //定时器恢复协程
+    struct SleepAwaiter {
+        uint64_t ms;
+
+        bool await_ready() const noexcept { return ms == 0; }
+        void await_suspend(std::coroutine_handle<> h) {
+            detail::CurrentIOManager()->addTimer(ms, [h]() { h.resume(); });
+        }
+        void await_resume() noexcept {}
+    };
+
+    template<class Rep, class Period>
+    inline SleepAwaiter sleep(std::chrono::duration<Rep, Period> d) {
+        return SleepAwaiter{(uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(d).count()};
+    }
+
+    //等待 fd 可读或可写，直接注册到 IOManager::addEvent，超时返回 false 且 errno = ETIMEDOUT
+    struct FdAwaiter {
+        int fd;
+        IOManager::Event event;
+        uint64_t timeout_ms;
+        bool ok = true;
+        std::shared_ptr<int> timed_out;
+        Timer::ptr timer;
+
+        bool await_ready() const noexcept { return false; }
+        //和 hook 的 do_io 一样先设置定时器再注册事件。注册成功后协程可能已经在其他线程恢复，不能再访问 this
+        bool await_suspend(std::coroutine_handle<> h) {
+            IOManager* iom = detail::CurrentIOManager();
+            if(timeout_ms != ~0ull) {
+                timed_out = std::make_shared<int>(0);
+                std::weak_ptr<int> winfo(timed_out);
+                int fd_ = fd;
+                IOManager::Event ev = event;
+                timer = iom->addConditionTimer(timeout_ms, [winfo, fd_, ev, iom]() {
+                    auto t = winfo.lock();
+                    if(!t || *t) {
+                        return;
+                    }
+                    *t = ETIMEDOUT;
+                    iom->canceEvent(fd_, ev);   //触发事件回调，恢复协程
+                }, winfo);
+            }
+            if(iom->addEvent(fd, event, [h]() { h.resume(); })) {
+                if(timer) {
+                    timer->cancel();
+                    timer.reset();
+                }
+                ok = false;     //注册失败，不挂起
+                return false;
+            }
+            return true;
+        }
+        bool await_resume() {
+            if(timer) {
+                timer->cancel();
+            }
+            if(timed_out && *timed_out) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            return ok;
+        }
+    };
+
+    inline FdAwaiter readable(int fd, uint64_t timeout_ms = ~0ull) {
+        return FdAwaiter{fd, IOManager::READ, timeout_ms};
+    }
+
+    inline FdAwaiter writable(int fd, uint64_t timeout_ms = ~0ull) {
+        return FdAwaiter{fd, IOManager::WRITE, timeout_ms};
+    }
+
+    //非阻塞调用原始的系统调用，EAGAIN 时等待 fd 就绪后重试
+    inline task<ssize_t> async_recv(int fd, void* buf, size_t len, int flags = 0, uint64_t timeout_ms = ~0ull) {
+        while(true) {
+            ssize_t n = recv_f(fd, buf, len, flags | MSG_DONTWAIT);
+            if(n >= 0 || (errno != EAGAIN && errno != EINTR)) {
+                co_return n;
+            }
+            if(errno == EAGAIN && !co_await readable(fd, timeout_ms)) {
+                co_return -1;
+            }
+        }
+    }
+
+    inline task<ssize_t> async_send(int fd, const void* buf, size_t len, int flags = 0, uint64_t timeout_ms = ~0ull) {
+        while(true) {
+            ssize_t n = send_f(fd, buf, len, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(n >= 0 || (errno != EAGAIN && errno != EINTR)) {
+                co_return n;
+            }
+            if(errno == EAGAIN && !co_await writable(fd, timeout_ms)) {
+                co_return -1;
+            }
+        }
+    }
+
+    //返回新连接的 fd，由调用者关闭
+    inline task<int> async_accept(int fd, uint64_t timeout_ms = ~0ull) {
+        while(true) {
+            int rt = accept_f(fd, nullptr, nullptr);
+            if(rt >= 0 || (errno != EAGAIN && errno != EINTR)) {
+                co_return rt;
+            }
+            if(errno == EAGAIN && !co_await readable(fd, timeout_ms)) {
+                co_return -1;
+            }
+        }
+    }
+
+    //task 在 co_await 时才开始执行，sock 保存在协程帧中，调用者提前释放 Socket::ptr 也不会关闭 fd
+    inline task<ssize_t> async_recv(Socket::ptr sock, void* buf, size_t len, int flags = 0) {
+        co_return co_await async_recv(sock->getSocket(), buf, len, flags, sock->getRecvTimeout() == (int64_t)-1 ? ~0ull : (uint64_t)sock->getRecvTimeout());
+    }
+
+    inline task<ssize_t> async_send(Socket::ptr sock, const void* buf, size_t len, int flags = 0) {
+        co_return co_await async_send(sock->getSocket(), buf, len, flags, sock->getSendTimeout() == (int64_t)-1 ? ~0ull : (uint64_t)sock->getSendTimeout());
+    }
+
+}
+
+#endif // !_WYZE_COROUTINE_H_
@@ -1,4 +1,5 @@
 #include "crypto.h"
+#include "offload.h"
 #include "openssl/pem.h"
 #include "openssl/aes.h"
 
@@ -188,8 +189,10 @@ std::string Rsa::decrypt(const std::string& data)
         return {};
     
     std::shared_ptr<unsigned char> debuf(new unsigned char[m_keyLen]);
-    int len = RSA_private_decrypt(data.size(), (const unsigned char*)data.c_str(),
+    int len = Offload([&]() {
+        return RSA_private_decrypt(data.size(), (const unsigned char*)data.c_str(),
                     debuf.get(), m_priKey, RSA_PKCS1_PADDING);
+    });
     return std::string((char*)debuf.get(), len);
 }
 
@@ -220,9 +223,12 @@ std::string Rsa::sign(HashType type, const std::string& data)
     
     std::shared_ptr<unsigned char> signData(new unsigned char[m_keyLen]);
 
-    unsigned int signLen;
-    RSA_sign(getRsaType(type), (const unsigned char*)data.c_str(), data.size()
+    //私钥运算耗时较长，放到 offload 线程池执行
+    unsigned int signLen = 0;
+    Offload([&]() {
+        return RSA_sign(getRsaType(type), (const unsigned char*)data.c_str(), data.size()
                 ,signData.get(), &signLen, m_priKey);
+    });
 
     return (int)signLen == m_keyLen ? std::string((char*)signData.get(), signLen) : std::string();
 }
@@ -1,4 +1,5 @@
 #include "mysqlconn.h"
+#include "../offload.h"
 #include <iostream>
 
 namespace wyze {
@@ -32,8 +33,11 @@ bool MysqlConn::connect(const std::string& user, const std::string &password,
     if(m_mysql == nullptr) 
         return false;
 
-    MYSQL* ptr = mysql_real_connect(m_mysql, ip.c_str(), user.c_str(), password.c_str(),
+    //mysql 客户端库的网络 IO 不经过 hook，在 offload 线程池中执行，不阻塞调度线程
+    MYSQL* ptr = Offload([&]() {
+        return mysql_real_connect(m_mysql, ip.c_str(), user.c_str(), password.c_str(),
                                         dbName.c_str(), port, nullptr, 0);
+    });
     
     return ptr == m_mysql ? true: false;
 }
@@ -43,7 +47,9 @@ bool MysqlConn::update(const std::string& sql)
     if(m_mysql == nullptr) 
         return false;
 
-    int ret = mysql_query(m_mysql, sql.c_str());
+    int ret = Offload([&]() {
+        return mysql_query(m_mysql, sql.c_str());
+    });
     return ret == 0 ? true: false;
 }
 
@@ -55,12 +61,17 @@ bool MysqlConn::query(const std::string& sql)
     //释放查询结果集
     freeResult();
 
-    int ret = mysql_query(m_mysql, sql.c_str());
+    int ret = Offload([&]() {
+        int rt = mysql_query(m_mysql, sql.c_str());
+        if(rt == 0) {
+            m_result = mysql_store_result(m_mysql);
+        }
+        return rt;
+    });
     if(ret != 0) {
         return false;
     }
 
-    m_result = mysql_store_result(m_mysql);
 
     return m_result == nullptr ? false: true;
 }
@@ -95,7 +106,9 @@ bool MysqlConn::transaction()
     if(m_mysql == nullptr) 
         return false;
 
-    int ret = mysql_autocommit(m_mysql, false);
+    int ret = Offload([&]() {
+        return mysql_autocommit(m_mysql, false);
+    });
     return ret == 0 ? true: false;
 }
 
@@ -104,7 +117,9 @@ bool MysqlConn::commit()
     if(m_mysql == nullptr) 
         return false;
 
-    int ret = mysql_commit(m_mysql);
+    int ret = Offload([&]() {
+        return mysql_commit(m_mysql);
+    });
     return ret == 0 ? true: false;
 }
 
@@ -113,7 +128,9 @@ bool MysqlConn::rollback()
     if(m_mysql == nullptr) 
         return false;
 
-    int ret = mysql_rollback(m_mysql);
+    int ret = Offload([&]() {
+        return mysql_rollback(m_mysql);
+    });
     return ret == 0 ? true: false;
 }
 
@@ -1,9 +1,15 @@
 #include "fiber.h"
 #include <atomic>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <vector>
 #include "config.h"
 #include "macro.h"
 #include "scheduler.h"
+#include "affinity.h"
 
 namespace wyze {
 
@@ -19,63 +25,220 @@ static thread_local Fiber::ptr t_threadFiber = nullptr;     //main 协程对象
 static ConfigVar<uint64_t>::ptr g_fiber_stack_size = 
             Config::Lookup<uint64_t>("fiber.stack_size", 16 * 1024, "fiber stack size");
 
-class MallocStackAllocator {
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+            Config::Lookup<std::string>("fiber.stack_allocator", "malloc", "fiber stack allocator: malloc or mmap");
+
+static ConfigVar<bool>::ptr g_fiber_stack_numa_local =
+            Config::Lookup<bool>("fiber.stack_numa_local", true, "mmap fiber stacks prefer the numa node of the allocating thread");
+
+static ConfigVar<uint64_t>::ptr g_fiber_shared_stack_size =
+            Config::Lookup<uint64_t>("fiber.shared_stack_size", 1024 * 1024, "per thread shared fiber stack size");
+
+static ConfigVar<uint32_t>::ptr g_fiber_pool_max_size =
+            Config::Lookup<uint32_t>("fiber.pool.max_size", 128, "max cached fibers per thread");
+
+static std::atomic<uint64_t> s_stack_total {0};     //所有协程栈申请的虚拟内存大小
+
+class StackAllocator {
 public:
-    static void* Alloc(size_t size) {
+    virtual ~StackAllocator() {}
+    virtual void* alloc(size_t size) = 0;
+    virtual void dealloc(void* p, size_t size) = 0;
+};
+
+class MallocStackAllocator : public StackAllocator {
+public:
+    void* alloc(size_t size) override {
         return malloc(size);
     } 
 
-    static void Dealloc(void* p, size_t size) {
+    void dealloc(void* p, size_t size) override {
         return free(p);
     }
 };
 
-using StackAllocator = MallocStackAllocator;
+//使用 mmap 分配栈，MAP_NORESERVE 只有在访问到页时才占用物理内存，
+//栈底(低地址)多分配一页设置为 PROT_NONE，栈溢出时直接段错误而不是破坏其他内存
+static bool s_numa_local = true;
+
+class MmapStackAllocator : public StackAllocator {
+public:
+    void* alloc(size_t size) override {
+        size_t page = PageSize();
+        size_t len = RoundUp(size) + page;
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE
+                        , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if(p == MAP_FAILED) {
+            WYZE_LOG_ERROR(g_logger) << "mmap stack size=" << len
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+
+        if(mprotect(p, page, PROT_NONE)) {
+            WYZE_LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno
+                << " errstr=" << strerror(errno);
+        }
+        //协程由取到任务的调度线程创建并通常在该线程上执行，页面还没有分配，
+        //按分配线程所在节点绑定，被其他节点的线程先访问到也不会放到远端
+        if(s_numa_local) {
+            NumaBindLocal((char*)p + page, len - page);
+        }
+        return (char*)p + page;
+    }
+
+    void dealloc(void* p, size_t size) override {
+        size_t page = PageSize();
+        munmap((char*)p - page, RoundUp(size) + page);
+    }
+
+    static size_t PageSize() {
+        static size_t s_page = sysconf(_SC_PAGESIZE);
+        return s_page;
+    }
+
+    static size_t RoundUp(size_t size) {
+        size_t page = PageSize();
+        return (size + page - 1) / page * page;
+    }
+};
+
+static MallocStackAllocator s_malloc_allocator;
+static MmapStackAllocator s_mmap_allocator;
+
+static StackAllocator* GetStackAllocator(const std::string& name)
+{
+    if(name == "mmap") {
+        return &s_mmap_allocator;
+    }
+    if(name != "malloc") {
+        WYZE_LOG_ERROR(g_logger) << "unknown fiber.stack_allocator=" << name << ", use malloc";
+    }
+    return &s_malloc_allocator;
+}
+
+static uint64_t s_stack_size = 0;       //缓存配置值，避免热路径上读配置加锁
+static uint32_t s_pool_max_size = 0;
+static StackAllocator* s_stack_allocator = &s_malloc_allocator;
+
+struct _FiberIniter {
+    _FiberIniter() {
+        s_stack_size = g_fiber_stack_size->getValue();
+        s_pool_max_size = g_fiber_pool_max_size->getValue();
+        s_stack_allocator = GetStackAllocator(g_fiber_stack_allocator->getValue());
+        s_numa_local = g_fiber_stack_numa_local->getValue();
+
+        g_fiber_stack_size->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+            s_stack_size = new_value;
+        });
+        g_fiber_stack_allocator->addListener([](const std::string& old_value, const std::string& new_value) {
+            WYZE_LOG_INFO(g_logger) << "fiber stack allocator changed from "
+                                    << old_value << " to " << new_value;
+            s_stack_allocator = GetStackAllocator(new_value);
+        });
+        g_fiber_stack_numa_local->addListener([](const bool& old_value, const bool& new_value) {
+            s_numa_local = new_value;
+        });
+        g_fiber_pool_max_size->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+            WYZE_LOG_INFO(g_logger) << "fiber pool max size changed from "
+                                    << old_value << " to " << new_value;
+            s_pool_max_size = new_value;
+        });
+    }
+};
+
+static _FiberIniter s_fiber_initer;
+
+//每个线程一个共享执行栈，使用 mmap 分配，只有用到的页占用物理内存
+struct SharedStack {
+    SharedStack() {
+        size = g_fiber_shared_stack_size->getValue();
+        stack = s_mmap_allocator.alloc(size);
+        WYZE_ASSERT2(stack, "alloc shared stack");
+    }
+    ~SharedStack() {
+        s_mmap_allocator.dealloc(stack, size);
+    }
+
+    char* top() const { return (char*)stack + size; }
+
+    void* stack = nullptr;
+    size_t size = 0;
+};
+
+static thread_local std::unique_ptr<SharedStack> t_sharedStack;
+
+static SharedStack* GetSharedStack()
+{
+    if(!t_sharedStack) {
+        t_sharedStack.reset(new SharedStack);
+    }
+    return t_sharedStack.get();
+}
+
+static thread_local std::vector<Fiber::ptr> t_fiberPool;       //当前线程缓存的协程，线程结束时释放
+static thread_local FiberPool::Stats t_poolStats;
 
 Fiber::Fiber()
+    : m_priority(Scheduler::PRIORITY_NORMAL)
 {
     m_state = State::EXEC;  
     SetThis(this);
 
-    if(getcontext(&m_context)){
-        WYZE_ASSERT2(false, "getcontext");
-    }
-
     m_id = s_fiber_id++;
     ++s_fiber_count;
     // WYZE_LOG_DEBUG(g_logger) << "Fiber::Fiber id = " << m_id;
 }  
 
-Fiber::Fiber(std::function<void()> cb, size_t stack_size, bool use_caller)
+Fiber::Fiber(Callable cb, size_t stack_size, bool use_caller, bool shared_stack)
     : m_id(s_fiber_id++)
-    , m_cb(cb)
+    , m_cb(std::move(cb))
     , m_useCaller(use_caller)
+    , m_priority(Scheduler::PRIORITY_NORMAL)
 {
     ++s_fiber_count;
-    m_stacksize = stack_size > (16 * 1024) ? stack_size : g_fiber_stack_size->getValue();
-    m_stack = StackAllocator::Alloc(m_stacksize);
-
-    if(getcontext(&m_context)) {
-        WYZE_ASSERT2(false, "getcontet");
+    if(shared_stack) {
+    #if WYZE_CONTEXT_ASM
+        WYZE_ASSERT2(!use_caller, "shared stack fiber only support swapIn/swapOut");
+        m_sharedStack = true;   //第一次 swapIn 时绑定线程并初始化上下文
+        return;
+    #else
+        static bool s_warned = false;
+        if(!s_warned) {
+            s_warned = true;
+            WYZE_LOG_WARN(g_logger) << "shared stack fiber need WYZE_FIBER_ASM, use private stack";
+        }
+    #endif
     }
 
-    m_context.uc_link = nullptr;
-    m_context.uc_stack.ss_size = m_stacksize;
-    m_context.uc_stack.ss_sp = m_stack;
+    m_stacksize = stack_size > (16 * 1024) ? stack_size : s_stack_size;
+    m_allocator = s_stack_allocator;    //释放时使用同一个分配器，配置修改不影响已有的协程
+    m_stack = m_allocator->alloc(m_stacksize);
+    WYZE_ASSERT2(m_stack, "alloc fiber stack");
+    s_stack_total += m_stacksize;
 
-    makecontext(&m_context, &Fiber::MainFunc, 0);
+    if(!MakeContext(&m_context, m_stack, m_stacksize, &Fiber::MainFunc)) {
+        WYZE_ASSERT2(false, "makecontext");
+    }
     // WYZE_LOG_DEBUG(g_logger) << "Fiber::Fiber id = " << m_id;
 }
 
 Fiber::~Fiber()
 {
     --s_fiber_count;
-    if(m_stack) {
+    clearLocals();      //挂起后被丢弃或异常结束的协程，局部变量在这里销毁
+    if(m_sharedStack) {
+        WYZE_ASSERT( m_state == State::INIT 
+                    || m_state == State::TERM
+                    || m_state == State::EXCEPT );
+        free(m_saved);
+    }
+    else if(m_stack) {
         //子协程
         WYZE_ASSERT( m_state == State::INIT 
                     || m_state == State::TERM
                     || m_state == State::EXCEPT );
-        StackAllocator::Dealloc(m_stack, m_stacksize);
+        m_allocator->dealloc(m_stack, m_stacksize);
+        s_stack_total -= m_stacksize;
     }
     else {
         //main 协程
@@ -92,22 +255,19 @@ Fiber::~Fiber()
 }
 
 //重置携程函数，并且重置状态为 INIT
-void Fiber::reset(std::function<void()> cb)
+void Fiber::reset(Callable cb)
 {
     WYZE_ASSERT(m_stack);
     WYZE_ASSERT( m_state == State::INIT
                     || m_state == State::TERM
                     || m_state == State::EXCEPT);
-    m_cb = cb;
-    if(getcontext(&m_context)) {
-        WYZE_ASSERT2(false, "getcontext");
+    clearLocals();
+    m_cb = std::move(cb);
+    m_priority = Scheduler::PRIORITY_NORMAL;
+    m_id = s_fiber_id++;        //复用的协程当作新的协程，日志中的协程id 不会重复
+    if(!MakeContext(&m_context, m_stack, m_stacksize, &Fiber::MainFunc)) {
+        WYZE_ASSERT2(false, "makecontext");
     }
-
-    m_context.uc_link = nullptr;
-    m_context.uc_stack.ss_size = m_stacksize;
-    m_context.uc_stack.ss_sp = m_stack;
-
-    makecontext(&m_context,&Fiber::MainFunc, 0);
     m_state = State::INIT;
 }
 
@@ -120,7 +280,7 @@ void Fiber::call()
 
     SetThis(this);
     m_state = State::EXEC;
-    if(swapcontext(&t_threadFiber->m_context, &m_context) ) {
+    if(!SwapContext(&t_threadFiber->m_context, &m_context)) {
         WYZE_ASSERT2(false, "swapcontext");
     }
 }
@@ -133,26 +293,81 @@ void Fiber::back()
     if(m_state == State::EXEC)
         m_state = State::READY;
 
-    if(swapcontext(&m_context, &t_threadFiber->m_context)) {
+    if(!SwapContext(&m_context, &t_threadFiber->m_context)) {
         WYZE_ASSERT2(false, "swapcontext");
     }
 }
 
 //切换到当前携程执行
-void Fiber::swapIn()
+Fiber::State Fiber::swapIn()
 {
     WYZE_ASSERT(m_state != State::EXEC);
     WYZE_ASSERT2(Scheduler::GetMainFiber() != nullptr, "make sure Scheduler init befor use Fiber::swapIn");
-    if(m_state == State::TERM || m_state == State::EXCEPT)
-        return;
+    State state = m_state;
+    if(state == State::TERM || state == State::EXCEPT)
+        return state;
 
     SetThis(this);
     
     m_state = State::EXEC;
+    if(m_sharedStack) {
+        restoreStack();
+    }
 
-    if(swapcontext(&Scheduler::GetMainFiber()->m_context, &m_context)) {
+    if(!SwapContext(&Scheduler::GetMainFiber()->m_context, &m_context)) {
         WYZE_ASSERT2(false, "swapcontext");
     }
+
+    if(m_sharedStack) {
+        saveStack();
+    }
+
+    //YeildToHold 不会在切出前设置 HOLD，切回调度协程后再设置，
+    //避免其他线程在协程还没有真正切出时就把它 swapIn。设置 HOLD 之前读取状态，之后状态属于恢复它的线程
+    state = m_state;
+    if(state == State::EXEC) {
+        state = State::HOLD;
+        m_state = State::HOLD;
+    }
+    return state;
+}
+
+void Fiber::restoreStack()
+{
+    SharedStack* ss = GetSharedStack();
+    if(m_homeThread == -1) {
+        m_homeThread = GetThreadId();
+        m_stacksize = ss->size;
+        if(!MakeContext(&m_context, ss->stack, ss->size, &Fiber::MainFunc)) {
+            WYZE_ASSERT2(false, "makecontext");
+        }
+        return;
+    }
+
+    WYZE_ASSERT2(m_homeThread == GetThreadId(), "shared stack fiber resumed on other thread");
+    memcpy(ss->top() - m_savedSize, m_saved, m_savedSize);
+}
+
+void Fiber::saveStack()
+{
+    if(m_state == State::TERM || m_state == State::EXCEPT) {
+        free(m_saved);
+        m_saved = nullptr;
+        m_savedSize = m_savedCap = 0;
+        return;
+    }
+
+#if WYZE_CONTEXT_ASM
+    //切出时寄存器保存在栈上，sp 到栈顶就是需要保存的部分
+    SharedStack* ss = GetSharedStack();
+    m_savedSize = ss->top() - (char*)m_context.sp;
+    if(m_savedSize > m_savedCap) {
+        m_savedCap = (m_savedSize + 1023) / 1024 * 1024;
+        m_saved = (char*)realloc(m_saved, m_savedCap);
+        WYZE_ASSERT2(m_saved, "realloc shared stack buffer");
+    }
+    memcpy(m_saved, m_context.sp, m_savedSize);
+#endif
 }
 
 //切换到后台执行
@@ -161,7 +376,7 @@ void Fiber::swapOut()
     WYZE_ASSERT2(Scheduler::GetMainFiber() != nullptr, "Fiber::swapIn Fiber::swapOut is pair");
     SetThis(t_threadFiber.get());
 
-    if(swapcontext(&m_context, &Scheduler::GetMainFiber()->m_context)){
+    if(!SwapContext(&m_context, &Scheduler::GetMainFiber()->m_context)) {
         WYZE_ASSERT2(false,"swapcontext");
     }
 
@@ -186,6 +401,53 @@ Fiber::ptr Fiber::GetThis()
     return t_fiber->shared_from_this();
 }
 
+Fiber* Fiber::GetCurrent()
+{
+    if(!t_fiber) {
+        GetThis();
+    }
+    return t_fiber;
+}
+
+static std::atomic<size_t> s_local_slot {0};
+
+size_t Fiber::AllocLocalSlot()
+{
+    return s_local_slot++;
+}
+
+void Fiber::setLocal(size_t slot, void* value, void (*destroy)(void*))
+{
+    if(slot >= m_locals.size()) {
+        if(!value) {
+            return;
+        }
+        m_locals.resize(slot + 1);
+    }
+    LocalValue old = m_locals[slot];
+    m_locals[slot].value = value;
+    m_locals[slot].destroy = destroy;
+    m_localCount += (value != nullptr) - (old.value != nullptr);
+    if(old.value) {
+        old.destroy(old.value);
+    }
+}
+
+void Fiber::clearLocals()
+{
+    //析构函数中可能再设置局部变量，按下标遍历直到全部清空
+    while(m_localCount) {
+        for(size_t i = 0; i < m_locals.size(); ++i) {
+            if(m_locals[i].value) {
+                LocalValue old = m_locals[i];
+                m_locals[i].value = nullptr;
+                --m_localCount;
+                old.destroy(old.value);
+            }
+        }
+    }
+}
+
 //当前协程切换到后台，并设置状态为READY
 void Fiber::YeildToReady()
 {
@@ -198,8 +460,14 @@ void Fiber::YeildToReady()
 void Fiber::YeildToHold()
 {
     Fiber::ptr cur = GetThis();
-    cur->m_state = State::HOLD;
-    cur->swapOut();
+    WYZE_ASSERT(cur->m_state == State::EXEC);
+    cur->swapOut();     //状态在 swapIn 返回后设置为 HOLD
+}
+
+bool Fiber::InScheduledFiber()
+{
+    return t_fiber && t_fiber != t_threadFiber.get()
+        && Scheduler::GetThis() && t_fiber != Scheduler::GetMainFiber();
 }
 
 uint64_t Fiber::TotalFibers()
@@ -207,6 +475,40 @@ uint64_t Fiber::TotalFibers()
     return s_fiber_count;
 }
 
+uint64_t Fiber::TotalStackSize()
+{
+    return s_stack_total;
+}
+
+size_t Fiber::getStackResident() const
+{
+    if(m_sharedStack) {
+        return m_savedCap;
+    }
+    if(!m_stack) {
+        return 0;
+    }
+
+    size_t page = MmapStackAllocator::PageSize();
+    uintptr_t begin = (uintptr_t)m_stack / page * page;
+    uintptr_t end = (uintptr_t)m_stack + m_stacksize;
+    size_t pages = (end - begin + page - 1) / page;
+    std::vector<unsigned char> vec(pages);
+    if(mincore((void*)begin, end - begin, &vec[0])) {
+        WYZE_LOG_ERROR(g_logger) << "mincore fiber_id=" << m_id
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return 0;
+    }
+
+    size_t resident = 0;
+    for(auto& i : vec) {
+        if(i & 1) {
+            ++resident;
+        }
+    }
+    return resident * page;
+}
+
 uint64_t Fiber::GetFiberId()
 {
     if(t_fiber) {
@@ -223,6 +525,7 @@ void Fiber::MainFunc()
     try{
         cur->m_cb();
         cur->m_cb = nullptr;
+        cur->clearLocals();     //在协程自己的上下文中销毁，析构函数中可以访问其他局部变量
         cur->m_state = State::TERM;
     }
     catch(std::exception& ex) {
@@ -252,4 +555,62 @@ void Fiber::MainFunc()
     WYZE_ASSERT2(false,"never reach");
 }
 
-}
\ No newline at end of file
+Fiber::ptr FiberPool::Get(Callable cb)
+{
+    if(!t_fiberPool.empty()) {
+        Fiber::ptr fiber;
+        fiber.swap(t_fiberPool.back());
+        t_fiberPool.pop_back();
+        t_poolStats.size = t_fiberPool.size();
+        ++t_poolStats.hits;
+
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+
+    ++t_poolStats.misses;
+    return Fiber::ptr(new Fiber(std::move(cb)));
+}
+
+bool FiberPool::Put(Fiber::ptr& fiber)
+{
+    if(!fiber || !fiber.unique()
+            || !fiber->m_stack
+            || fiber->m_useCaller
+            || (fiber->m_state != Fiber::TERM && fiber->m_state != Fiber::EXCEPT)) {
+        return false;
+    }
+
+    if(fiber->m_stacksize != s_stack_size) {    //栈大小不是默认值，或者配置已经修改
+        ++t_poolStats.drops;
+        return false;
+    }
+
+    if(t_fiberPool.size() >= s_pool_max_size) {
+        ++t_poolStats.drops;
+        return false;
+    }
+
+    fiber->m_cb = nullptr;      //异常退出的协程还持有回调，提前释放回调捕获的资源
+    fiber->clearLocals();
+    t_fiberPool.push_back(nullptr);
+    t_fiberPool.back().swap(fiber);
+    t_poolStats.size = t_fiberPool.size();
+    if(t_poolStats.size > t_poolStats.highWater) {
+        t_poolStats.highWater = t_poolStats.size;
+    }
+    return true;
+}
+
+FiberPool::Stats FiberPool::GetStats()
+{
+    return t_poolStats;
+}
+
+void FiberPool::Clear()
+{
+    t_fiberPool.clear();
+    t_poolStats.size = 0;
+}
+
+}
@@ -2,16 +2,22 @@
 #define _WYZE_FIBER_H_
 
 #include <memory>
-#include <ucontext.h>
+#include <atomic>
+#include "context.h"
+#include "callable.h"
 #include <functional>
+#include <vector>
 #include <stdint.h>
 
 namespace wyze {
 
 class Scheduler;
+class FiberPool;
+class StackAllocator;
 
 class Fiber : public std::enable_shared_from_this<Fiber> {
 friend class Scheduler;
+friend class FiberPool;
 public:
     using ptr = std::shared_ptr<Fiber>;
 
@@ -24,13 +30,16 @@ public:
         EXCEPT
     };
 
-    Fiber(std::function<void()> f, size_t stack_size = 0, bool use_caller = false);
+    //shared_stack 为 true 时，协程运行在线程共享的执行栈上，切出时只把用到的部分拷贝出来，
+    //第一次运行后只能在该线程上恢复；协程栈上变量的地址不能交给其他协程使用
+    Fiber(Callable f, size_t stack_size = 0, bool use_caller = false, bool shared_stack = false);
     ~Fiber();
 
-    //重置携程函数，并且重置状态为 INIT
-    void reset(std::function<void()> cb);
-    //从调度协程切换到当前协程
-    void swapIn();
+    //重置携程函数，并且重置状态为 INIT，会分配新的协程id
+    void reset(Callable cb);
+    //从调度协程切换到当前协程，返回切回时协程的状态。让出到 HOLD 的协程切回后可能马上被其他线程恢复，
+    //调用者应该使用返回值，不能再读取 getState()
+    State swapIn();
     // //从当前协程切换到调度协程
     // void swapOut();
     //从主协程切换到当前协程
@@ -40,6 +49,13 @@ public:
 
     uint64_t getId() const { return m_id; }
     State getState() const { return m_state;}
+    bool isSharedStack() const { return m_sharedStack; }
+    //共享栈协程绑定的线程id，没有绑定返回 -1
+    int getHomeThread() const { return m_homeThread; }
+    //调度优先级(Scheduler::Priority)，调度器执行前设置，让出或被 IO 事件唤醒后再次调度时沿用
+    int getPriority() const { return m_priority; }
+    //协程栈实际占用的物理内存(字节)，通过 mincore 统计
+    size_t getStackResident() const;
 
     //设置当前协程
     static void SetThis(Fiber* f);
@@ -50,26 +66,80 @@ public:
     // 当前协程切换到后台，并设置状态为HOLD
     static void YeildToHold();
     static uint64_t TotalFibers();
+    //所有协程栈申请的大小(字节)，mmap 分配器下为虚拟内存
+    static uint64_t TotalStackSize();
     static void MainFunc();
     static uint64_t GetFiberId();
+    //当前是否运行在调度器调度的协程中（不是线程主协程和调度协程），只有这时才能挂起等待
+    static bool InScheduledFiber();
+    //返回当前协程的裸指针，不增加引用计数，没有协程时创建线程主协程
+    static Fiber* GetCurrent();
+
+    //协程局部存储，由 FiberLocal 使用。每个 FiberLocal 占用一个全局槽位，按下标直接访问
+    static size_t AllocLocalSlot();
+    void* getLocal(size_t slot) const {
+        return slot < m_locals.size() ? m_locals[slot].value : nullptr;
+    }
+    //替换槽位中的值，旧值用它自己的 destroy 销毁
+    void setLocal(size_t slot, void* value, void (*destroy)(void*));
+    //销毁所有局部变量，协程正常结束、reset、放入缓存和析构时调用
+    void clearLocals();
 
 private:
     Fiber();        //在没有协程时，线程获取自己的协程所使用
     //从当前协程切换到调度协程
     void swapOut();
+    //共享栈协程：切入前把保存的栈内容拷贝回共享栈
+    void restoreStack();
+    //共享栈协程：切出后把共享栈上用到的部分保存下来
+    void saveStack();
 
 
 private:
     uint64_t m_id = 0;
     uint32_t m_stacksize = 0;
     void* m_stack = nullptr;
-    State m_state = State::INIT;
-    ucontext_t m_context;
-    std::function<void()> m_cb;
+    StackAllocator* m_allocator = nullptr;  //分配栈使用的分配器
+    std::atomic<State> m_state = {State::INIT};     //其他线程会读取该状态，判断协程是否已经切出
+    FiberContext m_context;
+    Callable m_cb;
     bool m_useCaller = false;
+    bool m_sharedStack = false;             //是否运行在线程共享栈上
+    int m_homeThread = -1;                  //共享栈协程绑定的线程
+    int m_priority;                         //构造和 reset 时设置为 Scheduler::PRIORITY_NORMAL
+    char* m_saved = nullptr;                //切出时保存的栈内容
+    size_t m_savedSize = 0;
+    size_t m_savedCap = 0;
+
+    struct LocalValue {
+        void* value = nullptr;
+        void (*destroy)(void*) = nullptr;
+    };
+    std::vector<LocalValue> m_locals;       //按槽位下标保存的协程局部变量
+    size_t m_localCount = 0;                //非空槽位数，为 0 时结束协程不需要遍历
 
 };
 
+//每个线程缓存已经结束的协程，复用协程对象和栈，避免每个任务都分配一次栈
+class FiberPool {
+public:
+    struct Stats {
+        uint64_t hits = 0;          //从缓存中复用的次数
+        uint64_t misses = 0;        //缓存为空，新建协程的次数
+        uint64_t drops = 0;         //缓存已满或者不能复用而释放的次数
+        size_t size = 0;            //当前缓存的协程数
+        size_t highWater = 0;       //缓存协程数的最高值
+    };
+
+    //获取一个执行 cb 的协程，优先复用当前线程缓存的协程
+    static Fiber::ptr Get(Callable cb);
+    //归还已经结束的协程，成功放入缓存后 fiber 会被置空
+    static bool Put(Fiber::ptr& fiber);
+    //当前线程的统计
+    static Stats GetStats();
+    //释放当前线程缓存的协程
+    static void Clear();
+};
 
 }
 
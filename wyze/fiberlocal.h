@@ -0,0 +1,63 @@
+#ifndef _WYZE_FIBERLOCAL_H_
+#define _WYZE_FIBERLOCAL_H_
+
+#include <utility>
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace wyze {
+
+    //协程局部变量，每个协程各自一份，协程在调度线程间迁移时跟着协程走，适合保存 trace id、
+    //认证信息、截止时间等请求上下文。第一次 get 时默认构造，协程结束、reset 或析构时销毁；
+    //不在协程中使用时属于线程主协程。槽位不会回收，通常定义成静态变量
+    template<class T>
+    class FiberLocal : Noncopyable {
+    public:
+        FiberLocal() : m_slot(Fiber::AllocLocalSlot()) { }
+
+        T& get() {
+            Fiber* fiber = Fiber::GetCurrent();
+            void* p = fiber->getLocal(m_slot);
+            if(!p) {
+                p = new T();
+                fiber->setLocal(m_slot, p, &Destroy);
+            }
+            return *static_cast<T*>(p);
+        }
+
+        //当前协程没有设置时返回 nullptr
+        T* tryGet() const {
+            return static_cast<T*>(Fiber::GetCurrent()->getLocal(m_slot));
+        }
+
+        void set(T value) {
+            Fiber* fiber = Fiber::GetCurrent();
+            T* p = static_cast<T*>(fiber->getLocal(m_slot));
+            if(p) {
+                *p = std::move(value);
+            }
+            else {
+                fiber->setLocal(m_slot, new T(std::move(value)), &Destroy);
+            }
+        }
+
+        //销毁当前协程中的值
+        void reset() {
+            Fiber::GetCurrent()->setLocal(m_slot, nullptr, nullptr);
+        }
+
+        T& operator*() { return get(); }
+        T* operator->() { return &get(); }
+
+    private:
+        static void Destroy(void* p) {
+            delete static_cast<T*>(p);
+        }
+
+    private:
+        size_t m_slot;
+    };
+
+}
+
+#endif // !_WYZE_FIBERLOCAL_H_
@@ -0,0 +1,171 @@
+#include "fibersync.h"
+#include "macro.h"
+
+namespace wyze {
+
+    //记录当前协程后释放内部锁，再切出。
+    //唤醒方可能在协程真正切出前就 schedule，调度器会等协程切出后再执行它
+    static void Park(std::deque<FiberWaiter>& waiters, SpinLock::Lock& lock)
+    {
+        FiberWaiter waiter;
+        waiter.scheduler = Scheduler::GetThis();
+        WYZE_ASSERT2(waiter.scheduler, "fiber sync wait outside scheduler");
+        waiter.fiber = Fiber::GetThis();
+        WYZE_ASSERT2(waiter.fiber.get() != Scheduler::GetMainFiber(), "fiber sync wait in scheduler fiber");
+        waiters.push_back(std::move(waiter));
+        lock.unlock();
+        Fiber::YeildToHold();
+    }
+
+    void FiberWaiter::wake()
+    {
+        scheduler->schedule(&fiber);
+        scheduler = nullptr;
+    }
+
+    FiberMutex::~FiberMutex()
+    {
+        WYZE_ASSERT(!m_locked && m_waiters.empty());
+    }
+
+    void FiberMutex::lock()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(!m_locked) {
+            m_locked = true;
+            return;
+        }
+        Park(m_waiters, lock);      //被唤醒时锁已经交给自己
+    }
+
+    bool FiberMutex::tryLock()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_locked) {
+            return false;
+        }
+        m_locked = true;
+        return true;
+    }
+
+    void FiberMutex::unlock()
+    {
+        SpinLock::Lock lock(m_mutex);
+        WYZE_ASSERT(m_locked);
+        if(m_waiters.empty()) {
+            m_locked = false;
+            return;
+        }
+
+        FiberWaiter waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        lock.unlock();
+        waiter.wake();
+    }
+
+    FiberConditionVariable::~FiberConditionVariable()
+    {
+        WYZE_ASSERT(m_waiters.empty());
+    }
+
+    void FiberConditionVariable::wait(FiberMutex::Lock& lock)
+    {
+        SpinLock::Lock slock(m_mutex);
+        lock.unlock();      //先进入等待队列再释放锁，notify 不会丢失
+        Park(m_waiters, slock);
+        lock.lock();
+    }
+
+    void FiberConditionVariable::notifyOne()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_waiters.empty()) {
+            return;
+        }
+        FiberWaiter waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        lock.unlock();
+        waiter.wake();
+    }
+
+    void FiberConditionVariable::notifyAll()
+    {
+        std::deque<FiberWaiter> waiters;
+        {
+            SpinLock::Lock lock(m_mutex);
+            waiters.swap(m_waiters);
+        }
+        for(auto& i : waiters) {
+            i.wake();
+        }
+    }
+
+    FiberSemaphore::~FiberSemaphore()
+    {
+        WYZE_ASSERT(m_waiters.empty());
+    }
+
+    void FiberSemaphore::wait()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_count > 0) {
+            --m_count;
+            return;
+        }
+        Park(m_waiters, lock);
+    }
+
+    bool FiberSemaphore::tryWait()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_count == 0) {
+            return false;
+        }
+        --m_count;
+        return true;
+    }
+
+    void FiberSemaphore::notify()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_waiters.empty()) {
+            ++m_count;
+            return;
+        }
+        FiberWaiter waiter = std::move(m_waiters.front());
+        m_waiters.pop_front();
+        lock.unlock();
+        waiter.wake();
+    }
+
+    WaitGroup::~WaitGroup()
+    {
+        WYZE_ASSERT(m_waiters.empty());
+    }
+
+    void WaitGroup::add(int64_t delta)
+    {
+        std::deque<FiberWaiter> waiters;
+        {
+            SpinLock::Lock lock(m_mutex);
+            m_count += delta;
+            WYZE_ASSERT2(m_count >= 0, "WaitGroup negative counter");
+            if(m_count == 0) {
+                waiters.swap(m_waiters);
+            }
+        }
+        for(auto& i : waiters) {
+            i.wake();
+        }
+    }
+
+    void WaitGroup::wait()
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_count == 0) {
+            return;
+        }
+        Park(m_waiters, lock);
+    }
+
+}
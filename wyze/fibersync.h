@@ -0,0 +1,90 @@
+#ifndef _WYZE_FIBERSYNC_H_
+#define _WYZE_FIBERSYNC_H_
+
+#include <memory>
+#include <deque>
+#include "thread.h"
+#include "fiber.h"
+#include "scheduler.h"
+
+namespace wyze {
+
+    //协程级别的同步原语：等待时只挂起当前协程，释放时通过 Scheduler::schedule 放回调度，
+    //不会阻塞调度线程。只能在调度器中运行的协程里等待，唤醒可以在任意线程
+    struct FiberWaiter {
+        Scheduler* scheduler = nullptr;     //等待协程所在的调度器
+        Fiber::ptr fiber;                   //等待的协程
+
+        void wake();                        //放回调度器
+    };
+
+    class FiberMutex : Noncopyable {
+    public:
+        using Lock = ScopeLockImpl<FiberMutex>;
+
+        FiberMutex() {}
+        ~FiberMutex();
+
+        void lock();
+        bool tryLock();
+        void unlock();      //有等待者时直接把锁交给第一个等待的协程
+
+    private:
+        SpinLock m_mutex;                   //保护下面的成员，临界区很短
+        bool m_locked = false;
+        std::deque<FiberWaiter> m_waiters;
+    };
+
+    class FiberConditionVariable : Noncopyable {
+    public:
+        FiberConditionVariable() {}
+        ~FiberConditionVariable();
+
+        void wait(FiberMutex::Lock& lock);  //释放锁并挂起，被唤醒后重新加锁
+        void notifyOne();
+        void notifyAll();
+
+    private:
+        SpinLock m_mutex;
+        std::deque<FiberWaiter> m_waiters;
+    };
+
+    class FiberSemaphore : Noncopyable {
+    public:
+        FiberSemaphore(uint32_t count = 0)
+            : m_count(count) { }
+        ~FiberSemaphore();
+
+        void wait();
+        bool tryWait();
+        void notify();      //有等待者时直接把信号量交给第一个等待的协程
+
+        uint32_t getCount() const { return m_count; }
+
+    private:
+        SpinLock m_mutex;
+        uint32_t m_count;
+        std::deque<FiberWaiter> m_waiters;
+    };
+
+    //等待一组任务完成，add 增加计数，done 减少计数，计数为 0 时唤醒所有 wait 的协程
+    class WaitGroup : Noncopyable {
+    public:
+        WaitGroup() {}
+        ~WaitGroup();
+
+        void add(int64_t delta = 1);
+        void done() { add(-1); }
+        void wait();
+
+        int64_t getCount() const { return m_count; }
+
+    private:
+        SpinLock m_mutex;
+        int64_t m_count = 0;
+        std::deque<FiberWaiter> m_waiters;
+    };
+
+}
+
+#endif // !_WYZE_FIBERSYNC_H_
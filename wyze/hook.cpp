@@ -3,11 +3,13 @@
 #include "fiber.h"
 #include "iomanager.h"
 #include "fdmanager.h"
+#include "cancel.h"
 #include "config.h"
 #include "macro.h"
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <linux/io_uring.h>
 
 wyze::Logger::ptr g_logger = WYZE_LOG_NAME("system");
 
@@ -83,13 +85,65 @@ namespace wyze {
     }
 
     struct TimerCond {      //hook fd 时， 添加定时器，触发时的条件，
-        int cancelled = 0;  // 当该变量不存在则不会触发定时器(也就是说数据在定时器来之前触发)
+        std::atomic<int> cancelled = {0};  // 当该变量不存在则不会触发定时器(也就是说数据在定时器来之前触发)
+
+        bool set(int err) { //超时和取消令牌可能同时触发，只有第一个生效
+            int expected = 0;
+            return cancelled.compare_exchange_strong(expected, err);
+        }
     };
 
-    //模板类，如何 hook 非阻塞fd ，使之让用户 同步使用
+    //等待 fd 事件期间挂在当前协程令牌上的回调：取消时唤醒协程，返回回调 id
+    static uint64_t add_cancel_callback(const CancelToken::ptr& token, std::weak_ptr<TimerCond> wtcnd
+                                        , int fd, IOManager* iom, uint32_t event)
+    {
+        return token->addCallback([wtcnd, fd, iom, event]() {
+            auto t = wtcnd.lock();
+            if(t && t->set(ECANCELED)) {
+                iom->canceEvent(fd, (IOManager::Event)(event));
+            }
+        });
+    }
+
+    //hook 的 sleep 系列：定时器到期或者当前协程的令牌取消时恢复，返回是否被取消
+    static bool sleep_for(uint64_t ms)
+    {
+        Fiber::ptr fiber = Fiber::GetThis();
+        IOManager* iom = IOManager::GetThis();
+        CancelToken::ptr token = CancelToken::GetCurrent();
+        if(!token) {
+            //创建一个定时器，定时到，将当前协程加入协程调度中
+            iom->addTimer(ms, std::bind((void(Scheduler::*)(Fiber::ptr, int thread, Scheduler::Priority)) //这里表示的是一个函数类型
+                                            &IOManager::schedule, iom, fiber, -1, Scheduler::PRIORITY_INHERIT));
+            Fiber::YeildToHold();
+            return false;
+        }
+        if(token->isCancelled()) {
+            return true;
+        }
+
+        std::shared_ptr<TimerCond> tcnd(new TimerCond);
+        Timer::ptr timer = iom->addTimer(ms, [tcnd, fiber, iom]() {
+            if(tcnd->set(ETIMEDOUT)) {
+                iom->schedule(fiber);
+            }
+        });
+        uint64_t cancel_id = token->addCallback([tcnd, fiber, iom]() {
+            if(tcnd->set(ECANCELED)) {
+                iom->schedule(fiber);
+            }
+        });
+        Fiber::YeildToHold();
+        timer->cancel();
+        token->removeCallback(cancel_id);
+        return tcnd->cancelled == ECANCELED;
+    }
+
+    //模板类，如何 hook 非阻塞fd ，使之让用户 同步使用。
+    //req 不为空且 IOManager 使用 io_uring 时，EAGAIN 后把同样的操作提交给 io_uring，完成结果直接返回
     template<typename OriginFun, typename ... Args>
     static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
-                            uint32_t event, int timeout_so, Args&& ... args) 
+                            uint32_t event, int timeout_so, const IOManager::UringRequest* req, Args&& ... args) 
     {
         if( !t_hook_enable ) 
             return fun(fd, std::forward<Args>(args)...);
@@ -121,19 +175,34 @@ namespace wyze {
             if( n == -1 && errno == EAGAIN ) {  //如果是 -1 且 errno 提示重试，则进入阻塞
 
                 IOManager* iom = IOManager::GetThis();
+                CancelToken::ptr token = CancelToken::GetCurrent();
+                if(token && token->isCancelled()) {
+                    errno = ECANCELED;
+                    return -1;
+                }
 
+                if(req && iom->canUseUring()) {
+                    int res = iom->uringWait(*req, ms == 0 ? (uint64_t)-1 : ms);
+                    if(res != -EAGAIN) {
+                        if(res < 0) {
+                            errno = -res;
+                            return -1;
+                        }
+                        return res;
+                    }
+                    //内核没有等待而是直接返回 EAGAIN，这一次退回 epoll 等待就绪
+                }
 
                 std::shared_ptr<TimerCond> tcnd(new TimerCond);
                 std::weak_ptr<TimerCond> wtcnd(tcnd);
                 Timer::ptr timer;
 
-                if(ms != (uint64_t)0 ) {    //在挂起之前检测有没有定时
+                if(ms != (uint64_t)-1 && ms != 0) {   //在挂起之前检测有没有定时，-1 和 0 都表示不超时
 
                     timer = iom->addConditionTimer(ms, [wtcnd, fd, iom, event]() {
                         auto t = wtcnd.lock();
-                        if( !t || t->cancelled) //当指针不存在，获取指针里面设置为取消，直接返回
+                        if( !t || !t->set(ETIMEDOUT)) //当指针不存在，或者已经被取消，直接返回
                             return ;
-                        t->cancelled = ETIMEDOUT;
                         iom->canceEvent(fd, (IOManager::Event)(event)); //唤醒协程
                     }, wtcnd);
                 }
@@ -145,11 +214,14 @@ namespace wyze {
                     return -1;
                 }
                 else {
+                    uint64_t cancel_id = token ? add_cancel_callback(token, wtcnd, fd, iom, event) : 0;
 
                     Fiber::YeildToHold();       //挂起
                                                 //这里开始，表示定时器，获取添加的fd事件触发
                     if(timer)
                         timer->cancel();
+                    if(token)
+                        token->removeCallback(cancel_id);
 
                     if(tcnd->cancelled) {       //如果该值不为0 表示超时触发
                         errno = tcnd->cancelled;
@@ -180,13 +252,13 @@ extern "C" {
     {
         if( !wyze::t_hook_enable ) 
             return sleep_f(seconds);
-        
-        wyze::Fiber::ptr fiber = wyze::Fiber::GetThis();
-        wyze::IOManager* iom = wyze::IOManager::GetThis();
-        //创建一个定时器，定时到，将当前协程加入协程调度中
-        iom->addTimer(seconds * 1000, std::bind((void(wyze::Scheduler::*)(wyze::Fiber::ptr, int thread)) //这里表示的是一个函数类型
-                                                &wyze::IOManager::schedule, iom, fiber, -1));
-        wyze::Fiber::YeildToHold();
+
+        uint64_t start = wyze::GetCurrentMS();
+        if(wyze::sleep_for(seconds * 1000ull)) {
+            errno = ECANCELED;
+            uint64_t slept = (wyze::GetCurrentMS() - start) / 1000;
+            return slept < seconds ? seconds - slept : 0;   //没有睡完的秒数
+        }
         return 0;
     }
 
@@ -195,25 +267,30 @@ extern "C" {
         if( !wyze::t_hook_enable ) 
             return usleep_f(usec);
 
-        wyze::Fiber::ptr fiber = wyze::Fiber::GetThis();
-        wyze::IOManager* iom = wyze::IOManager::GetThis();
-        iom->addTimer(usec / 1000, std::bind( (void(wyze::Scheduler::*)(wyze::Fiber::ptr, int thread))
-                                                &wyze::IOManager::schedule, iom, fiber, -1));
-        wyze::Fiber::YeildToHold();
+        if(wyze::sleep_for(usec / 1000)) {
+            errno = ECANCELED;
+            return -1;
+        }
         return 0;
     }
 
     int nanosleep(const struct timespec *req, struct timespec* rem)
     {
         if(!wyze::t_hook_enable)
-            return nanosleep(req, rem);
-
-        int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
-        wyze::Fiber::ptr fiber = wyze::Fiber::GetThis();
-        wyze::IOManager* iom = wyze::IOManager::GetThis();
-        iom->addTimer(timeout_ms, std::bind((void(wyze::Scheduler::*)(wyze::Fiber::ptr, int))
-                                                &wyze::IOManager::schedule, iom, fiber, -1));
-        wyze::Fiber::YeildToHold();
+            return nanosleep_f(req, rem);
+
+        uint64_t timeout_ms = req->tv_sec * 1000ull + req->tv_nsec / 1000 / 1000;
+        uint64_t start = wyze::GetCurrentMS();
+        if(wyze::sleep_for(timeout_ms)) {
+            if(rem) {
+                uint64_t slept = wyze::GetCurrentMS() - start;
+                uint64_t left = slept < timeout_ms ? timeout_ms - slept : 0;
+                rem->tv_sec = left / 1000;
+                rem->tv_nsec = left % 1000 * 1000 * 1000;
+            }
+            errno = ECANCELED;
+            return -1;
+        }
         return 0;
     }
 
@@ -244,14 +321,32 @@ extern "C" {
         if( !ctx->isSocket() || ctx->getUserNonblock() )    //用户使用非阻塞，外部会处理
             return connect_f(fd, addr, addrlen);
 
-        int n = connect_f(fd, addr, addrlen);
-        if(n == 0)          //返回 表示错误
-            return 0;
-        else if( n != -1 || errno != EINPROGRESS)
-            return n;
+        wyze::IOManager* iom = wyze::IOManager::GetThis();
+        if(iom && iom->canUseUring()) {     //连接本身提交给 io_uring，完成时就是连接结果
+            wyze::IOManager::UringRequest req(IORING_OP_CONNECT, fd, addr, 0, addrlen);
+            int res = iom->uringWait(req, timeout_ms);
+            if(res == 0)
+                return 0;
+            if(res != -EINPROGRESS && res != -EAGAIN) {
+                errno = -res;
+                return -1;
+            }
+            //内核按非阻塞返回时，连接已经发起，退回 epoll 等待可写
+        }
+        else {
+            int n = connect_f(fd, addr, addrlen);
+            if(n == 0)          //返回 表示错误
+                return 0;
+            else if( n != -1 || errno != EINPROGRESS)
+                return n;
+        }
 
         //这里处理 返回 -1 且错误码为 EINPROGRESS 的情况
-        wyze::IOManager* iom = wyze::IOManager::GetThis();
+        wyze::CancelToken::ptr token = wyze::CancelToken::GetCurrent();
+        if(token && token->isCancelled()) {
+            errno = ECANCELED;
+            return -1;
+        }
 
         int rt = iom->addEvent(fd, wyze::IOManager::WRITE);     //检测可写表示真正的连接成功
         if(rt) {
@@ -266,17 +361,19 @@ extern "C" {
             if(timeout_ms != (uint64_t)-1) {
                 timer = iom->addConditionTimer(timeout_ms, [wtcnd, fd, iom](){
                     auto t = wtcnd.lock();
-                    if(!t || t->cancelled)
+                    if(!t || !t->set(ETIMEDOUT))
                         return;
-                    t->cancelled = ETIMEDOUT;
                     iom->canceEvent(fd, wyze::IOManager::WRITE);
                 }, wtcnd);
             }
+            uint64_t cancel_id = token ? wyze::add_cancel_callback(token, wtcnd, fd, iom, wyze::IOManager::WRITE) : 0;
 
             wyze::Fiber::YeildToHold();
                                             //这里表示触发
             if(timer)
                 timer->cancel();
+            if(token)
+                token->removeCallback(cancel_id);
             
             if(tcnd->cancelled) {           //超时唤醒，直接返回
                 errno = tcnd->cancelled;
@@ -307,8 +404,9 @@ extern "C" {
 
     int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)addrlen);
         int fd = wyze::do_io(sockfd, accept_f, "accept", wyze::IOManager::READ 
-                                ,SO_RCVTIMEO, addr, addrlen);
+                                ,SO_RCVTIMEO, &req, addr, addrlen);
         if(fd >= 0) 
             wyze::FdMgr::GetInstance()->get(fd, true);
         
@@ -335,63 +433,71 @@ extern "C" {
     //read
     ssize_t read(int fd, void *buf, size_t count)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_READ, fd, buf, count, (uint64_t)-1);
         return wyze::do_io(fd, read_f, "read", wyze::IOManager::READ
-                                , SO_RCVTIMEO, buf, count);
+                                , SO_RCVTIMEO, &req, buf, count);
     }
 
     ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_READV, fd, iov, iovcnt, (uint64_t)-1);
         return wyze::do_io(fd, readv_f, "readv", wyze::IOManager::READ
-                                , SO_RCVTIMEO, iov, iovcnt);
+                                , SO_RCVTIMEO, &req, iov, iovcnt);
     }
 
     ssize_t recv(int sockfd, void *buf, size_t len, int flags)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_RECV, sockfd, buf, len, 0, flags);
         return wyze::do_io(sockfd, recv_f, "recv", wyze::IOManager::READ
-                                , SO_RCVTIMEO, buf, len, flags);
+                                , SO_RCVTIMEO, &req, buf, len, flags);
     }
 
     ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
     {
         return wyze::do_io(sockfd, recvfrom_f, "recvfrom", wyze::IOManager::READ
-                                , SO_RCVTIMEO, buf, len,  flags, src_addr, addrlen);
+                                , SO_RCVTIMEO, nullptr, buf, len,  flags, src_addr, addrlen);
     }
 
     ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_RECVMSG, sockfd, msg, 1, 0, flags);
         return wyze::do_io(sockfd, recvmsg_f, "recvmsg", wyze::IOManager::READ
-                                , SO_RCVTIMEO, msg, flags);
+                                , SO_RCVTIMEO, &req, msg, flags);
     }
 
     // write
     ssize_t write(int fd, const void *buf, size_t count)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_WRITE, fd, buf, count, (uint64_t)-1);
         return wyze::do_io(fd, write_f, "write", wyze::IOManager::WRITE
-                                , SO_SNDTIMEO, buf, count);
+                                , SO_SNDTIMEO, &req, buf, count);
     }
 
     ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_WRITEV, fd, iov, iovcnt, (uint64_t)-1);
         return wyze::do_io(fd, writev_f, "writev", wyze::IOManager::WRITE
-                                , SO_SNDTIMEO, iov, iovcnt);
+                                , SO_SNDTIMEO, &req, iov, iovcnt);
     }
 
     ssize_t send(int sockfd, const void *buf, size_t len, int flags)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_SEND, sockfd, buf, len, 0, flags);
         return wyze::do_io(sockfd, send_f, "send", wyze::IOManager::WRITE
-                                , SO_SNDTIMEO, buf, len, flags);
+                                , SO_SNDTIMEO, &req, buf, len, flags);
     }
 
     ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen)
     {
         return wyze::do_io(sockfd, sendto_f, "sendto", wyze::IOManager::WRITE
-                                , SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
+                                , SO_SNDTIMEO, nullptr, buf, len, flags, dest_addr, addrlen);
     }
 
     ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
     {
+        wyze::IOManager::UringRequest req(IORING_OP_SENDMSG, sockfd, msg, 1, 0, flags);
         return wyze::do_io(sockfd, sendmsg_f, "sendmsg", wyze::IOManager::WRITE
-                                , SO_SNDTIMEO, msg, flags);
+                                , SO_SNDTIMEO, &req, msg, flags);
     }
 
     // TODO::这里的设置操作，读写操作和设置操作不再同一个线程可能会出现错误
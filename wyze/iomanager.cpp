@@ -1,8 +1,14 @@
 #include "iomanager.h"
+#include "iouring.h"
+#include "cancel.h"
+#include "config.h"
 #include "macro.h"
 #include "log.h"
 
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
@@ -13,6 +19,61 @@ namespace wyze {
 
     static Logger::ptr g_logger = WYZE_LOG_NAME("system");
 
+    static ConfigVar<std::string>::ptr g_backend =
+        Config::Lookup<std::string>("iomanager.backend", "epoll", "iomanager backend: epoll or io_uring");
+    static ConfigVar<uint32_t>::ptr g_uring_entries =
+        Config::Lookup<uint32_t>("iomanager.uring_entries", 256, "io_uring submission queue entries");
+    static ConfigVar<uint32_t>::ptr g_uring_submit_batch =
+        Config::Lookup<uint32_t>("iomanager.uring_submit_batch", 16, "submit queued io_uring requests once this many are queued or this many tasks ran");
+
+    static ConfigVar<bool>::ptr g_multi_reactor =
+        Config::Lookup<bool>("iomanager.multi_reactor", false, "one epoll per worker thread, connections are owned by one thread");
+    static ConfigVar<uint32_t>::ptr g_reactor_poll_interval =
+        Config::Lookup<uint32_t>("iomanager.reactor_poll_interval", 64, "in multi reactor mode a busy worker polls its own epoll every this many tasks, 0 to disable");
+    static ConfigVar<bool>::ptr g_persistent_et =
+        Config::Lookup<bool>("iomanager.persistent_et", false, "register each direction a fiber waits on once with EPOLLET and keep it in epoll until close");
+    static ConfigVar<uint64_t>::ptr g_busy_poll_us =
+        Config::Lookup<uint64_t>("iomanager.busy_poll_us", 0, "idle workers poll epoll without blocking for up to this many microseconds before parking, 0 to disable");
+    static ConfigVar<uint32_t>::ptr g_busy_poll_socket_us =
+        Config::Lookup<uint32_t>("iomanager.busy_poll_socket_us", 0, "SO_BUSY_POLL set on accepted sockets of a busy poll iomanager, 0 to leave sockets unchanged");
+
+    static uint32_t s_uring_submit_batch = 16;
+    static uint32_t s_reactor_poll_interval = 64;
+    static thread_local uint32_t t_uringSlices = 0;     //有请求待提交时当前线程执行过的任务数
+    static thread_local uint32_t t_reactorSlices = 0;   //上次检查自己的 epoll 后执行过的任务数
+
+    struct _IOManagerIniter {
+        _IOManagerIniter() {
+            s_uring_submit_batch = g_uring_submit_batch->getValue();
+            s_reactor_poll_interval = g_reactor_poll_interval->getValue();
+            g_uring_submit_batch->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                WYZE_LOG_INFO(g_logger) << "iomanager uring submit batch changed from "
+                                        << old_value << " to " << new_value;
+                s_uring_submit_batch = new_value;
+            });
+            g_reactor_poll_interval->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                WYZE_LOG_INFO(g_logger) << "iomanager reactor poll interval changed from "
+                                        << old_value << " to " << new_value;
+                s_reactor_poll_interval = new_value;
+            });
+        }
+    };
+
+    static _IOManagerIniter s_iomanager_initer;
+
+    //一个在 io_uring 中等待完成的请求，user_data 指向它
+    struct IOManager::UringOp {
+        Fiber::ptr fiber;               //等待完成的协程
+        int thread = -1;                //完成后在哪个线程恢复，多 reactor 模式下为 fd 所属的线程
+        int res = 0;                    //cqe.res
+        std::atomic<int> reason = {0};  //超时或者令牌取消时记录的 errno，只有第一次设置生效
+
+        bool cancel(int err) {
+            int expected = 0;
+            return reason.compare_exchange_strong(expected, err);
+        }
+    };
+
     IOManager::FdContext::EventContext& IOManager::FdContext::getContext(Event event)
     {
         switch(event) {
@@ -32,88 +93,201 @@ namespace wyze {
         ctx.cb = nullptr;
     }
 
-    void IOManager::FdContext::triggerEvent(Event event)
+    void IOManager::FdContext::triggerEvent(Event event, int thread)
     {
         WYZE_ASSERT(events & event);
         events = (Event)(events & ~event);      //将出发的事件取消
         EventContext& ctx = getContext(event);
         if(ctx.cb) {
-            ctx.scheduler->schedule(&ctx.cb);   //将对象地址传入，进行交换，避免引用计数
+            ctx.scheduler->schedule(&ctx.cb, thread);   //将对象地址传入，进行交换，避免引用计数
         }
         else {
-            ctx.scheduler->schedule(&ctx.fiber);    //TODO::这里感觉不会进入
+            if(ctx.fiber->getHomeThread() != -1) {
+                thread = -1;                    //共享栈协程只能回到绑定的线程
+            }
+            ctx.scheduler->schedule(&ctx.fiber, thread);    //TODO::这里感觉不会进入
         }
         ctx.scheduler = nullptr;
     }
 
-    void IOManager::contextResize(size_t size)
+    IOManager::Reactor::Reactor()
     {
-        m_fdContexts.resize(size);      //如果size 小于 当前的大小，则后面的被截断，如果大于，后面的则调用默认的构造函数
+        for(auto& i : segments) {
+            i.store(nullptr, std::memory_order_relaxed);
+        }
+    }
 
-        for(size_t i = 0 ; i < m_fdContexts.size(); ++i) {
-            if(!m_fdContexts[i]) {  //不存在，则创建
-                m_fdContexts[i] = new FdContext;
-                m_fdContexts[i]->fd = i;
+    IOManager::Reactor::~Reactor()
+    {
+        for(auto& i : segments) {
+            FdSegment* seg = i.load(std::memory_order_relaxed);
+            if(!seg) {
+                continue;
             }
+            for(size_t j = 0; j < FD_SEGMENT_SIZE; ++j) {
+                delete seg[j].load(std::memory_order_relaxed);
+            }
+            delete[] seg;
+        }
+    }
+
+    //多 reactor 模式下 fd 按编号轮流分给各个线程，连续 accept 的连接分散到不同线程
+    IOManager::Reactor* IOManager::getReactor(int fd) const
+    {
+        if(!m_multiReactor) {
+            return m_reactors[0];
         }
+        return m_reactors[m_firstOwner + fd % (m_reactors.size() - m_firstOwner)];
     }
 
-    IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
+    size_t IOManager::getSlot(int fd) const
+    {
+        return m_multiReactor ? fd / (m_reactors.size() - m_firstOwner) : fd;
+    }
+
+    IOManager::FdContext* IOManager::getFdContext(int fd, bool create)
+    {
+        if(fd < 0) {
+            return nullptr;
+        }
+        Reactor* reactor = getReactor(fd);
+        size_t slot = getSlot(fd);
+        size_t seg_idx = slot >> FD_SEGMENT_BITS;
+        if(seg_idx >= FD_SEGMENT_COUNT) {
+            return nullptr;
+        }
+
+        FdSegment* seg = reactor->segments[seg_idx].load(std::memory_order_acquire);
+        if(!seg) {
+            if(!create) {
+                return nullptr;
+            }
+            seg = new FdSegment[FD_SEGMENT_SIZE];
+            for(size_t i = 0; i < FD_SEGMENT_SIZE; ++i) {
+                seg[i].store(nullptr, std::memory_order_relaxed);
+            }
+            FdSegment* expected = nullptr;
+            if(!reactor->segments[seg_idx].compare_exchange_strong(expected, seg
+                        , std::memory_order_acq_rel)) {
+                delete[] seg;           //其他线程先装上了这个段
+                seg = expected;
+            }
+        }
+
+        //FdContext 在第一次 addEvent 时由注册的线程创建，绑核后内存落在该线程所在的 NUMA 节点
+        FdSegment& entry = seg[slot & (FD_SEGMENT_SIZE - 1)];
+        FdContext* fd_ctx = entry.load(std::memory_order_acquire);
+        if(!fd_ctx && create) {
+            FdContext* created = new FdContext;
+            created->fd = fd;
+            created->reactor = reactor;
+            if(entry.compare_exchange_strong(fd_ctx, created, std::memory_order_acq_rel)) {
+                fd_ctx = created;
+            }
+            else {
+                delete created;         //失败时 fd_ctx 是其他线程创建的
+            }
+        }
+        return fd_ctx;
+    }
+
+    int IOManager::getReactorThread(const Reactor* reactor) const
+    {
+        return reactor->owner == -1 ? -1 : getWorkerThread(reactor->owner);
+    }
+
+    int IOManager::getOwnerThread(int fd) const
+    {
+        return m_multiReactor ? getReactorThread(getReactor(fd)) : -1;
+    }
+
+    IOManager::IOManager(size_t threads, bool use_caller, const std::string& name, Backend backend)
         : Scheduler(threads, use_caller, name)
     {
-        m_epfd = epoll_create(5000);
-        WYZE_ASSERT(m_epfd > 0);
+        //use_caller 的线程只在 stop 时参与调度，不拥有 fd；弹性模式下线程会退出，也不能拥有 fd
+        m_firstOwner = hasRootThread() ? 1 : 0;
+        m_multiReactor = g_multi_reactor->getValue();
+        if(m_multiReactor && (isElastic() || getWorkerCount() <= m_firstOwner)) {
+            WYZE_LOG_WARN(g_logger) << "name=" << name << " multi reactor needs a fixed number of "
+                                    << "created threads, fallback to one shared epoll";
+            m_multiReactor = false;
+        }
+
+        m_persistentEt = g_persistent_et->getValue();
+        m_busyPollUs = g_busy_poll_us->getValue();
+        m_busyPollSocketUs = m_busyPollUs ? g_busy_poll_socket_us->getValue() : 0;
+
+        size_t reactor_count = m_multiReactor ? getWorkerCount() : 1;
+        for(size_t i = 0; i < reactor_count; ++i) {
+            Reactor* reactor = new Reactor;
+            reactor->epfd = epoll_create(5000);
+            WYZE_ASSERT(reactor->epfd > 0);
+            reactor->owner = m_multiReactor ? i : -1;
+            m_reactors.push_back(reactor);
+        }
+        m_epfd = m_reactors[0]->epfd;
 
-        int rt = pipe(m_tickleFds);
-        WYZE_ASSERT(!rt);
+        m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        WYZE_ASSERT(m_tickleFd >= 0);
 
         epoll_event ev;
         memset(&ev, 0, sizeof(ev));
-        ev.events = EPOLLET | EPOLLIN;
-        ev.data.fd = m_tickleFds[0];
-        
-        rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &ev);
-        WYZE_ASSERT(!rt);
+        int rt = 0;
+        if(!m_multiReactor) {   //多 reactor 模式下 poller 用自己的 eventfd 唤醒，不使用 m_tickleFd
+            ev.events = EPOLLET | EPOLLIN;
+            ev.data.fd = m_tickleFd;
+            rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &ev);
+            WYZE_ASSERT(!rt);
+        }
 
-        int flag = fcntl(m_tickleFds[0], F_GETFL);
-        flag |= O_NONBLOCK;
-        rt = fcntl(m_tickleFds[0], F_SETFL, flag);
-        WYZE_ASSERT(!rt);
+        //共享模式下 follower 阻塞在自己的 eventfd 上，不注册到 epoll，唤醒时不会惊动 poller；
+        //多 reactor 模式下注册到自己的 epoll，停车时同时等待唤醒和自己的 fd
+        m_wakeFds.resize(getWorkerCount());
+        for(size_t i = 0; i < m_wakeFds.size(); ++i) {
+            m_wakeFds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            WYZE_ASSERT(m_wakeFds[i] >= 0);
+            if(m_multiReactor) {
+                ev.events = EPOLLET | EPOLLIN;
+                ev.data.ptr = m_reactors[i];
+                rt = epoll_ctl(m_reactors[i]->epfd, EPOLL_CTL_ADD, m_wakeFds[i], &ev);
+                WYZE_ASSERT(!rt);
+            }
+        }
 
-        contextResize(32);
+        if(backend == BACKEND_CONFIG) {
+            backend = g_backend->getValue() == "io_uring" ? BACKEND_URING : BACKEND_EPOLL;
+        }
+        if(backend == BACKEND_URING && !initUring()) {
+            WYZE_LOG_WARN(g_logger) << "name=" << name << " io_uring unavailable errno=" << errno
+                                    << " (" << strerror(errno) << "), fallback to epoll";
+        }
         start();                //开启调度
     }
 
     IOManager::~IOManager()
     {
         stop();     //停止调度
-        close(m_epfd);
-        close(m_tickleFds[0]);
-        close(m_tickleFds[1]);
+        m_uring.reset();
+        close(m_tickleFd);
+        for(auto& i : m_wakeFds) {
+            close(i);
+        }
 
-        for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-            if(m_fdContexts[i]) {
-                delete m_fdContexts[i];
-            }
+        for(auto& reactor : m_reactors) {
+            close(reactor->epfd);
+            delete reactor;
         }
     }
     
     // 0 success, -1 error
-    int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
+    int IOManager::addEvent(int fd, Event event, Callable cb)
     {
-        FdContext* fd_ctx = nullptr;
-
-        RWMutexType::ReadLock rlock(m_mutex);   //先加读锁
-        if((int)m_fdContexts.size() > fd) { //已经分配好了内存空间
-            fd_ctx = m_fdContexts[fd];
-            rlock.unlock();
-        }
-        else {                              //没有分配内存空间
-            rlock.unlock();     
-            RWMutexType::WriteLock wlock(m_mutex);
-            contextResize(fd * 1.5);        //一些子分配 1.5 倍空间，减少 写锁粒度
-            fd_ctx = m_fdContexts[fd];
+        FdContext* fd_ctx = getFdContext(fd, true);
+        if(!fd_ctx) {
+            WYZE_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of fd table range";
+            return -1;
         }
+        int epfd = fd_ctx->reactor->epfd;
 
         //对 fdContext 加锁， 避免多线程操作,    处理操作，增加过的事件再增加会报错
         FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
@@ -124,18 +298,26 @@ namespace wyze {
             WYZE_ASSERT(!(fd_ctx->events & event));
         }
 
-        int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-        epoll_event ev;
-        memset(&ev, 0, sizeof(ev));
-        ev.events = EPOLLET | fd_ctx->events | event;
-        ev.data.ptr = fd_ctx;
-
-        int rt = epoll_ctl(m_epfd, op, fd, &ev);
-        if(rt) {
-            WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                << op << ", " << fd << ", " << ev.events << "):" 
-                << rt << " (" << errno << ") (" << strerror(errno) << ")";
-            return -1;
+        //常驻注册的方向只需要填写等待者。协程等待时把这个方向加入常驻注册，之后一直留在 epoll 中；
+        //写方向用到时才注册，只读的连接不会因为对端读走数据产生没有等待者的 EPOLLOUT 唤醒
+        if(!(fd_ctx->persistent & event)) {
+            bool persistent = fd_ctx->persistent || (m_persistentEt && !cb && !fd_ctx->events);
+            int op = fd_ctx->events || fd_ctx->persistent ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLET | fd_ctx->persistent | fd_ctx->events | event;
+            ev.data.ptr = fd_ctx;
+
+            int rt = epoll_ctl(epfd, op, fd, &ev);
+            if(rt) {
+                WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                    << op << ", " << fd << ", " << ev.events << "):" 
+                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+                return -1;
+            }
+            if(persistent) {
+                fd_ctx->persistent = (Event)(fd_ctx->persistent | event);
+            }
         }
 
         ++m_pendingEvent;
@@ -154,36 +336,43 @@ namespace wyze {
             ev_ctx.fiber = Fiber::GetThis();
             WYZE_ASSERT(ev_ctx.fiber->getState() == Fiber::State::EXEC);
         }
+
+        //调用者上次 EAGAIN 之后边沿已经到达，不会再有新的通知，直接触发。
+        //协程此时还没有切出，调度器会等它挂起后再恢复
+        if(fd_ctx->ready & event) {
+            fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+            fd_ctx->triggerEvent(event, getReactorThread(fd_ctx->reactor));
+            --m_pendingEvent;
+        }
         return 0;
     }
 
     bool IOManager::delEvent(int fd, Event event)
     {
-        FdContext* fd_ctx = nullptr;
-        {
-            RWMutexType::ReadLock rlock(m_mutex);
-            if((int)m_fdContexts.size() <= fd) 
-                return false;
-            fd_ctx = m_fdContexts[fd];
-        }
+        FdContext* fd_ctx = getFdContext(fd, false);
+        if(!fd_ctx)
+            return false;
+        int epfd = fd_ctx->reactor->epfd;
 
         FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
         if(!(fd_ctx->events & event))   //不存在该事件则返回
             return false;
         
         Event new_ev = (Event)(fd_ctx->events & ~event);
-        int op = new_ev ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-        epoll_event ev;
-        memset(&ev, 0, sizeof(ev));
-        ev.events = EPOLLET | new_ev;
-        ev.data.ptr = fd_ctx;
-
-        int rt = epoll_ctl(m_epfd, op, fd, &ev);
-        if(rt) {
-            WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                << op << ", " << fd << ", " << ev.events << "):" 
-                << rt << " (" << errno << ") (" << strerror(errno) << ")";
-            return false;
+        if(!fd_ctx->persistent) {
+            int op = new_ev ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLET | new_ev;
+            ev.data.ptr = fd_ctx;
+
+            int rt = epoll_ctl(epfd, op, fd, &ev);
+            if(rt) {
+                WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                    << op << ", " << fd << ", " << ev.events << "):" 
+                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+                return false;
+            }
         }
 
         --m_pendingEvent;
@@ -195,67 +384,71 @@ namespace wyze {
 
     bool IOManager::canceEvent(int fd, Event event)
     {
-        FdContext* fd_ctx = nullptr;
-        {
-            RWMutexType::ReadLock rlock(m_mutex);
-            if((int)m_fdContexts.size() <= fd)
-                return false;
-            fd_ctx = m_fdContexts[fd];
-        }
+        FdContext* fd_ctx = getFdContext(fd, false);
+        if(!fd_ctx)
+            return false;
+        int epfd = fd_ctx->reactor->epfd;
 
         FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
         if(!(fd_ctx->events & event))
             return false;
 
         Event new_ev = (Event)(fd_ctx->events & ~event);
-        int op = new_ev ?  EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-        epoll_event ev;
-        memset(&ev, 0, sizeof(ev));
-        ev.events = EPOLLET | new_ev;
-        ev.data.ptr = fd_ctx;
-
-        int rt = epoll_ctl(m_epfd, op, fd, &ev);
-        if(rt) {
-            WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                << op << ", " << fd << ", " << ev.events << "):" 
-                << rt << " (" << errno << ") (" << strerror(errno) << ")";
-            return false;
+        if(!fd_ctx->persistent) {
+            int op = new_ev ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLET | new_ev;
+            ev.data.ptr = fd_ctx;
+
+            int rt = epoll_ctl(epfd, op, fd, &ev);
+            if(rt) {
+                WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                    << op << ", " << fd << ", " << ev.events << "):" 
+                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+                return false;
+            }
         }
 
-        fd_ctx->triggerEvent(event);
+        fd_ctx->triggerEvent(event, getReactorThread(fd_ctx->reactor));
         --m_pendingEvent;
         return true;
     }
 
     bool IOManager::canceAll(int fd)
     {
-        FdContext* fd_ctx = nullptr;
-        {
-            RWMutexType::ReadLock rlock(m_mutex);
-            if((int)m_fdContexts.size() <= fd)
-                return false;
-            fd_ctx = m_fdContexts[fd];
+        FdContext* fd_ctx = getFdContext(fd, false);
+        if(!fd_ctx)
+            return false;
+        int epfd = fd_ctx->reactor->epfd;
+
+        if(m_uring && fd_ctx->uringOps > 0) {
+            cancelUring(0, fd);     //还在 io_uring 中的请求持有文件引用，先取消，等待的协程得到 EBADF
         }
 
         FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
-        if(!fd_ctx->events) 
+        if(!fd_ctx->events && !fd_ctx->persistent) 
             return false;
         
-        //删除
-        int rt = epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
-        if(rt) {
-            WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+        //删除，常驻注册的 fd 没有等待者时也要删除，fd 编号复用后重新注册
+        int rt = epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        if(rt && !fd_ctx->persistent) {
+            WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
                 << EPOLL_CTL_DEL << ", " << fd << "):" 
                 << rt << " (" << errno << ") (" << strerror(errno) << ")";
             return false;
         }
+        fd_ctx->persistent = Event::NONE;
+        fd_ctx->ready = Event::NONE;
+        if(!fd_ctx->events)
+            return false;
 
         if(fd_ctx->events & Event::READ) {
-            fd_ctx->triggerEvent(Event::READ);
+            fd_ctx->triggerEvent(Event::READ, getReactorThread(fd_ctx->reactor));
             --m_pendingEvent;
         }
         if(fd_ctx->events & Event::WRITE) {
-            fd_ctx->triggerEvent(Event::WRITE);
+            fd_ctx->triggerEvent(Event::WRITE, getReactorThread(fd_ctx->reactor));
             --m_pendingEvent;
         }
 
@@ -263,17 +456,239 @@ namespace wyze {
         return true;
     }
 
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+    bool IOManager::setSocketBusyPoll(int fd) const
+    {
+        if(!m_busyPollSocketUs) {
+            return true;
+        }
+        //两个选项都需要 CAP_NET_ADMIN，失败时连接照常工作，只是内核不会替它忙轮询网卡
+        int usec = m_busyPollSocketUs;
+        int prefer = 1;
+        if(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec))
+                || setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer))) {
+            WYZE_LOG_DEBUG(g_logger) << "setSocketBusyPoll fd=" << fd << " errno=" << errno
+                                     << " (" << strerror(errno) << ")";
+            return false;
+        }
+        return true;
+    }
+
     IOManager* IOManager::GetThis()
     {
         return dynamic_cast<IOManager*>(Scheduler::GetThis());
     }
 
-    void IOManager::tickle()
+    bool IOManager::initUring()
     {
-        if(hasIdleThreads()) 
+        std::unique_ptr<IoUring> uring(new IoUring);
+        if(!uring->init(g_uring_entries->getValue())) {
+            return false;
+        }
+
+        //ring 的 fd 以水平触发注册到 epoll，有完成事件时唤醒 poller 收割。
+        //多 reactor 模式下注册到每个 epoll，EPOLLEXCLUSIVE 避免一次完成唤醒所有停车的线程
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = m_multiReactor ? EPOLLIN | EPOLLEXCLUSIVE : EPOLLIN;
+        ev.data.ptr = uring.get();
+        for(auto& reactor : m_reactors) {
+            if(epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, uring->getFd(), &ev)) {
+                return false;
+            }
+        }
+        m_uring.swap(uring);
+        return true;
+    }
+
+    bool IOManager::canUseUring() const
+    {
+        return m_uring && !Fiber::GetThis()->isSharedStack();
+    }
+
+    io_uring_sqe* IOManager::getUringSqe()
+    {
+        io_uring_sqe* sqe = m_uring->getSqe();
+        if(!sqe && m_uring->submit() >= 0) {
+            ++m_uringSubmits;
+            m_uringQueued = 0;
+            sqe = m_uring->getSqe();
+        }
+        return sqe;
+    }
+
+    void IOManager::submitUring()
+    {
+        Mutex::Lock lock(m_sqMutex);
+        if(m_uring->getPending() == 0) {
             return;
-        int rt = write(m_tickleFds[1], "T", 1);
-        WYZE_ASSERT(rt == 1);
+        }
+        int rt = m_uring->submit();
+        if(rt < 0) {
+            //完成队列满(EBUSY)时内核不接收，SQE 留在队列中，收割后下次再提交
+            if(rt != -EBUSY && rt != -EAGAIN) {
+                WYZE_LOG_ERROR(g_logger) << "io_uring_enter submit error=" << -rt
+                                         << " (" << strerror(-rt) << ")";
+            }
+            return;
+        }
+        ++m_uringSubmits;
+        m_uringQueued = 0;
+    }
+
+    void IOManager::reapUring()
+    {
+        Mutex::Lock lock(m_cqMutex);
+        m_uring->reap([this](const io_uring_cqe& cqe) {
+            if(!cqe.user_data) {    //取消请求自身的完成事件
+                return;
+            }
+            UringOp* op = (UringOp*)cqe.user_data;
+            op->res = cqe.res;
+            --m_pendingEvent;
+            schedule(&op->fiber, op->thread);   //之后协程可能马上在其他线程恢复并释放 op
+        });
+    }
+
+    void IOManager::cancelUring(uint64_t user_data, int fd)
+    {
+        Mutex::Lock lock(m_sqMutex);
+        io_uring_sqe* sqe = getUringSqe();
+        if(!sqe) {
+            WYZE_LOG_ERROR(g_logger) << "io_uring cancel fd=" << fd << " no free sqe";
+            return;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        if(!user_data) {
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        }
+        sqe->user_data = 0;
+        ++m_uringCancels;
+        //取消不等批量，连同之前攒下的请求马上提交
+        if(m_uring->submit() >= 0) {
+            ++m_uringSubmits;
+            m_uringQueued = 0;
+        }
+    }
+
+    int IOManager::uringWait(const UringRequest& req, uint64_t timeout_ms)
+    {
+        WYZE_ASSERT(m_uring);
+        CancelToken::ptr token = CancelToken::GetCurrent();
+        if(token && token->isCancelled()) {
+            return -ECANCELED;
+        }
+
+        FdContext* fd_ctx = getFdContext(req.fd, true);
+        if(!fd_ctx) {
+            return -EAGAIN;
+        }
+        std::shared_ptr<UringOp> op = std::make_shared<UringOp>();
+        op->fiber = Fiber::GetThis();
+        op->thread = getReactorThread(fd_ctx->reactor);
+        {
+            Mutex::Lock lock(m_sqMutex);
+            io_uring_sqe* sqe = getUringSqe();
+            if(!sqe) {
+                return -EAGAIN;     //提交队列满，调用方退回 epoll
+            }
+            sqe->opcode = req.opcode;
+            sqe->fd = req.fd;
+            sqe->addr = req.addr;
+            sqe->len = req.len;
+            sqe->off = req.off;
+            sqe->rw_flags = req.opFlags;
+            sqe->user_data = (uint64_t)op.get();
+            ++m_uringQueued;
+            ++fd_ctx->uringOps;     //在锁内增加，close 发起的取消排在这个请求之后
+            ++m_pendingEvent;
+        }
+        ++m_uringOps;
+
+        //超时和取消都只是提交 ASYNC_CANCEL，协程仍然由请求自己的完成事件唤醒
+        std::weak_ptr<UringOp> weak(op);
+        Timer::ptr timer;
+        if(timeout_ms != ~0ull) {
+            timer = addConditionTimer(timeout_ms, [weak, this]() {
+                std::shared_ptr<UringOp> o = weak.lock();
+                if(o && o->cancel(ETIMEDOUT)) {
+                    cancelUring((uint64_t)o.get(), -1);
+                }
+            }, weak);
+        }
+        uint64_t cancel_id = 0;
+        if(token) {
+            cancel_id = token->addCallback([weak, this]() {
+                std::shared_ptr<UringOp> o = weak.lock();
+                if(o && o->cancel(ECANCELED)) {
+                    cancelUring((uint64_t)o.get(), -1);
+                }
+            });
+        }
+
+        Fiber::YeildToHold();
+
+        if(timer) {
+            timer->cancel();
+        }
+        if(token) {
+            token->removeCallback(cancel_id);
+        }
+        --fd_ctx->uringOps;
+
+        int res = op->res;
+        if(res == -ECANCELED || (res == -EINTR && op->reason)) {
+            int reason = op->reason;
+            res = reason ? -reason : -EBADF;    //没有原因的取消来自 close
+        }
+        else if(res == -EAGAIN) {
+            ++m_uringEagain;
+        }
+        return res;
+    }
+
+    UringStats IOManager::getUringStats() const
+    {
+        UringStats stats;
+        stats.ops = m_uringOps;
+        stats.submits = m_uringSubmits;
+        stats.eagain = m_uringEagain;
+        stats.cancels = m_uringCancels;
+        return stats;
+    }
+
+    void IOManager::flushBatch(bool idle)
+    {
+        if(m_multiReactor && !idle && s_reactor_poll_interval
+                && ++t_reactorSlices >= s_reactor_poll_interval) {
+            t_reactorSlices = 0;
+            pollReactor();
+        }
+        if(!m_uring) {
+            return;
+        }
+        if(m_uringQueued > 0 && (idle || m_uringQueued >= s_uring_submit_batch
+                                    || ++t_uringSlices >= s_uring_submit_batch)) {
+            t_uringSlices = 0;
+            submitUring();
+        }
+        if(m_uring->hasCompletions()) {
+            reapUring();
+        }
+    }
+
+    void IOManager::tickleWorker(int idx, bool poller)
+    {
+        uint64_t one = 1;
+        //多 reactor 模式下 poller 也阻塞在自己的 epoll 上，用自己的 eventfd 唤醒
+        int rt = write(poller && !m_multiReactor ? m_tickleFd : m_wakeFds[idx], &one, sizeof(one));
+        WYZE_ASSERT(rt == sizeof(one));
     }
 
     bool IOManager::stopping(uint64_t& timeout)
@@ -290,96 +705,251 @@ namespace wyze {
         return stopping(timeout);
     }
 
+    //处理 reactor 上 epoll_wait 返回的事件，只由 reactor 所属的线程（共享模式下为 poller 或者忙轮询的线程）调用
+    bool IOManager::processEvents(Reactor* reactor, epoll_event* evs, int count)
+    {
+        bool has_work = false;
+        int thread = getReactorThread(reactor);
+        for(int i = 0; i < count; ++i) {
+            epoll_event& ev = evs[i];
+            if(m_uring && ev.data.ptr == m_uring.get()) {
+                reapUring();
+                has_work = true;
+                continue;
+            }
+            if(m_multiReactor && ev.data.ptr == reactor) {  //自己的唤醒 eventfd
+                uint64_t dummy;
+                while(read(m_wakeFds[reactor->owner], &dummy, sizeof(dummy)) > 0);
+                continue;
+            }
+            if(!m_multiReactor && ev.data.fd == m_tickleFd) {  //TODO::这里会不会出现地址和fd 相同的情况
+                uint64_t dummy;
+                while(read(m_tickleFd, &dummy, sizeof(dummy)) > 0);
+                continue;
+            }
+
+            has_work = true;
+            FdContext* fd_ctx = (FdContext*) ev.data.ptr;
+            FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
+
+            //常驻注册：有等待者的事件直接触发，没有等待者的记下来留给下一次 addEvent，出错时读写都算就绪
+            if(fd_ctx->persistent) {
+                int ready_evs = Event::NONE;
+                if(ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    ready_evs |= Event::READ;
+                if(ev.events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                    ready_evs |= Event::WRITE;
+                fd_ctx->ready = (Event)(fd_ctx->ready | (ready_evs & fd_ctx->persistent & ~fd_ctx->events));
+                ready_evs &= fd_ctx->events;
+                if(ready_evs & Event::READ) {
+                    fd_ctx->triggerEvent(Event::READ, thread);
+                    --m_pendingEvent;
+                }
+                if(ready_evs & Event::WRITE) {
+                    fd_ctx->triggerEvent(Event::WRITE, thread);
+                    --m_pendingEvent;
+                }
+                continue;
+            }
+
+            //获取 该事件由什么 事件类型触发
+            if(ev.events & (EPOLLERR | EPOLLHUP)) {
+                ev.events |= (fd_ctx->events & EPOLLIN) | (fd_ctx->events & EPOLLOUT);        //当发生错误，会触发读写事件
+                WYZE_LOG_ERROR(g_logger) << "ev.events" << ev.events;
+            }
+            int real_evs = Event::NONE;
+            if(ev.events & EPOLLIN) 
+                real_evs |= Event::READ;
+            if(ev.events & EPOLLOUT)
+                real_evs |= Event::WRITE;
+            if( (fd_ctx->events & real_evs) == Event::NONE)
+                continue;
+            
+            //去掉触发的类型，保存未触发的事件类型
+            int left_evs = (fd_ctx->events & ~real_evs);
+            int op = left_evs ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            ev.events = EPOLLET | left_evs;
+
+            int rt2 = epoll_ctl(reactor->epfd, op, fd_ctx->fd, &ev);
+            if(rt2) {
+                WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << reactor->epfd << ", "
+                    << op << "," << fd_ctx->fd << "," << ev.events << "):"
+                    << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+                continue;
+            }
+
+            //执行触发的事件，多 reactor 模式下放回所属的线程
+            if(real_evs & Event::READ) {
+                fd_ctx->triggerEvent(Event::READ, thread);
+                --m_pendingEvent;
+            }
+
+            if(real_evs & Event::WRITE) {
+                fd_ctx->triggerEvent(Event::WRITE, thread);
+                --m_pendingEvent;
+            }
+        }
+        return has_work;
+    }
+
+    void IOManager::pollReactor()
+    {
+        static const int MAX_EVENTS = 32;
+        int idx = GetWorkerIndex();
+        if(idx < 0) {
+            return;
+        }
+        epoll_event evs[MAX_EVENTS];
+        int rt = epoll_wait(m_reactors[idx]->epfd, evs, MAX_EVENTS, 0);
+        if(rt > 0) {
+            processEvents(m_reactors[idx], evs, rt);
+        }
+    }
+
+    //忙轮询自己的 reactor 和定时器。共享模式下只让一个线程轮询，它去执行等到的任务或者预算用完时放弃这个身份，
+    //并唤醒停在 eventfd 上的 poller：poller 接着忙轮询或者回到 epoll_wait，长任务不会耽误 IO 和定时器
+    bool IOManager::busyPollReactor(Reactor* reactor, epoll_event* evs, int max_events)
+    {
+        int idx = GetWorkerIndex();
+        int expected = -1;
+        if(!m_multiReactor && m_busyPoller != idx
+                && !m_busyPoller.compare_exchange_strong(expected, idx)) {
+            return false;
+        }
+        bool rt = busyPoll(m_busyPollUs, [this, reactor, evs, max_events]() {
+            bool has_work = false;
+            int n = epoll_wait(reactor->epfd, evs, max_events, 0);
+            if(n > 0 && processEvents(reactor, evs, n)) {
+                has_work = true;
+            }
+            if(getNextTimer() == 0) {
+                std::vector<Callable> cbs;
+                listExpiredCb(cbs);
+                if(!cbs.empty()) {
+                    schedule(cbs.begin(), cbs.end());
+                    has_work = true;
+                }
+            }
+            return has_work;
+        });
+        if(!m_multiReactor) {
+            releaseBusyPoller(idx);
+        }
+        return rt;
+    }
+
+    void IOManager::releaseBusyPoller(int idx)
+    {
+        int expected = idx;
+        if(m_busyPoller.compare_exchange_strong(expected, -1)) {
+            ticklePoller();
+        }
+    }
+
+    //leader/follower：停车的线程中只有一个 poller 阻塞在 epoll_wait 上处理 IO 和定时器，
+    //共享模式下其余 follower 阻塞在自己的 eventfd 上，由 schedule 定向唤醒，避免惊群；
+    //多 reactor 模式下每个线程阻塞在自己的 epoll 上，只等待自己的 fd，poller 额外负责定时器
     void IOManager::idle()
     {
         static const int MAX_EVENTS = 128;
+        static const int MAX_TIMEOUT = 5000;    //TODO::这里不能大于 60 × 60 × 12 在定时器中，会处理时间修改问题
         epoll_event* evs = new epoll_event[MAX_EVENTS]();
         std::shared_ptr<epoll_event> del_evs(evs, [](epoll_event* ptr) {
             delete[] ptr;
         } );
+        int idx = GetWorkerIndex();
+        WYZE_ASSERT(idx >= 0 && idx < (int)m_wakeFds.size());
+        Reactor* reactor = m_multiReactor ? m_reactors[idx] : m_reactors[0];
 
         while(true) {
             uint64_t next_timeout = 0;
             if(stopping(next_timeout))  {
                 // WYZE_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+                releaseBusyPoller(idx);
+                tickleAll();    //其他停车的线程也需要退出
                 break;
             }
 
+            if(m_busyPollUs && busyPollReactor(reactor, evs, MAX_EVENTS)) {
+                Fiber::YeildToReady();
+                continue;
+            }
+
+            if(spinForWork()) {
+                Fiber::YeildToReady();
+                continue;
+            }
+
+            ParkRole role = parkBegin(idx);
+            if(role == PARK_NONE) {
+                Fiber::YeildToReady();
+                continue;
+            }
+
+            //共享模式下有线程在忙轮询时，poller 也不进入 epoll_wait，以免 IO 事件唤醒它、和忙轮询的线程抢事件。
+            //它同时等待 m_tickleFd：定向唤醒 poller 和忙轮询结束时的 ticklePoller 都写这个 fd
+            bool busy_parked = role == PARK_POLLER && !m_multiReactor && m_busyPoller != -1;
+            if((role == PARK_FOLLOWER || busy_parked) && !m_multiReactor) {
+                pollfd pfd[2];
+                pfd[0].fd = m_wakeFds[idx];
+                pfd[0].events = POLLIN;
+                pfd[0].revents = 0;
+                pfd[1].fd = m_tickleFd;
+                pfd[1].events = POLLIN;
+                pfd[1].revents = 0;
+                int rt = poll(pfd, busy_parked ? 2 : 1, parkTimeout(MAX_TIMEOUT));   //超时是兜底，停止时会被 tickleAll 唤醒
+                uint64_t dummy;
+                while(read(m_wakeFds[idx], &dummy, sizeof(dummy)) > 0);
+                if(busy_parked) {
+                    while(read(m_tickleFd, &dummy, sizeof(dummy)) > 0);
+                }
+                if(!parkEnd(idx) && rt == 0 && !busy_parked && tryRetire(idx)) {    //弹性模式下空闲太久的 follower 退出
+                    break;
+                }
+                Fiber::YeildToReady();
+                continue;
+            }
+
             int rt = 0;
             memset(evs, 0, sizeof(epoll_event) * MAX_EVENTS);
-            do {
-                static const int MAX_TIMEOUT = 5000;    //TODO::这里不能大于 60 × 60 × 12 在定时器中，会处理时间修改问题
+            if(role == PARK_POLLER) {
                 if(next_timeout != ~0ull) {
                     next_timeout = (int)next_timeout < MAX_TIMEOUT ? next_timeout :  MAX_TIMEOUT;
                 }
                 else {
                     next_timeout = MAX_TIMEOUT;
                 }
-
-                rt = epoll_wait(m_epfd, evs, MAX_EVENTS, (int)next_timeout);  //有事件触发，这里会出现惊群
+            }
+            else {
+                next_timeout = MAX_TIMEOUT;
+            }
+            do {
+                rt = epoll_wait(reactor->epfd, evs, MAX_EVENTS, (int)next_timeout);  //共享模式下只有 poller 在这里等待
                 if(rt < 0 && errno == EINTR) {
                 }   //这里表示重试
                 else {
                     break;
                 }
             }while(true);
-
-            std::vector<std::function<void()>> cbs;
-            listExpiredCb(cbs);                         //这里会出现其他唤醒的线程也会卡住
-            if(!cbs.empty()) {
-                schedule(cbs.begin(), cbs.end());
-                cbs.clear();
-            }
-
-            for(int i = 0; i < rt; ++i) {
-                epoll_event& ev = evs[i];
-                if(ev.data.fd == m_tickleFds[0]) {  //TODO::这里会不会出现地址和fd 相同的情况
-                    uint8_t dummy;
-                    while(read(m_tickleFds[0], &dummy, sizeof(dummy)) == 1);
-                    continue;
-                }
-
-                FdContext* fd_ctx = (FdContext*) ev.data.ptr;
-                FdContext::MutexTyp::Lock lock(fd_ctx->mutex);
-
-                //获取 该事件由什么 事件类型触发
-                if(ev.events & (EPOLLERR | EPOLLHUP)) {
-                    ev.events |= (fd_ctx->events & EPOLLIN) | (fd_ctx->events & EPOLLOUT);        //当发生错误，会触发读写事件
-                    WYZE_LOG_ERROR(g_logger) << "ev.events" << ev.events;
-                }
-                int real_evs = Event::NONE;
-                if(ev.events & EPOLLIN) 
-                    real_evs |= Event::READ;
-                if(ev.events & EPOLLOUT)
-                    real_evs |= Event::WRITE;
-                if( (fd_ctx->events & real_evs) == Event::NONE)
-                    continue;
-                
-                //去掉触发的类型，保存未触发的事件类型
-                int left_evs = (fd_ctx->events & ~real_evs);
-                int op = left_evs ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-                ev.events = EPOLLET | left_evs;
-
-                int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &ev);
-                if(rt2) {
-                    WYZE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                        << op << "," << fd_ctx->fd << "," << ev.events << "):"
-                        << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
-                    continue;
-                }
-
-                //执行触发的事件
-                if(real_evs & Event::READ) {
-                    fd_ctx->triggerEvent(Event::READ);
-                    --m_pendingEvent;
+            bool has_work = parkEnd(idx);   //被定向唤醒表示有任务
+
+            if(role == PARK_POLLER) {
+                std::vector<Callable> cbs;
+                listExpiredCb(cbs);
+                if(!cbs.empty()) {
+                    schedule(cbs.begin(), cbs.end());
+                    cbs.clear();
+                    has_work = true;
                 }
+            }
 
-                if(real_evs & Event::WRITE) {
-                    fd_ctx->triggerEvent(Event::WRITE);
-                    --m_pendingEvent;
-                }
+            if(rt > 0 && processEvents(reactor, evs, rt)) {
+                has_work = true;
             }
 
+            if(has_work && role == PARK_POLLER) {
+                promotePoller();    //自己去执行任务，让一个 follower 接着等待定时器和 IO
+            }
             Fiber::YeildToReady();   //让出该协程
         }
     }
@@ -387,6 +957,6 @@ namespace wyze {
 
     void IOManager::onTimerInsertdAtFront()
     {
-        tickle();
+        ticklePoller();
     }
 }
\ No newline at end of file
@@ -4,9 +4,22 @@
 #include "scheduler.h"
 #include "timer.h"
 #include <vector>
+#include <memory>
+
+struct io_uring_sqe;
+struct epoll_event;
 
 namespace wyze {
 
+    class IoUring;
+
+    struct UringStats {
+        uint64_t ops = 0;           //提交的读写、accept、connect 请求
+        uint64_t submits = 0;       //io_uring_enter 的次数，ops / submits 就是平均批量
+        uint64_t eagain = 0;        //内核返回 EAGAIN，退回 epoll 等待的请求
+        uint64_t cancels = 0;       //超时、令牌取消和 close 发起的取消请求
+    };
+
     class IOManager: public Scheduler, public TimerManager{
     public:
         using ptr = std::shared_ptr<IOManager>;
@@ -17,55 +30,155 @@ namespace wyze {
             READ = 0X1,  //EPOLLIN
             WRITE = 0X4, //EPOLLOUT
         };
+
+        enum Backend {
+            BACKEND_CONFIG = -1,    //按 iomanager.backend 配置选择
+            BACKEND_EPOLL = 0,
+            BACKEND_URING = 1,      //hook 的 socket 读写、accept、connect 提交为 io_uring 的完成型请求
+        };
+
+        //提交给 io_uring 的请求，字段和 io_uring_sqe 中的同名字段含义相同
+        struct UringRequest {
+            UringRequest(uint8_t opcode_, int fd_, const void* addr_, uint32_t len_
+                        , uint64_t off_ = 0, uint32_t op_flags_ = 0)
+                : opcode(opcode_), fd(fd_), addr((uint64_t)addr_), len(len_)
+                , off(off_), opFlags(op_flags_) {}
+
+            uint8_t opcode;
+            int fd;
+            uint64_t addr;
+            uint32_t len;
+            uint64_t off;           //accept 时是 addrlen 的地址，connect 时是地址长度
+            uint32_t opFlags;       //recv/send 的 flags，readv/writev 的 rw_flags 等
+        };
     private:
+        struct Reactor;
+
         struct FdContext {
             using MutexTyp = Mutex;
             struct EventContext {
                 Scheduler* scheduler = nullptr;     //事件执行的scheduler
                 Fiber::ptr fiber;                   //事件协程
-                std::function<void()> cb = nullptr; //时间的回调函数
+                Callable cb;                        //时间的回调函数
             };
 
             EventContext& getContext(Event event);
             void resetContext(EventContext& ctx);
-            void triggerEvent(Event event);
+            void triggerEvent(Event event, int thread);     //thread 为 -1 时任意线程执行
 
             EventContext read;              //读事件
             EventContext write;             //写事件
             int fd = 0;                     //事件关联的句柄
+            Reactor* reactor = nullptr;     //注册到哪个 epoll
             Event events = Event::NONE;     //已经注册的事件
+            Event persistent = Event::NONE; //以边沿触发常驻在 epoll 中的方向，等待和唤醒不再调用 epoll_ctl
+            Event ready = Event::NONE;      //常驻注册时没有等待者期间到达的边沿，下一个等待者直接触发
+            std::atomic<int> uringOps = {0};    //在 io_uring 中等待完成的请求数，close 时需要取消
             MutexTyp mutex;
         };
 
-        void contextResize(size_t size);
+        //fd 上下文表分两级：顶层是固定大小的段指针数组，段按需分配后不再移动也不释放，
+        //查找只需要两次加载，扩容只是用 CAS 装上一个新段，不会阻塞并发的注册
+        static const size_t FD_SEGMENT_BITS = 10;
+        static const size_t FD_SEGMENT_SIZE = 1 << FD_SEGMENT_BITS;
+        static const size_t FD_SEGMENT_COUNT = 4096;    //每个 reactor 最多 4M 个 fd
+        using FdSegment = std::atomic<FdContext*>;
+
+        //一个 epoll 实例和它管理的 fd 上下文。共享模式下只有一个，所有线程轮流做 poller；
+        //多 reactor 模式下每个调度线程一个，连接上的事件只由所属线程等待和处理
+        struct Reactor {
+            Reactor();
+            ~Reactor();
+
+            int epfd = -1;
+            int owner = -1;                     //所属线程的队列下标，共享模式为 -1
+            std::atomic<FdSegment*> segments[FD_SEGMENT_COUNT];    //下标为 fd 在该 reactor 中的序号的高位
+        };
+
+        struct UringOp;
+
+        Reactor* getReactor(int fd) const;
+        size_t getSlot(int fd) const;       //fd 在所属 reactor 中的下标
+        FdContext* getFdContext(int fd, bool create);   //create 时不存在则创建，超出表的范围返回 nullptr
+        int getReactorThread(const Reactor* reactor) const;     //reactor 所属的线程id，共享模式为 -1
 
     public:
         IOManager(size_t threads = 1, 
-            bool use_caller = true, const std::string& name = "UNKONW");
+            bool use_caller = true, const std::string& name = "UNKONW"
+            , Backend backend = BACKEND_CONFIG);
         ~IOManager();
         
         // 0 success, -1 error      该函数只支持单事件的增加
-        int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+        int addEvent(int fd, Event event, Callable cb = nullptr);
         bool delEvent(int fd, Event event);
         bool canceEvent(int fd, Event event);
         bool canceAll(int fd);
         static IOManager* GetThis();
+
+        //io_uring 初始化失败时退回 epoll，这里返回实际使用的后端
+        Backend getBackend() const { return m_uring ? BACKEND_URING : BACKEND_EPOLL; }
+        //iomanager.multi_reactor 打开时每个调度线程有自己的 epoll，fd 按编号分给线程
+        bool isMultiReactor() const { return m_multiReactor; }
+        //iomanager.persistent_et 打开时协程等待的 fd 每个方向第一次注册后常驻 epoll，要求调用者读写到 EAGAIN 再等待，
+        //fd 必须经过 hook 的 close（canceAll）关闭，否则复用同一个 fd 编号的新连接收不到事件
+        bool isPersistentEt() const { return m_persistentEt; }
+        //iomanager.busy_poll_us 大于 0 时空闲线程先不阻塞地轮询 epoll 和定时器，期间新任务不需要唤醒，
+        //超过预算仍然没有事件才停车。共享模式下同一时间只有一个线程轮询，其余空闲线程停在自己的 eventfd 上
+        uint64_t getBusyPollUs() const { return m_busyPollUs; }
+        //按 iomanager.busy_poll_socket_us 给 socket 设置 SO_BUSY_POLL 和 SO_PREFER_BUSY_POLL，没有配置时不做处理
+        bool setSocketBusyPoll(int fd) const;
+        //fd 所属的调度线程 id，accept 后把连接的处理协程放到这个线程。共享模式返回 -1
+        int getOwnerThread(int fd) const;
+        //当前协程能否使用 io_uring 等待：共享栈协程挂起后栈内容被换出，内核不能直接写它的缓冲区
+        bool canUseUring() const;
+        //提交 req 并挂起当前协程直到完成，返回系统调用的结果，失败返回 -errno。
+        //超时返回 -ETIMEDOUT，当前协程的 CancelToken 被取消返回 -ECANCELED，fd 被 close 返回 -EBADF
+        int uringWait(const UringRequest& req, uint64_t timeout_ms = ~0ull);
+        UringStats getUringStats() const;
     
     protected:
-        void tickle() override;
+        void tickleWorker(int idx, bool poller) override;
         bool stopping() override;
         void idle() override;
         void onTimerInsertdAtFront() override;   //添加一个定时器，如果该定时器在 set 集合中为开始，表示需要重新设置阻塞时间
 
+        void flushBatch(bool idle) override;    //攒够一批或者要空闲时提交 SQE，顺便收割 CQE
+
         bool stopping(uint64_t& timeout);
 
     private:
-        int m_epfd = 0;             //epoll fd
-        int m_tickleFds[2];         //唤醒 epoll 主塞的 pipe  fd
+        bool initUring();
+        io_uring_sqe* getUringSqe();        //需要持有 m_sqMutex，队列满时先提交再取
+        void submitUring();
+        void reapUring();
+        bool processEvents(Reactor* reactor, epoll_event* evs, int count);   //返回是否调度了任务
+        void pollReactor();                 //多 reactor 模式下忙碌的线程不阻塞地检查自己的 fd
+        bool busyPollReactor(Reactor* reactor, epoll_event* evs, int max_events);  //忙轮询，返回是否有任务
+        void releaseBusyPoller(int idx);    //idx 不再忙轮询，唤醒 poller 接替
+        void cancelUring(uint64_t user_data, int fd);   //user_data 为 0 时取消 fd 上所有的请求
+
+    private:
+        int m_epfd = 0;             //共享模式的 epoll fd，多 reactor 模式下为 0 号 reactor 的
+        int m_tickleFd = -1;        //唤醒阻塞在 epoll_wait 的 poller 的 eventfd
+        std::vector<int> m_wakeFds; //每个调度线程停车时阻塞的 eventfd，多 reactor 模式下注册在自己的 epoll 中
 
         std::atomic<size_t> m_pendingEvent = {0};   //添加的时间，增加时间会增加，删除和触发会取消
-        RWMutexType m_mutex;                        //对 m_fdContexts 对象操作会进行 加锁
-        std::vector<FdContext *> m_fdContexts;      // 保存fd 事件句柄
+        bool m_multiReactor = false;
+        bool m_persistentEt = false;
+        uint64_t m_busyPollUs = 0;                  //忙轮询的预算，0 表示关闭
+        uint32_t m_busyPollSocketUs = 0;            //accept 的连接上设置的 SO_BUSY_POLL，0 表示不设置
+        std::atomic<int> m_busyPoller = {-1};       //共享模式下忙轮询的线程下标，其余线程不进入 epoll，去执行任务时放弃
+        std::vector<Reactor *> m_reactors;          //多 reactor 模式下下标和本地队列下标相同
+        size_t m_firstOwner = 0;                    //可以拥有 fd 的第一个 reactor，use_caller 的线程只在 stop 时调度，不拥有 fd
+
+        std::unique_ptr<IoUring> m_uring;           //io_uring 后端，epoll 后端时为空
+        Mutex m_sqMutex;                            //准备和提交 SQE
+        Mutex m_cqMutex;                            //收割 CQE
+        std::atomic<uint32_t> m_uringQueued = {0};  //已经准备、还没有提交的 SQE
+        std::atomic<uint64_t> m_uringOps = {0};
+        std::atomic<uint64_t> m_uringSubmits = {0};
+        std::atomic<uint64_t> m_uringEagain = {0};
+        std::atomic<uint64_t> m_uringCancels = {0};
     };
 
 }
@@ -0,0 +1,139 @@
+#include "iouring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+namespace wyze {
+
+    static int io_uring_setup(unsigned entries, io_uring_params* p)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    IoUring::~IoUring()
+    {
+        if(m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if(m_cqRing && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if(m_sqRing) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if(m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    bool IoUring::init(unsigned entries)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CLAMP;
+        m_fd = io_uring_setup(entries, &p);
+        if(m_fd < 0) {
+            return false;
+        }
+
+        m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if(p.features & IORING_FEAT_SINGLE_MMAP) {      //两个队列共用一次映射
+            if(m_cqRingSize > m_sqRingSize) {
+                m_sqRingSize = m_cqRingSize;
+            }
+            m_cqRingSize = m_sqRingSize;
+        }
+
+        void* sq = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE
+                        , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if(sq == MAP_FAILED) {
+            return false;
+        }
+        m_sqRing = sq;
+        if(p.features & IORING_FEAT_SINGLE_MMAP) {
+            m_cqRing = sq;
+        }
+        else {
+            void* cq = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE
+                            , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if(cq == MAP_FAILED) {
+                return false;
+            }
+            m_cqRing = cq;
+        }
+
+        m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+                        , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if(sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = (io_uring_sqe*)sqes;
+
+        char* sq_ptr = (char*)m_sqRing;
+        m_sqHead = (unsigned*)(sq_ptr + p.sq_off.head);
+        m_sqTail = (unsigned*)(sq_ptr + p.sq_off.tail);
+        m_sqMask = *(unsigned*)(sq_ptr + p.sq_off.ring_mask);
+        m_sqEntries = p.sq_entries;
+        m_sqeTail = *m_sqTail;
+        //SQE 按顺序使用，索引数组固定为恒等映射，提交时只需要移动 tail
+        unsigned* array = (unsigned*)(sq_ptr + p.sq_off.array);
+        for(unsigned i = 0; i < m_sqEntries; ++i) {
+            array[i] = i;
+        }
+
+        char* cq_ptr = (char*)m_cqRing;
+        m_cqHead = (unsigned*)(cq_ptr + p.cq_off.head);
+        m_cqTail = (unsigned*)(cq_ptr + p.cq_off.tail);
+        m_cqMask = *(unsigned*)(cq_ptr + p.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe*)(cq_ptr + p.cq_off.cqes);
+        return true;
+    }
+
+    io_uring_sqe* IoUring::getSqe()
+    {
+        unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if(m_sqeTail - head >= m_sqEntries) {
+            return nullptr;
+        }
+        io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+        ++m_sqeTail;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    unsigned IoUring::getPending() const
+    {
+        return m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    }
+
+    int IoUring::submit()
+    {
+        __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+        //上次因为 EBUSY 等没有被内核接收的 SQE 也在这里一起提交
+        unsigned to_submit = getPending();
+        if(to_submit == 0) {
+            return 0;
+        }
+        int rt = 0;
+        do {
+            rt = io_uring_enter(m_fd, to_submit, 0, 0);
+        } while(rt < 0 && errno == EINTR);
+        return rt < 0 ? -errno : rt;
+    }
+
+    bool IoUring::hasCompletions() const
+    {
+        return __atomic_load_n(m_cqHead, __ATOMIC_RELAXED) != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    }
+
+}
@@ -0,0 +1,66 @@
+#ifndef _WYZE_IOURING_H_
+#define _WYZE_IOURING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "noncopyable.h"
+
+namespace wyze {
+
+    //不依赖 liburing 的最小 io_uring 封装：映射提交/完成队列，准备 SQE、提交、遍历 CQE。
+    //本身不加锁，准备和提交 SQE、收割 CQE 分别由调用方串行化
+    class IoUring : Noncopyable {
+    public:
+        IoUring() {}
+        ~IoUring();
+
+        //内核不支持或者被 seccomp 等禁止时返回 false
+        bool init(unsigned entries);
+        int getFd() const { return m_fd; }
+
+        //取一个清零的 SQE，提交队列满时返回 nullptr
+        io_uring_sqe* getSqe();
+        //已经准备好、还没有提交给内核的 SQE 数
+        unsigned getPending() const;
+        //提交所有准备好的 SQE，返回内核接收的个数，失败返回 -errno
+        int submit();
+
+        bool hasCompletions() const;
+        //依次处理所有 CQE 后推进 head，返回处理的个数。f 不能保存 cqe 的地址
+        template<class F>
+        size_t reap(F f) {
+            unsigned head = *m_cqHead;      //只有收割方修改 head
+            unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            size_t n = 0;
+            for(; head != tail; ++head, ++n) {
+                f(m_cqes[head & m_cqMask]);
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            return n;
+        }
+
+    private:
+        int m_fd = -1;
+        void* m_sqRing = nullptr;
+        void* m_cqRing = nullptr;
+        size_t m_sqRingSize = 0;
+        size_t m_cqRingSize = 0;
+        io_uring_sqe* m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+
+        unsigned* m_sqHead = nullptr;       //内核消费到的位置
+        unsigned* m_sqTail = nullptr;       //对内核可见的提交位置
+        unsigned m_sqMask = 0;
+        unsigned m_sqEntries = 0;
+        unsigned m_sqeTail = 0;             //本地已经准备到的位置，submit 时发布到 m_sqTail
+
+        unsigned* m_cqHead = nullptr;
+        unsigned* m_cqTail = nullptr;
+        unsigned m_cqMask = 0;
+        io_uring_cqe* m_cqes = nullptr;
+    };
+
+}
+
+#endif // !_WYZE_IOURING_H_
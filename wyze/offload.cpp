@@ -0,0 +1,155 @@
+#include "offload.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "macro.h"
+
+namespace wyze {
+
+    static Logger::ptr g_logger = WYZE_LOG_NAME("system");
+
+    static ConfigVar<uint32_t>::ptr g_offload_threads =
+        Config::Lookup<uint32_t>("offload.threads", 4, "offload pool thread count");
+
+    static ConfigVar<uint32_t>::ptr g_offload_max_queue =
+        Config::Lookup<uint32_t>("offload.max_queue", 1024, "offload pool max queued and running tasks");
+
+    OffloadPool::OffloadPool(size_t threads, size_t max_queue, const std::string& name)
+        : m_name(name)
+        , m_maxQueue(max_queue)
+        , m_slots(max_queue)
+    {
+        WYZE_ASSERT(threads > 0 && max_queue > 0);
+        for(size_t i = 0; i < threads; ++i) {
+            m_threads.push_back(Thread::ptr(new Thread(std::bind(&OffloadPool::work, this),
+                                            m_name + "_" + std::to_string(i))));
+        }
+    }
+
+    OffloadPool::~OffloadPool()
+    {
+        stop();
+    }
+
+    void OffloadPool::stop()
+    {
+        {
+            Mutex::Lock lock(m_mutex);
+            if(m_stopping) {
+                return;
+            }
+            m_stopping = true;
+        }
+        for(size_t i = 0; i < m_threads.size(); ++i) {
+            m_sem.notify();
+        }
+        for(auto& i : m_threads) {
+            i->join();
+        }
+        m_threads.clear();
+    }
+
+    OffloadPool::Stats OffloadPool::getStats() const
+    {
+        Stats stats;
+        stats.submitted = m_submitted;
+        stats.completed = m_completed;
+        stats.inlined = m_inlined;
+        stats.queue_full = m_queueFull;
+        stats.queue_depth = m_depth;
+        stats.max_queue_depth = m_maxDepth;
+        stats.total_wait_us = m_totalWaitUs;
+        stats.max_wait_us = m_maxWaitUs;
+        stats.total_run_us = m_totalRunUs;
+        stats.max_run_us = m_maxRunUs;
+        return stats;
+    }
+
+    OffloadPool* OffloadPool::GetDefault()
+    {
+        static OffloadPool s_pool(g_offload_threads->getValue(), g_offload_max_queue->getValue(), "offload");
+        return &s_pool;
+    }
+
+    void OffloadPool::execute(std::function<void()> cb)
+    {
+        //共享栈协程挂起后栈会被换出，cb 可能引用协程栈上的变量，只能在当前线程执行
+        if(m_stopping || !Fiber::InScheduledFiber() || Fiber::GetThis()->isSharedStack()) {
+            ++m_inlined;
+            cb();
+            return;
+        }
+
+        if(!m_slots.tryWait()) {
+            ++m_queueFull;
+            m_slots.wait();
+        }
+
+        Task* task = new Task;
+        task->cb = std::move(cb);
+        task->waiter.scheduler = Scheduler::GetThis();
+        task->waiter.fiber = Fiber::GetThis();
+        task->enqueue_us = GetCurrentUS();
+        {
+            Mutex::Lock lock(m_mutex);
+            if(m_stopping) {
+                lock.unlock();
+                m_slots.notify();
+                ++m_inlined;
+                task->cb();
+                delete task;
+                return;
+            }
+            ++m_submitted;
+            UpdateMax(m_maxDepth, ++m_depth);
+            m_tasks.push_back(task);
+        }
+        m_sem.notify();
+        Fiber::YeildToHold();   //任务结束后由工作线程放回调度器
+    }
+
+    void OffloadPool::work()
+    {
+        while(true) {
+            m_sem.wait();
+            Task* task = nullptr;
+            {
+                Mutex::Lock lock(m_mutex);
+                if(m_tasks.empty()) {
+                    if(m_stopping) {
+                        break;
+                    }
+                    continue;
+                }
+                task = m_tasks.front();
+                m_tasks.pop_front();
+            }
+
+            uint64_t start = GetCurrentUS();
+            uint64_t wait = start - task->enqueue_us;
+            task->cb();     //OffloadResult 已经捕获了异常
+            uint64_t run = GetCurrentUS() - start;
+
+            m_totalWaitUs += wait;
+            UpdateMax(m_maxWaitUs, wait);
+            m_totalRunUs += run;
+            UpdateMax(m_maxRunUs, run);
+            ++m_completed;
+            --m_depth;
+
+            FiberWaiter waiter = std::move(task->waiter);
+            delete task;
+            m_slots.notify();
+            waiter.wake();
+        }
+        WYZE_LOG_DEBUG(g_logger) << "offload thread " << Thread::GetName() << " exit";
+    }
+
+    void OffloadPool::UpdateMax(std::atomic<uint64_t>& max, uint64_t v)
+    {
+        uint64_t cur = max.load(std::memory_order_relaxed);
+        while(v > cur && !max.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+        }
+    }
+
+}
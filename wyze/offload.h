@@ -0,0 +1,146 @@
+#ifndef _WYZE_OFFLOAD_H_
+#define _WYZE_OFFLOAD_H_
+
+#include <memory>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <exception>
+#include <functional>
+#include "thread.h"
+#include "fiber.h"
+#include "fibersync.h"
+
+namespace wyze {
+
+    namespace detail {
+
+        //任务结果放在堆上：调用协程挂起时栈可能被换出（共享栈），工作线程不能写协程栈
+        template<class R>
+        struct OffloadResult {
+            std::unique_ptr<R> value;
+            std::exception_ptr exception;
+
+            template<class F>
+            void call(F& fn) {
+                try {
+                    value.reset(new R(fn()));
+                } catch(...) {
+                    exception = std::current_exception();
+                }
+            }
+            R get() {
+                if(exception) {
+                    std::rethrow_exception(exception);
+                }
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct OffloadResult<void> {
+            std::exception_ptr exception;
+
+            template<class F>
+            void call(F& fn) {
+                try {
+                    fn();
+                } catch(...) {
+                    exception = std::current_exception();
+                }
+            }
+            void get() {
+                if(exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+    }
+
+    //执行阻塞调用（文件 IO、getaddrinfo、MySQL、RSA 等）的线程池。
+    //在协程中调用 run 时挂起当前协程，任务在池中的线程上执行，结束后把协程放回原来的调度器，
+    //调度线程可以继续执行其他协程；不在协程中、池已经停止或者共享栈协程中调用时直接在当前线程执行
+    class OffloadPool : Noncopyable {
+    public:
+        using ptr = std::shared_ptr<OffloadPool>;
+
+        struct Stats {
+            uint64_t submitted = 0;     //交给线程池执行的任务数
+            uint64_t completed = 0;
+            uint64_t inlined = 0;       //直接在调用线程执行的任务数
+            uint64_t queue_full = 0;    //队列满时等待空位的次数
+            uint64_t queue_depth = 0;   //当前排队和执行中的任务数
+            uint64_t max_queue_depth = 0;
+            uint64_t total_wait_us = 0; //在队列中等待的总时间
+            uint64_t max_wait_us = 0;
+            uint64_t total_run_us = 0;  //执行的总时间
+            uint64_t max_run_us = 0;
+        };
+
+        //max_queue 是排队加执行中的任务上限，超过时调用协程挂起等待空位
+        OffloadPool(size_t threads, size_t max_queue, const std::string& name = "offload");
+        ~OffloadPool();
+
+        //执行 fn 并返回结果，fn 抛出的异常在调用协程中重新抛出
+        template<class F>
+        auto run(F fn) -> decltype(fn()) {
+            typedef decltype(fn()) R;
+            std::shared_ptr<detail::OffloadResult<R>> result = std::make_shared<detail::OffloadResult<R>>();
+            execute([result, fn]() mutable {
+                result->call(fn);
+            });
+            return result->get();
+        }
+
+        void stop();    //执行完已经提交的任务后退出线程
+        Stats getStats() const;
+        size_t getThreadCount() const { return m_threads.size(); }
+        size_t getMaxQueue() const { return m_maxQueue; }
+
+        //默认线程池，线程数和队列上限由 offload.threads 和 offload.max_queue 配置
+        static OffloadPool* GetDefault();
+
+    private:
+        struct Task {
+            std::function<void()> cb;
+            FiberWaiter waiter;
+            uint64_t enqueue_us = 0;
+        };
+
+        void execute(std::function<void()> cb);
+        void work();
+        static void UpdateMax(std::atomic<uint64_t>& max, uint64_t v);
+
+    private:
+        std::string m_name;
+        size_t m_maxQueue;
+        std::vector<Thread::ptr> m_threads;
+        Mutex m_mutex;
+        std::deque<Task*> m_tasks;
+        Semaphore m_sem;                    //通知工作线程有新任务
+        FiberSemaphore m_slots;             //队列中的空位
+        std::atomic<bool> m_stopping = {false};
+
+        std::atomic<uint64_t> m_submitted = {0};
+        std::atomic<uint64_t> m_completed = {0};
+        std::atomic<uint64_t> m_inlined = {0};
+        std::atomic<uint64_t> m_queueFull = {0};
+        std::atomic<uint64_t> m_depth = {0};
+        std::atomic<uint64_t> m_maxDepth = {0};
+        std::atomic<uint64_t> m_totalWaitUs = {0};
+        std::atomic<uint64_t> m_maxWaitUs = {0};
+        std::atomic<uint64_t> m_totalRunUs = {0};
+        std::atomic<uint64_t> m_maxRunUs = {0};
+    };
+
+    //在默认线程池中执行阻塞调用，调用协程挂起等待结果
+    template<class F>
+    inline auto Offload(F fn) -> decltype(fn()) {
+        return OffloadPool::GetDefault()->run(std::move(fn));
+    }
+
+}
+
+#endif // !_WYZE_OFFLOAD_H_
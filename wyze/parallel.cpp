@@ -0,0 +1,108 @@
+#include "parallel.h"
+#include "macro.h"
+
+namespace wyze {
+
+    ParallelJob::ParallelJob(Scheduler* sched, size_t begin, size_t end, size_t grain, Body body)
+        : m_scheduler(sched)
+        , m_grain(grain ? grain : 1)
+        , m_maxHelpers(sched->getWorkerCount())
+        , m_body(std::move(body))
+        , m_remaining(end - begin)
+    {
+        WYZE_ASSERT(begin < end);
+        m_ranges.push_back(std::make_pair(begin, end));
+    }
+
+    void ParallelJob::run()
+    {
+        //共享栈协程挂起后栈会被换出，而区间函数引用了调用者栈上的变量，只能阻塞线程等待
+        m_inFiber = Fiber::InScheduledFiber() && !Fiber::GetThis()->isSharedStack();
+        while(runOne());
+
+        if(m_remaining > 0) {   //其他线程上还有区间在执行
+            if(m_inFiber) {
+                m_fiberDone.wait();
+            }
+            else {
+                m_threadDone.wait();
+            }
+        }
+        if(m_failed) {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+    bool ParallelJob::pop(std::pair<size_t, size_t>& range)
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(m_ranges.empty()) {
+            return false;
+        }
+        range = m_ranges.back();
+        m_ranges.pop_back();
+        return true;
+    }
+
+    void ParallelJob::push(size_t begin, size_t end)
+    {
+        {
+            SpinLock::Lock lock(m_mutex);
+            m_ranges.push_back(std::make_pair(begin, end));
+        }
+        size_t helpers = m_helpers;
+        while(helpers < m_maxHelpers) {
+            if(m_helpers.compare_exchange_weak(helpers, helpers + 1)) {
+                ParallelJob::ptr self = shared_from_this();
+                m_scheduler->schedule([self]() {
+                    self->help();
+                });
+                break;
+            }
+        }
+    }
+
+    bool ParallelJob::runOne()
+    {
+        std::pair<size_t, size_t> range;
+        if(!pop(range)) {
+            return false;
+        }
+        size_t begin = range.first;
+        size_t end = range.second;
+        while(end - begin > m_grain) {
+            size_t mid = begin + (end - begin) / 2;
+            push(mid, end);     //右半部分交给其他线程，自己继续拆分左半部分
+            end = mid;
+        }
+
+        if(!m_failed) {         //已经出错时只统计，不再执行
+            try {
+                m_body(begin, end);
+            } catch(...) {
+                SpinLock::Lock lock(m_mutex);
+                if(!m_exception) {
+                    m_exception = std::current_exception();
+                }
+                m_failed = true;
+            }
+        }
+
+        if((m_remaining -= end - begin) == 0) {
+            if(m_inFiber) {
+                m_fiberDone.notify();
+            }
+            else {
+                m_threadDone.notify();
+            }
+        }
+        return true;
+    }
+
+    void ParallelJob::help()
+    {
+        while(runOne());
+        --m_helpers;
+    }
+
+}
@@ -0,0 +1,93 @@
+#ifndef _WYZE_PARALLEL_H_
+#define _WYZE_PARALLEL_H_
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <exception>
+#include <functional>
+#include "thread.h"
+#include "scheduler.h"
+#include "fibersync.h"
+
+namespace wyze {
+
+    //一次 parallel_for/parallel_reduce 的执行状态。
+    //区间放在栈中，取出的区间大于 grain 时不断对半拆分，右半部分压回栈中，
+    //每次拆分时如果帮忙的任务少于调度线程数，再 schedule 一个帮忙的任务，由各线程窃取执行。
+    //调用者自己也执行区间，执行完后只挂起当前协程等待其他线程上的区间结束
+    class ParallelJob : Noncopyable, public std::enable_shared_from_this<ParallelJob> {
+    public:
+        using ptr = std::shared_ptr<ParallelJob>;
+        using Body = std::function<void(size_t, size_t)>;   //执行 [begin, end)
+
+        ParallelJob(Scheduler* sched, size_t begin, size_t end, size_t grain, Body body);
+
+        //执行并等待全部区间结束，区间中抛出的第一个异常在这里重新抛出
+        void run();
+
+    private:
+        bool pop(std::pair<size_t, size_t>& range);
+        void push(size_t begin, size_t end);
+        bool runOne();      //取出一个区间拆分并执行，没有区间时返回 false
+        void help();        //在调度线程上帮忙执行区间
+
+    private:
+        Scheduler* m_scheduler;
+        size_t m_grain;
+        size_t m_maxHelpers;
+        Body m_body;
+        SpinLock m_mutex;
+        std::vector<std::pair<size_t, size_t>> m_ranges;
+        std::atomic<size_t> m_helpers = {0};    //正在执行的帮忙任务数
+        std::atomic<size_t> m_remaining;        //还没有执行完的元素数
+        std::atomic<bool> m_failed = {false};   //有区间抛出了异常
+        std::exception_ptr m_exception;         //由 m_mutex 保护
+        bool m_inFiber = false;                 //调用者是否在调度器的协程中
+        FiberSemaphore m_fiberDone;
+        Semaphore m_threadDone;
+    };
+
+    //在 sched 的线程上并行执行 fn(i)，i 属于 [begin, end)，每个区间至少 grain 个元素。
+    //可以在任意线程或协程中调用，调用者也会执行一部分区间
+    template<class F>
+    void parallel_for(Scheduler* sched, size_t begin, size_t end, size_t grain, F fn) {
+        if(begin >= end) {
+            return;
+        }
+        ParallelJob::ptr job = std::make_shared<ParallelJob>(sched, begin, end, grain,
+            [&fn](size_t b, size_t e) {
+                for(size_t i = b; i < e; ++i) {
+                    fn(i);
+                }
+            });
+        job->run();
+    }
+
+    //并行计算 reduce(identity, map(begin), ..., map(end - 1))，区间的合并顺序不确定，
+    //reduce 需要满足结合律和交换律
+    template<class T, class Map, class Reduce>
+    T parallel_reduce(Scheduler* sched, size_t begin, size_t end, size_t grain,
+                      T identity, Map map, Reduce reduce) {
+        T result = identity;
+        if(begin >= end) {
+            return result;
+        }
+        SpinLock mutex;
+        ParallelJob::ptr job = std::make_shared<ParallelJob>(sched, begin, end, grain,
+            [&](size_t b, size_t e) {
+                T acc = identity;
+                for(size_t i = b; i < e; ++i) {
+                    acc = reduce(std::move(acc), map(i));
+                }
+                SpinLock::Lock lock(mutex);
+                result = reduce(std::move(result), std::move(acc));
+            });
+        job->run();
+        return result;
+    }
+
+}
+
+#endif // !_WYZE_PARALLEL_H_
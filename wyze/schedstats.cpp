@@ -0,0 +1,133 @@
+#include "schedstats.h"
+#include <sstream>
+#include <iomanip>
+
+namespace wyze {
+
+    static uint64_t BucketUpper(size_t idx)
+    {
+        return idx ? (1ull << idx) - 1 : 0;
+    }
+
+    void LatencyHistogram::Snapshot::merge(const Snapshot& rhs)
+    {
+        for(size_t i = 0; i < BUCKETS; ++i) {
+            buckets[i] += rhs.buckets[i];
+        }
+        count += rhs.count;
+        sum += rhs.sum;
+        if(rhs.max > max) {
+            max = rhs.max;
+        }
+    }
+
+    uint64_t LatencyHistogram::Snapshot::percentile(double p) const
+    {
+        if(count == 0) {
+            return 0;
+        }
+        uint64_t target = (uint64_t)(count * p);
+        if(target >= count) {
+            target = count - 1;
+        }
+        uint64_t seen = 0;
+        for(size_t i = 0; i < BUCKETS; ++i) {
+            seen += buckets[i];
+            if(seen > target) {
+                uint64_t upper = BucketUpper(i);
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+    std::string LatencyHistogram::Snapshot::toString() const
+    {
+        std::stringstream ss;
+        ss << "count=" << count << " mean=" << mean() << "us"
+           << " p50=" << percentile(0.5) << "us"
+           << " p99=" << percentile(0.99) << "us"
+           << " p999=" << percentile(0.999) << "us"
+           << " max=" << max << "us";
+        return ss.str();
+    }
+
+    LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+    {
+        Snapshot s;
+        for(size_t i = 0; i < BUCKETS; ++i) {
+            s.buckets[i] = m_buckets[i].get();
+        }
+        s.count = m_count.get();
+        s.sum = m_sum.get();
+        s.max = m_max.get();
+        return s;
+    }
+
+    void SchedulerStats::Thread::merge(const Thread& rhs)
+    {
+        switches += rhs.switches;
+        run_us += rhs.run_us;
+        idle_us += rhs.idle_us;
+        idles += rhs.idles;
+        queue_wait.merge(rhs.queue_wait);
+        run_slice.merge(rhs.run_slice);
+    }
+
+    std::string SchedulerStats::toString(const SchedulerStats* prev) const
+    {
+        std::stringstream ss;
+        ss << "scheduler " << name
+           << " active_threads=" << active_threads
+           << " idle_threads=" << idle_threads
+           << " pending_tasks=" << pending_tasks
+           << " tickles=" << tickles
+           << " useful_wakeups=" << useful_wakeups
+           << " suppressed_wakeups=" << suppressed_wakeups
+           << " spin_hits=" << spin_hits
+           << " spin_misses=" << spin_misses
+           << " parks=" << parks << "\n";
+        if(elastic) {
+            ss << "  workers=" << workers << " (" << min_workers << "-" << max_workers << ")"
+               << " grow_queue_wait=" << grow_queue_wait
+               << " grow_stuck=" << grow_stuck
+               << " retired=" << retired << "\n";
+        }
+        if(high_dispatches || low_dispatches) {
+            ss << "  high_dispatches=" << high_dispatches
+               << " low_dispatches=" << low_dispatches
+               << " low_aged=" << low_aged << "\n";
+        }
+        if(!enabled) {
+            ss << "  counters disabled, build with WYZE_SCHED_STATS\n";
+            return ss.str();
+        }
+
+        ss << "  switches=" << total.switches
+           << " run=" << total.run_us << "us"
+           << " idle=" << total.idle_us << "us"
+           << " idles=" << total.idles << "\n";
+        if(prev && prev->enabled && timestamp_us > prev->timestamp_us
+                && prev->threads.size() == threads.size()) {
+            uint64_t elapsed = timestamp_us - prev->timestamp_us;
+            ss << std::fixed << std::setprecision(1)
+               << "  interval=" << elapsed / 1000 << "ms"
+               << " switches/s=" << (total.switches - prev->total.switches) * 1e6 / elapsed
+               << " busy=" << (total.run_us - prev->total.run_us) * 100.0 / elapsed / threads.size() << "%"
+               << " idle=" << (total.idle_us - prev->total.idle_us) * 100.0 / elapsed / threads.size() << "%\n";
+        }
+        ss << "  queue_wait " << total.queue_wait.toString() << "\n"
+           << "  run_slice " << total.run_slice.toString() << "\n";
+        for(size_t i = 0; i < threads.size(); ++i) {
+            const Thread& t = threads[i];
+            ss << "  [" << i << "] switches=" << t.switches
+               << " run=" << t.run_us << "us"
+               << " idle=" << t.idle_us << "us"
+               << " queue_wait_p99=" << t.queue_wait.percentile(0.99) << "us"
+               << " run_slice_p99=" << t.run_slice.percentile(0.99) << "us"
+               << " run_slice_max=" << t.run_slice.max << "us\n";
+        }
+        return ss.str();
+    }
+
+}
@@ -0,0 +1,116 @@
+#ifndef _WYZE_SCHEDSTATS_H_
+#define _WYZE_SCHEDSTATS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace wyze {
+
+    //只有一个线程写、其他线程读的计数器，写入不需要原子加
+    class StatCounter {
+    public:
+        void add(uint64_t v) {
+            m_value.store(m_value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+        }
+        void setMax(uint64_t v) {
+            if(v > m_value.load(std::memory_order_relaxed)) {
+                m_value.store(v, std::memory_order_relaxed);
+            }
+        }
+        uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> m_value = {0};
+    };
+
+    //以 2 的幂分桶的耗时直方图(微秒)，第 i 个桶记录 [2^(i-1), 2^i) 的样本，第 0 个桶记录 0
+    class LatencyHistogram {
+    public:
+        static const size_t BUCKETS = 32;
+
+        struct Snapshot {
+            uint64_t buckets[BUCKETS] = {0};
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+
+            void merge(const Snapshot& rhs);
+            uint64_t mean() const { return count ? sum / count : 0; }
+            uint64_t percentile(double p) const;    //返回所在桶的上界，p 取值 0~1
+            std::string toString() const;
+        };
+
+        void add(uint64_t us) {
+            size_t idx = us ? 64 - __builtin_clzll(us) : 0;
+            m_buckets[idx < BUCKETS ? idx : BUCKETS - 1].add(1);
+            m_count.add(1);
+            m_sum.add(us);
+            m_max.setMax(us);
+        }
+
+        Snapshot snapshot() const;
+
+    private:
+        StatCounter m_buckets[BUCKETS];
+        StatCounter m_count;
+        StatCounter m_sum;
+        StatCounter m_max;
+    };
+
+    //单个调度线程的统计，只由该线程写入
+    struct SchedThreadCounters {
+        StatCounter switches;           //切换到任务协程的次数
+        StatCounter runUs;              //执行任务的总时间
+        StatCounter idleUs;             //在 idle 协程中的总时间
+        StatCounter idles;              //进入 idle 的次数
+        LatencyHistogram queueWait;     //任务从放入队列到开始执行的时间
+        LatencyHistogram runSlice;      //每次切入任务协程到切回的时间
+    };
+
+    //Scheduler::getStats 返回的快照
+    struct SchedulerStats {
+        struct Thread {
+            uint64_t switches = 0;
+            uint64_t run_us = 0;
+            uint64_t idle_us = 0;
+            uint64_t idles = 0;
+            LatencyHistogram::Snapshot queue_wait;
+            LatencyHistogram::Snapshot run_slice;
+
+            void merge(const Thread& rhs);
+        };
+
+        bool enabled = false;           //编译时是否打开了 WYZE_SCHED_STATS
+        std::string name;
+        uint64_t timestamp_us = 0;      //单调时钟
+        size_t active_threads = 0;      //正在执行任务的线程数
+        size_t idle_threads = 0;        //在 idle 协程中的线程数
+        size_t pending_tasks = 0;       //所有队列中等待执行的任务数
+        uint64_t tickles = 0;
+        uint64_t useful_wakeups = 0;
+        uint64_t suppressed_wakeups = 0;
+        uint64_t spin_hits = 0;         //空闲自旋期间等到任务的次数
+        uint64_t spin_misses = 0;
+        uint64_t parks = 0;
+        bool elastic = false;           //是否配置了 scheduler.elastic
+        size_t workers = 0;             //当前创建的线程数，不含 use_caller 的线程
+        size_t min_workers = 0;
+        size_t max_workers = 0;
+        uint64_t grow_queue_wait = 0;   //因为排队时间过长增加线程的次数
+        uint64_t grow_stuck = 0;        //因为线程卡在一个协程中增加线程的次数
+        uint64_t retired = 0;           //空闲退出的线程数
+        uint64_t high_dispatches = 0;   //执行的高优先级任务数
+        uint64_t low_dispatches = 0;    //执行的低优先级任务数
+        uint64_t low_aged = 0;          //等待过久、先于普通任务执行的低优先级任务数
+        Thread total;                   //所有线程的合计
+        std::vector<Thread> threads;    //按本地队列下标
+
+        //prev 不为空时输出两次快照之间的速率(切换/秒、线程利用率)
+        std::string toString(const SchedulerStats* prev = nullptr) const;
+    };
+
+}
+
+#endif // !_WYZE_SCHEDSTATS_H_
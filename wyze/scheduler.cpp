@@ -2,13 +2,168 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "util.h"
+#include "config.h"
+#include "affinity.h"
+#include <stdio.h>
 #include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <algorithm>
 
 namespace wyze {
 
     static Logger::ptr g_logger = WYZE_LOG_NAME("system");
     static thread_local Scheduler* t_scheduler = nullptr;   //每个线程都会保存调度器对象
     static thread_local Fiber* t_fiber = nullptr;       //每个线程都会有住协程，切换回到 run 方法中运行
+    static thread_local int t_queueIndex = -1;          //当前线程在 run 中使用的本地队列下标
+    static thread_local bool t_searching = false;       //当前线程是否计入 m_searchingCount
+    static thread_local bool t_tickled = false;         //当前线程是否被定向唤醒，还没拿到任务
+
+    static thread_local uint64_t t_sliceStartUs = 0;    //当前任务开始执行的时间
+    static thread_local bool t_sliceLogged = false;     //本次执行是否已经打印过调用栈
+    static thread_local uint64_t t_dispatches = 0;      //当前线程取到的任务数
+    static thread_local uint64_t t_spinDispatches = 0;  //上一次自旋时的 t_dispatches
+    static thread_local uint64_t t_spinUs = 0;          //当前线程的自旋时长，根据命中情况调整
+    static thread_local uint64_t t_busyDispatches = 0;  //上一次忙轮询用完预算时的 t_dispatches
+    static thread_local bool t_busyExhausted = false;   //上一次忙轮询是否用完了预算
+    static thread_local uint64_t t_highStreak = 0;      //当前线程连续执行的高优先级任务数
+
+    static const size_t MAX_INJECT_BATCH = 32;          //从全局队列一次最多搬运到本地队列的任务数
+    static const uint64_t SLICE_UNSTAMPED = 1;          //任务正在执行，但取任务时没有读取时钟
+
+    static ConfigVar<uint64_t>::ptr g_slice_budget =
+        Config::Lookup<uint64_t>("scheduler.slice_budget_us", 10000, "maybe_yield yields after a fiber ran this long");
+    static ConfigVar<uint64_t>::ptr g_slice_warn =
+        Config::Lookup<uint64_t>("scheduler.slice_warn_ms", 100, "warn when a fiber runs this long without yielding, 0 to disable");
+
+    static ConfigVar<uint64_t>::ptr g_idle_spin =
+        Config::Lookup<uint64_t>("scheduler.idle_spin_us", 50, "max time an idle worker spins for new tasks before parking, 0 to disable");
+    static ConfigVar<std::map<std::string, std::string>>::ptr g_scheduler_cpus =
+        Config::Lookup<std::map<std::string, std::string>>("scheduler.cpus", {}
+                , "scheduler name to cpu list of its worker threads, e.g. io: \"0-3\" or io: \"0-1;2-3\"");
+
+    static ConfigVar<std::map<std::string, std::string>>::ptr g_scheduler_elastic =
+        Config::Lookup<std::map<std::string, std::string>>("scheduler.elastic", {}
+                , "scheduler name to \"min-max\" worker threads, enables adding and retiring threads under load");
+    static ConfigVar<uint64_t>::ptr g_elastic_queue_wait =
+        Config::Lookup<uint64_t>("scheduler.elastic_queue_wait_ms", 20, "elastic scheduler adds a thread when a task waited this long in queue");
+    static ConfigVar<uint64_t>::ptr g_elastic_stuck =
+        Config::Lookup<uint64_t>("scheduler.elastic_stuck_ms", 200, "elastic scheduler adds a thread when a worker is stuck in one fiber this long");
+    static ConfigVar<uint64_t>::ptr g_elastic_idle =
+        Config::Lookup<uint64_t>("scheduler.elastic_idle_ms", 10000, "elastic scheduler retires a thread idle this long");
+
+    static ConfigVar<uint64_t>::ptr g_high_burst =
+        Config::Lookup<uint64_t>("scheduler.high_priority_burst", 16, "max high priority tasks a worker runs in a row while other tasks wait, 0 for no limit");
+    static ConfigVar<uint64_t>::ptr g_low_aging =
+        Config::Lookup<uint64_t>("scheduler.low_priority_aging_ms", 100, "low priority task waited this long runs ahead of normal tasks, 0 to disable");
+
+    static uint64_t s_slice_budget_us = 0;
+    static uint64_t s_slice_warn_us = 0;
+    static uint64_t s_idle_spin_us = 0;
+    static uint64_t s_elastic_queue_wait_us = 0;
+    static uint64_t s_elastic_stuck_us = 0;
+    static uint64_t s_elastic_idle_ms = 0;
+    static uint64_t s_high_burst = 0;
+    static uint64_t s_low_aging_us = 0;
+
+    //只有一个 CPU 时自旋只会占用要放任务进来的线程的时间
+    static uint64_t IdleSpinUs(uint64_t value)
+    {
+        return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? value : 0;
+    }
+
+    struct _SchedulerIniter {
+        _SchedulerIniter() {
+            s_slice_budget_us = g_slice_budget->getValue();
+            s_slice_warn_us = g_slice_warn->getValue() * 1000;
+            s_idle_spin_us = IdleSpinUs(g_idle_spin->getValue());
+            s_elastic_queue_wait_us = g_elastic_queue_wait->getValue() * 1000;
+            s_elastic_stuck_us = g_elastic_stuck->getValue() * 1000;
+            s_elastic_idle_ms = g_elastic_idle->getValue();
+            s_high_burst = g_high_burst->getValue();
+            s_low_aging_us = g_low_aging->getValue() * 1000;
+
+            g_slice_budget->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                WYZE_LOG_INFO(g_logger) << "scheduler slice budget changed from "
+                                        << old_value << " to " << new_value;
+                s_slice_budget_us = new_value;
+            });
+            g_slice_warn->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                WYZE_LOG_INFO(g_logger) << "scheduler slice warn changed from "
+                                        << old_value << " to " << new_value;
+                s_slice_warn_us = new_value * 1000;
+            });
+            g_idle_spin->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                WYZE_LOG_INFO(g_logger) << "scheduler idle spin changed from "
+                                        << old_value << " to " << new_value;
+                s_idle_spin_us = IdleSpinUs(new_value);
+            });
+            g_elastic_queue_wait->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                s_elastic_queue_wait_us = new_value * 1000;
+            });
+            g_elastic_stuck->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                s_elastic_stuck_us = new_value * 1000;
+            });
+            g_elastic_idle->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                s_elastic_idle_ms = new_value;
+            });
+            g_high_burst->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                s_high_burst = new_value;
+            });
+            g_low_aging->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                s_low_aging_us = new_value * 1000;
+            });
+        }
+    };
+
+    static _SchedulerIniter s_scheduler_initer;
+
+    //检测长时间没有让出的协程，并驱动弹性调度器增加线程：后台线程定期扫描所有运行中的调度器。
+    //对象在第一次使用时创建且不释放，避免进程退出时线程还在访问
+    struct SliceWatchdog {
+        Mutex mutex;
+        std::vector<Scheduler*> schedulers;
+        Thread::ptr thread;
+
+        static SliceWatchdog* Get() {
+            static SliceWatchdog* s_watchdog = new SliceWatchdog;
+            return s_watchdog;
+        }
+
+        void add(Scheduler* sched) {
+            Mutex::Lock lock(mutex);
+            schedulers.push_back(sched);
+            if(!thread) {
+                thread.reset(new Thread(std::bind(&SliceWatchdog::run, this), "slice_watchdog"));
+            }
+        }
+
+        void del(Scheduler* sched) {
+            Mutex::Lock lock(mutex);
+            auto it = std::find(schedulers.begin(), schedulers.end(), sched);
+            if(it != schedulers.end()) {
+                schedulers.erase(it);
+            }
+        }
+
+        void run() {
+            while(true) {
+                uint64_t warn_us = s_slice_warn_us;
+                usleep(warn_us ? std::min<uint64_t>(warn_us / 4, 100 * 1000) : 100 * 1000);
+                uint64_t now = GetMonotonicUS();
+                Mutex::Lock lock(mutex);
+                for(auto& i : schedulers) {
+                    if(warn_us) {
+                        i->checkSlices(now, warn_us);
+                    }
+                    i->checkElastic(now);
+                }
+            }
+        }
+    };
 
     Scheduler::Scheduler(size_t threads, 
         bool use_caller, const std::string& name)
@@ -35,14 +190,51 @@ namespace wyze {
             m_rootThread = -1;
         }
         m_threadCount = threads;    //在run中会创建线程数
+
+        auto elastic = g_scheduler_elastic->getValue();
+        auto it = elastic.find(m_name);
+        if(it != elastic.end()) {
+            size_t min_workers = 0;
+            size_t max_workers = 0;
+            if(sscanf(it->second.c_str(), "%zu-%zu", &min_workers, &max_workers) == 2
+                    && min_workers <= max_workers && max_workers > 0) {
+                m_elastic = true;
+                m_minWorkers = std::max<size_t>(min_workers, m_rootThread != -1 ? 0 : 1);
+                m_maxWorkers = std::max(max_workers, m_minWorkers);
+                m_threadCount = std::min(std::max(m_threadCount, m_minWorkers), m_maxWorkers);
+            }
+            else {
+                WYZE_LOG_ERROR(g_logger) << "scheduler " << m_name << " invalid scheduler.elastic=" << it->second;
+            }
+        }
+
+#ifdef WYZE_SCHED_STATS
+        m_timeDispatch = true;
+#else
+        m_timeDispatch = m_elastic;
+#endif
+
+        //弹性模式按最大线程数创建本地队列，增加的线程使用空出来的队列
+        size_t queue_count = (m_elastic ? m_maxWorkers : m_threadCount) + (m_rootThread != -1 ? 1 : 0);
+        for(size_t i = 0; i < queue_count; ++i) {
+            m_queues.push_back(new WorkQueue);
+        }
+        if(m_rootThread != -1) {
+            m_queues[0]->threadId = m_rootThread;
+        }
     }
 
     Scheduler::~Scheduler()
     {
         WYZE_ASSERT(m_stopping);
+        SliceWatchdog::Get()->del(this);
         if(GetThis() == this) {
             t_scheduler = nullptr;
         }
+
+        for(auto& i : m_queues) {
+            delete i;
+        }
     }
 
     //获取调度器对象
@@ -66,12 +258,23 @@ namespace wyze {
         m_stopping = false;
         WYZE_ASSERT(m_threads.empty());
 
-        m_threads.resize(m_threadCount);    //创建对应的线程智能指针对象
+        m_cpuGroups.clear();
+        auto cpus = g_scheduler_cpus->getValue();
+        auto it = cpus.find(m_name);
+        if(it != cpus.end() && !ParseCpuGroups(it->second, m_cpuGroups)) {
+            WYZE_LOG_ERROR(g_logger) << "scheduler " << m_name << " invalid scheduler.cpus=" << it->second;
+        }
+        int first = m_rootThread != -1 ? 1 : 0;
+        m_threads.resize(m_queues.size() - first);  //创建对应的线程智能指针对象
         for(size_t i = 0; i < m_threadCount; ++i) {
-            m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this)
+            m_queues[i + first]->active = true;
+            m_threads[i].reset(new Thread(std::bind(&Scheduler::workerMain, this, i + first)
                                     , m_name + "_" + std::to_string(i)));
             m_threadIds.push_back(m_threads[i]->getId());   //这里能获取到是因为 Semaphore 起到了作用
         }
+        m_liveWorkers = m_threadCount;
+        lock.unlock();
+        SliceWatchdog::Get()->add(this);
     }
 
     void Scheduler::stop()
@@ -96,12 +299,7 @@ namespace wyze {
         }
 
         m_stopping = true;
-        for(size_t i = 0; i < m_threadCount; ++i) {
-            tickle();
-        }
-
-        if(m_rootFiber) 
-            tickle();
+        tickleAll();
 
         if(m_rootFiber) {
             if(!stopping()) {   //不具备停止的条件
@@ -116,16 +314,624 @@ namespace wyze {
         }
 
         for(auto& i : thrs) {
-            i->join();
+            if(i) {
+                i->join();
+            }
         }
-
+        SliceWatchdog::Get()->del(this);
     }
 
-    //唤醒调度器
+    //唤醒一个空闲线程：已经有线程在找任务时，它会拿到新任务，不需要再唤醒
     void Scheduler::tickle()
     {
-        WYZE_LOG_INFO(g_logger) << "tickle";
-    }  
+        std::atomic_thread_fence(std::memory_order_seq_cst);   //与 parkBegin 中的屏障配对，避免丢失唤醒
+        if(m_searchingCount > 0) {
+            ++m_suppressedWakeups;
+            return;
+        }
+
+        MutexType::Lock lock(m_idleMutex);
+        if(m_idleStack.empty()) {
+            ++m_suppressedWakeups;
+            return;
+        }
+
+        //优先唤醒 follower，poller 被唤醒后还需要别的线程接替
+        int idx = -1;
+        for(auto it = m_idleStack.rbegin(); it != m_idleStack.rend(); ++it) {
+            if(*it != m_pollerIndex) {
+                idx = *it;
+                break;
+            }
+        }
+        if(idx == -1) {
+            idx = m_pollerIndex;
+        }
+        ++m_searchingCount;     //在唤醒前计数，后续的 schedule 不会再唤醒别的线程
+        wakeLocked(idx);
+    }
+
+    static inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    //基类没有 IO 和定时器，停车的线程都等在自己的 futex 上
+    void Scheduler::tickleWorker(int idx, bool poller)
+    {
+        WorkQueue* q = m_queues[idx];
+        q->parkWord.store(1, std::memory_order_release);
+        syscall(SYS_futex, (int*)&q->parkWord, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    void Scheduler::wakeLocked(int idx)
+    {
+        WorkQueue* q = m_queues[idx];
+        m_idleStack.erase(std::find(m_idleStack.begin(), m_idleStack.end(), idx));
+        q->parked = false;
+        q->tickled = true;
+        ++m_tickleCount;
+        tickleWorker(idx, idx == m_pollerIndex);
+    }
+
+    void Scheduler::notify(int target)
+    {
+        if(target == WAKE_ANY) {
+            tickle();
+        }
+        else if(target >= 0) {
+            MutexType::Lock lock(m_idleMutex);
+            if(m_queues[target]->parked) {     //没有停车的线程会在下一次 dequeue 时看到指定给它的任务
+                ++m_searchingCount;
+                wakeLocked(target);
+            }
+        }
+    }
+
+    void Scheduler::ticklePoller()
+    {
+        MutexType::Lock lock(m_idleMutex);
+        if(m_pollerIndex != -1) {
+            tickleWorker(m_pollerIndex, true);
+        }
+    }
+
+    void Scheduler::promotePoller()
+    {
+        MutexType::Lock lock(m_idleMutex);
+        if(m_pollerIndex != -1 || m_idleStack.empty()) {
+            return;
+        }
+        int idx = m_idleStack.back();
+        m_idleStack.pop_back();
+        m_queues[idx]->parked = false;  //不计入 tickled，醒来后会在下一次停车时成为 poller
+        ++m_promotions;
+        tickleWorker(idx, false);
+    }
+
+    void Scheduler::tickleAll()
+    {
+        MutexType::Lock lock(m_idleMutex);
+        while(!m_idleStack.empty()) {
+            int idx = m_idleStack.back();
+            m_idleStack.pop_back();
+            m_queues[idx]->parked = false;
+            tickleWorker(idx, idx == m_pollerIndex);
+        }
+    }
+
+    Scheduler::WakeupStats Scheduler::getWakeupStats() const
+    {
+        WakeupStats stats;
+        stats.tickles = m_tickleCount;
+        stats.useful = m_usefulWakeups;
+        stats.suppressed = m_suppressedWakeups;
+        stats.promotions = m_promotions;
+        stats.spin_hits = m_spinHits;
+        stats.spin_misses = m_spinMisses;
+        stats.parks = m_parks;
+        return stats;
+    }
+
+    SchedulerStats Scheduler::getStats() const
+    {
+        SchedulerStats stats;
+        stats.name = m_name;
+        stats.timestamp_us = GetMonotonicUS();
+        stats.active_threads = m_activeThreadCount;
+        stats.idle_threads = m_idleThreadCount;
+        stats.pending_tasks = m_pendingTasks;
+        stats.tickles = m_tickleCount;
+        stats.useful_wakeups = m_usefulWakeups;
+        stats.suppressed_wakeups = m_suppressedWakeups;
+        stats.spin_hits = m_spinHits;
+        stats.spin_misses = m_spinMisses;
+        stats.parks = m_parks;
+        stats.elastic = m_elastic;
+        stats.workers = m_liveWorkers;
+        stats.min_workers = m_minWorkers;
+        stats.max_workers = m_maxWorkers;
+        stats.grow_queue_wait = m_growQueueWait;
+        stats.grow_stuck = m_growStuck;
+        stats.retired = m_retired;
+        stats.high_dispatches = m_highDispatches;
+        stats.low_dispatches = m_lowDispatches;
+        stats.low_aged = m_lowAged;
+#ifdef WYZE_SCHED_STATS
+        stats.enabled = true;
+        for(auto& q : m_queues) {
+            SchedulerStats::Thread t;
+            t.switches = q->stats.switches.get();
+            t.run_us = q->stats.runUs.get();
+            t.idle_us = q->stats.idleUs.get();
+            t.idles = q->stats.idles.get();
+            t.queue_wait = q->stats.queueWait.snapshot();
+            t.run_slice = q->stats.runSlice.snapshot();
+            stats.total.merge(t);
+            stats.threads.push_back(t);
+        }
+#endif
+        return stats;
+    }
+
+    std::string Scheduler::dumpStats()
+    {
+        SchedulerStats stats = getStats();
+        MutexType::Lock lock(m_statsMutex);
+        std::string str = stats.toString(m_lastStats.timestamp_us ? &m_lastStats : nullptr);
+        m_lastStats = std::move(stats);
+        return str;
+    }
+
+    int Scheduler::GetWorkerIndex()
+    {
+        return t_queueIndex;
+    }
+
+    //停车顺序：先进入停车栈，再退出找任务状态，最后检查队列。
+    //schedule 的顺序相反：先放入任务，再检查 m_searchingCount 和停车栈，两边至少有一方能看到对方
+    Scheduler::ParkRole Scheduler::parkBegin(int idx)
+    {
+        WorkQueue* q = m_queues[idx];
+        ParkRole role = PARK_FOLLOWER;
+        {
+            MutexType::Lock lock(m_idleMutex);
+            q->parked = true;
+            q->tickled = false;
+            m_idleStack.push_back(idx);
+            if(m_pollerIndex == -1) {
+                m_pollerIndex = idx;
+                role = PARK_POLLER;
+            }
+        }
+        t_tickled = false;      //被唤醒后没有拿到任务
+        if(t_searching) {
+            t_searching = false;
+            --m_searchingCount;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(stopping() || hasWork(idx)) {
+            parkEnd(idx);
+            return PARK_NONE;
+        }
+        ++m_parks;
+        return role;
+    }
+
+    bool Scheduler::parkEnd(int idx)
+    {
+        WorkQueue* q = m_queues[idx];
+        MutexType::Lock lock(m_idleMutex);
+        if(m_pollerIndex == idx) {
+            m_pollerIndex = -1;
+        }
+        bool tickled = q->tickled;
+        q->tickled = false;
+        if(q->parked) {     //自己醒来（超时、IO 事件或者停车前发现任务）
+            q->parked = false;
+            m_idleStack.erase(std::find(m_idleStack.begin(), m_idleStack.end(), idx));
+            ++m_searchingCount;
+        }
+        else if(!tickled) { //被 tickleAll/promotePoller 唤醒，没有计入 m_searchingCount
+            ++m_searchingCount;
+        }
+        t_searching = true;
+        t_tickled = tickled;
+        return tickled;
+    }
+
+    //停车前检查：自己的队列、全局队列中可以执行的任务、其他线程可以窃取的任务
+    bool Scheduler::hasWork(int idx)
+    {
+        if(m_priorityPending > 0) {
+            return true;
+        }
+        {
+            MutexType::Lock lock(m_mutex);
+            int thread_id = GetThreadId();
+            for(auto& i : m_fibers) {
+                if(i.thread == -1 || i.thread == thread_id) {
+                    return true;
+                }
+            }
+        }
+
+        for(size_t i = 0; i < m_queues.size(); ++i) {
+            WorkQueue* q = m_queues[i];
+            MutexType::Lock lock(q->mutex);
+            if(!q->tasks.empty() || ((int)i == idx && !q->pinned.empty())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //拿到任务：统计有效唤醒；最后一个找任务的线程拿到任务后如果还有任务，再唤醒一个线程
+    void Scheduler::foundWork()
+    {
+        if(t_tickled) {
+            t_tickled = false;
+            ++m_usefulWakeups;
+        }
+        if(t_searching) {
+            t_searching = false;
+            if(--m_searchingCount == 0 && m_pendingTasks > 0) {
+                tickle();
+            }
+        }
+    }
+
+    std::vector<int> Scheduler::getThreadIds() const
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_threadIds;
+    }
+
+    int Scheduler::getWorkerIndex(int thread) const
+    {
+        for(size_t i = 0; i < m_queues.size(); ++i) {
+            if(m_queues[i]->threadId == thread) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    //放入任务：指定线程的放入该线程的 pinned 队列，调度线程自己产生的放入本地队列，其余放入全局队列
+    int Scheduler::enqueue(FiberAndThread& ft)
+    {
+        ++m_pendingTasks;
+#ifdef WYZE_SCHED_STATS
+        ft.enqueueUs = GetMonotonicUS();
+#else
+        if(m_elastic) {
+            ft.enqueueUs = GetMonotonicUS();
+        }
+#endif
+        int self = (GetThis() == this) ? t_queueIndex : -1;
+        if(ft.fiber && ft.thread == -1) {
+            ft.thread = ft.fiber->getHomeThread();  //共享栈协程只能回到绑定的线程执行
+        }
+        if(ft.priority == PRIORITY_INHERIT) {
+            ft.priority = ft.fiber ? ft.fiber->getPriority() : PRIORITY_NORMAL;
+        }
+
+        if(ft.thread != -1) {
+            int idx = getWorkerIndex(ft.thread);
+            if(idx != -1) {
+                WorkQueue* q = m_queues[idx];
+                MutexType::Lock lock(q->mutex);
+                if(q->threadId == ft.thread) {
+                    q->pinned.push_back(std::move(ft));
+                    return idx != self ? idx : WAKE_NONE;   //只唤醒指定的线程
+                }
+                ft.thread = -1;     //指定的线程刚刚退出，交给任意线程执行
+            }
+        }
+        if(ft.thread == -1 && ft.priority != PRIORITY_NORMAL) {
+            if(ft.priority == PRIORITY_LOW && !ft.enqueueUs) {
+                ft.enqueueUs = GetMonotonicUS();    //判断是否等待过久
+            }
+            MutexType::Lock lock(m_priorityMutex);
+            (ft.priority == PRIORITY_HIGH ? m_highTasks : m_lowTasks).push_back(std::move(ft));
+            ++m_priorityPending;
+            return WAKE_ANY;
+        }
+        if(ft.thread == -1 && self != -1) {
+            WorkQueue* q = m_queues[self];
+            MutexType::Lock lock(q->mutex);
+            bool need_tickle = q->tasks.empty();    //让空闲的线程来窃取
+            q->tasks.push_back(std::move(ft));
+            return need_tickle ? WAKE_ANY : WAKE_NONE;
+        }
+
+        //非调度线程，或者指定的线程还没有运行
+        MutexType::Lock lock(m_mutex);
+        if(ft.thread != -1 && std::find(m_threadIds.begin(), m_threadIds.end(), ft.thread) == m_threadIds.end()) {
+            ft.thread = -1;     //指定的线程已经退出（或者不是调度线程），没有线程会取走它，交给任意线程执行
+        }
+        m_fibers.push_back(std::move(ft));
+        return WAKE_ANY;
+    }
+
+    //从队列中取出第一个可以执行的任务，正在其他线程上切出的协程先跳过
+    bool Scheduler::TakeRunnable(std::deque<FiberAndThread>& dq, FiberAndThread& ft)
+    {
+        for(auto it = dq.begin(); it != dq.end(); ++it) {
+            WYZE_ASSERT(it->fiber || it->cb);
+            if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+                continue;
+            }
+            ft = std::move(*it);
+            dq.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    //取任务的顺序：指定给本线程的任务，高优先级任务，等待过久的低优先级任务，本地队列，全局队列，
+    //窃取，最后才是低优先级任务。连续执行 scheduler.high_priority_burst 个高优先级任务后，
+    //先执行一个其他任务，避免普通任务饿死
+    bool Scheduler::dequeue(int idx, FiberAndThread& ft)
+    {
+        WorkQueue* q = m_queues[idx];
+        bool prio = m_priorityPending > 0;
+        {
+            MutexType::Lock lock(q->mutex);
+            if(TakeRunnable(q->pinned, ft)) {
+                return true;
+            }
+            if(!prio && TakeRunnable(q->tasks, ft)) {
+                t_highStreak = 0;
+                return true;
+            }
+        }
+
+        if(prio) {
+            if((!s_high_burst || t_highStreak < s_high_burst)
+                    && takePriority(PRIORITY_HIGH, ft, false)) {
+                ++t_highStreak;
+                return true;
+            }
+            if(takePriority(PRIORITY_LOW, ft, true)) {
+                t_highStreak = 0;
+                return true;
+            }
+            MutexType::Lock lock(q->mutex);
+            if(TakeRunnable(q->tasks, ft)) {
+                t_highStreak = 0;
+                return true;
+            }
+        }
+
+        if(takeInjected(idx, ft) || steal(idx, ft)) {
+            t_highStreak = 0;
+            return true;
+        }
+        if(m_priorityPending > 0) {     //没有其他任务时不受连续次数限制
+            if(takePriority(PRIORITY_HIGH, ft, false)) {
+                t_highStreak = 1;
+                return true;
+            }
+            if(takePriority(PRIORITY_LOW, ft, false)) {
+                t_highStreak = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //aged_only 时只取等待超过 scheduler.low_priority_aging_ms 的任务
+    bool Scheduler::takePriority(int priority, FiberAndThread& ft, bool aged_only)
+    {
+        if(aged_only && !s_low_aging_us) {
+            return false;
+        }
+        std::deque<FiberAndThread>& dq = priority == PRIORITY_HIGH ? m_highTasks : m_lowTasks;
+        MutexType::Lock lock(m_priorityMutex);
+        if(dq.empty()) {
+            return false;
+        }
+        if(aged_only && dq.front().enqueueUs + s_low_aging_us > GetMonotonicUS()) {
+            return false;
+        }
+        if(!TakeRunnable(dq, ft)) {
+            return false;
+        }
+        --m_priorityPending;
+        if(priority == PRIORITY_HIGH) {
+            ++m_highDispatches;
+        }
+        else {
+            ++m_lowDispatches;
+            if(aged_only) {
+                ++m_lowAged;
+            }
+        }
+        return true;
+    }
+
+    //从全局队列取一个任务，并顺带搬运一批到本地队列，减少对 m_mutex 的竞争
+    bool Scheduler::takeInjected(int idx, FiberAndThread& ft)
+    {
+        std::vector<FiberAndThread> batch;
+        bool found = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_fibers.empty()) {
+                return false;
+            }
+
+            size_t limit = std::min(m_fibers.size() / m_queues.size() + 1, MAX_INJECT_BATCH);
+            int thread_id = GetThreadId();
+            auto it = m_fibers.begin();
+            while(it != m_fibers.end() && batch.size() < limit) {
+                if(it->thread != -1 && it->thread != thread_id) {
+                    ++it;       //指定的线程启动后会自己从全局队列取走
+                    continue;
+                }
+
+                WYZE_ASSERT(it->fiber || it->cb);
+                if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+                    ++it;
+                    continue;
+                }
+
+                if(!found) {
+                    ft = std::move(*it);
+                    found = true;
+                }
+                else {
+                    batch.push_back(std::move(*it));
+                }
+                it = m_fibers.erase(it);
+            }
+        }
+
+        bool stealable = false;
+        if(!batch.empty()) {
+            WorkQueue* q = m_queues[idx];
+            MutexType::Lock lock(q->mutex);
+            for(auto& i : batch) {
+                if(i.thread != -1) {
+                    q->pinned.push_back(std::move(i));
+                }
+                else {
+                    q->tasks.push_back(std::move(i));
+                    stealable = true;
+                }
+            }
+        }
+        if(stealable) {
+            tickle();   //搬运期间其他线程看不到这些任务，可能已经停车
+        }
+        return found;
+    }
+
+    //从其他线程的本地队列尾部窃取一半任务
+    bool Scheduler::steal(int idx, FiberAndThread& ft)
+    {
+        size_t count = m_queues.size();
+        std::vector<FiberAndThread> stolen;
+        for(size_t i = 1; i < count && stolen.empty(); ++i) {
+            WorkQueue* victim = m_queues[(idx + i) % count];
+            MutexType::Lock lock(victim->mutex);
+            size_t n = (victim->tasks.size() + 1) / 2;
+            while(n-- > 0) {
+                stolen.push_back(std::move(victim->tasks.back()));
+                victim->tasks.pop_back();
+            }
+        }
+
+        if(stolen.empty()) {
+            return false;
+        }
+
+        WorkQueue* q = m_queues[idx];
+        MutexType::Lock lock(q->mutex);
+        for(auto it = stolen.rbegin(); it != stolen.rend(); ++it) {
+            q->tasks.push_back(std::move(*it));
+        }
+        bool found = TakeRunnable(q->tasks, ft);
+        bool left = !q->tasks.empty();
+        lock.unlock();
+        if(left) {
+            tickle();   //同 takeInjected，窃取期间任务对其他线程不可见
+        }
+        return found;
+    }
+
+    //start_us 为 0 表示取任务时没有读取时钟，开始时间由 watchdog 或 maybe_yield 第一次看到时记录
+    void Scheduler::beginSlice(WorkQueue* q, Fiber* fiber, uint64_t start_us)
+    {
+        uint64_t start = start_us ? start_us : SLICE_UNSTAMPED;
+        t_sliceStartUs = start;
+        t_sliceLogged = false;
+        q->sliceFiberId.store(fiber->getId(), std::memory_order_relaxed);
+        q->sliceReported.store(false, std::memory_order_relaxed);
+        q->sliceStartUs.store(start, std::memory_order_release);
+    }
+
+    void Scheduler::endSlice(WorkQueue* q, Fiber* fiber)
+    {
+        uint64_t start_us = q->sliceStartUs.load(std::memory_order_relaxed);
+        q->sliceStartUs.store(0, std::memory_order_relaxed);
+        t_sliceStartUs = 0;
+#ifndef WYZE_SCHED_STATS
+        if(!s_slice_warn_us || start_us == SLICE_UNSTAMPED) {   //没有被 watchdog 看到过的任务执行得不会太久
+            return;
+        }
+#endif
+        uint64_t slice = GetMonotonicUS() - start_us;
+#ifdef WYZE_SCHED_STATS
+        q->stats.switches.add(1);
+        q->stats.runUs.add(slice);
+        q->stats.runSlice.add(slice);
+#endif
+        if(s_slice_warn_us && slice >= s_slice_warn_us) {
+            WYZE_LOG_WARN(g_logger) << "scheduler " << m_name << " fiber id=" << fiber->getId()
+                                    << " ran " << slice / 1000 << "ms without yielding";
+        }
+    }
+
+    uint64_t Scheduler::SliceStart(WorkQueue* q, uint64_t now_us)
+    {
+        uint64_t start = q->sliceStartUs.load(std::memory_order_acquire);
+        if(start == SLICE_UNSTAMPED && q->sliceStartUs.compare_exchange_strong(start, now_us)) {
+            return now_us;
+        }
+        return start;
+    }
+
+    void Scheduler::checkSlices(uint64_t now_us, uint64_t warn_us)
+    {
+        for(auto& q : m_queues) {
+            uint64_t start = SliceStart(q, now_us);
+            if(!start || now_us < start + warn_us || q->sliceReported.exchange(true)) {
+                continue;
+            }
+            WYZE_LOG_WARN(g_logger) << "scheduler " << m_name << " thread " << q->threadId
+                                    << " fiber id=" << q->sliceFiberId.load(std::memory_order_relaxed)
+                                    << " running " << (now_us - start) / 1000
+                                    << "ms without yielding, starving other fibers on this thread";
+        }
+    }
+
+    bool maybe_yield()
+    {
+        if(!t_sliceStartUs || !Fiber::InScheduledFiber()) {
+            return false;
+        }
+        uint64_t now = GetMonotonicUS();
+        if(t_sliceStartUs == SLICE_UNSTAMPED) {     //取任务时没有读取时钟，从第一次调用开始计算
+            t_sliceStartUs = now;
+            return false;
+        }
+        uint64_t elapsed = now - t_sliceStartUs;
+        if(elapsed < s_slice_budget_us) {
+            return false;
+        }
+        if(s_slice_warn_us && elapsed >= s_slice_warn_us && !t_sliceLogged) {
+            t_sliceLogged = true;   //在协程自己的栈上，能拿到真正耗时的位置
+            WYZE_LOG_WARN(g_logger) << "fiber id=" << Fiber::GetFiberId() << " ran "
+                                    << elapsed / 1000 << "ms before maybe_yield\n"
+                                    << BacktraceToString(32, 2, "    ");
+        }
+        Fiber::YeildToReady();
+        return true;
+    }
+
+    void Scheduler::workerMain(int idx)
+    {
+        t_queueIndex = idx;
+        run();
+        m_queues[idx]->active = false;  //之后 spawnWorker 可以复用该队列
+    }
 
     //调度核心
     void Scheduler::run()
@@ -135,89 +941,84 @@ namespace wyze {
         setThis();      //每个线程都保存调度器对象
         if(GetThreadId() != m_rootThread) {     //如果不是创建 调度器的线程，则创建主协程
             t_fiber = Fiber::GetThis().get();
+            if(!m_cpuGroups.empty()) {  //在创建 idle 协程之前绑核，线程的栈和缓存都留在本地节点
+                size_t worker = t_queueIndex - (m_rootThread != -1 ? 1 : 0);
+                SetThreadAffinity(m_cpuGroups[worker % m_cpuGroups.size()]);
+            }
+        }
+        else {
+            t_queueIndex = 0;
         }
+        WYZE_ASSERT(t_queueIndex < (int)m_queues.size());
+        m_queues[t_queueIndex]->threadId = GetThreadId();
 
         Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));    //空闲协程，没有人物做则运行该协程
         Fiber::ptr cb_fiber;    //执行函数协程
+        WorkQueue* queue = m_queues[t_queueIndex];
+        uint64_t start_us = 0;
+#ifdef WYZE_SCHED_STATS
+        SchedThreadCounters& stats = queue->stats;
+#endif
 
         FiberAndThread ft;
         while(true) {
             ft.rest();
-            bool tickle_me = false; //唤醒别的线程
             bool is_active = false; //是否活跃
-            {   //从调度任务中，取出任务
-                MutexType::Lock lock(m_mutex);
-                auto it = m_fibers.begin();
-                while(it != m_fibers.end()) {
-                    if(it->thread != -1 && it->thread != GetThreadId()) {
-                        ++it;
-                        tickle_me = true;
-                        continue;
-                    }
-
-                    WYZE_ASSERT(it->fiber || it->cb);
-                    if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
-                        WYZE_LOG_INFO(g_logger) << "don't known fiber="<< it->fiber->getId();
-                        ++it;
-                        continue;
-                    }
-
-                    ft = *it;
-                    m_fibers.erase(it);
-                    ++m_activeThreadCount;
-                    is_active = true;
-                    break;
+            if(dequeue(t_queueIndex, ft)) {     //从调度任务中，取出任务
+                ++m_activeThreadCount;      //先增加活跃数再减少任务数，避免 stopping 误判
+                --m_pendingTasks;
+                is_active = true;
+                foundWork();
+                ++t_dispatches;
+                start_us = m_timeDispatch ? GetMonotonicUS() : 0;   //不需要排队时间时不读取时钟
+#ifdef WYZE_SCHED_STATS
+                stats.queueWait.add(start_us > ft.enqueueUs ? start_us - ft.enqueueUs : 0);
+#endif
+                if(m_elastic && ft.priority != PRIORITY_LOW && start_us > ft.enqueueUs) {  //低优先级任务本来就会等待
+                    uint64_t wait = start_us - ft.enqueueUs;
+                    uint64_t cur = m_maxQueueWaitUs.load(std::memory_order_relaxed);
+                    while(wait > cur && !m_maxQueueWaitUs.compare_exchange_weak(cur, wait));
                 }
             }
-       
-
-            if(tickle_me) 
-                tickle();
 
             //执行获取到的任务
             if(ft.fiber && (ft.fiber->getState() != Fiber::State::TERM 
                             && ft.fiber->getState() != Fiber::State::EXCEPT)) {
-                ft.fiber->swapIn();
+                ft.fiber->m_priority = ft.priority;
+                beginSlice(queue, ft.fiber.get(), start_us);
+                Fiber::State state = ft.fiber->swapIn();    //HOLD 的协程可能已经在其他线程上运行，不能再读取它的状态
                 --m_activeThreadCount;
+                endSlice(queue, ft.fiber.get());
+                flushBatch(false);
+                if(ft.fiber->isSharedStack()) {
+                    queue->sharedStack = true;
+                }
 
-                if(ft.fiber->getState() == Fiber::State::READY) {
-                    schedule(ft.fiber);
+                if(state == Fiber::State::READY) {
+                    reschedule(ft.fiber);
+                }
+                else if(state == Fiber::State::TERM || state == Fiber::State::EXCEPT) {
+                    FiberPool::Put(ft.fiber);   //已经结束且没有其他地方持有，放入缓存
                 }
-                // else if(ft.fiber->getState() != Fiber::State::TERM
-                //         && ft.fiber->getState() != Fiber::State::EXCEPT) {
-                //     ft.fiber->m_state = Fiber::HOLD;
-                //     WYZE_LOG_DEBUG(g_logger) << "fiber swapOut in Fiber::State::HOLD";
-                // }
                 ft.rest(); 
-                // usleep(5000);
             }
             else if(ft.cb) {
-
-                // if(cb_fiber) {                  //TODO::这样子做相当于所有的函数任务都在使用 一个固定的协程
-                //     cb_fiber->reset(ft.cb);     //Fiber 对象重置
-                // }
-                // else {
-                //     cb_fiber.reset(new Fiber(ft.cb));   //创建 Fiber对象
-                // }
-                
-                cb_fiber.reset(new Fiber(ft.cb));   //创建 Fiber对象,如果不重新创建，那么就会以一直看到同一个协程id出现，但实际上有两个对象
+                cb_fiber = FiberPool::Get(std::move(ft.cb));   //复用已经结束的协程，每次复用都会分配新的协程id
+                cb_fiber->m_priority = ft.priority;     //让出后再次调度时沿用
                 ft.rest();
-                cb_fiber->swapIn();
+                beginSlice(queue, cb_fiber.get(), start_us);
+                Fiber::State state = cb_fiber->swapIn();
                 --m_activeThreadCount;
+                endSlice(queue, cb_fiber.get());
+                flushBatch(false);
 
-                if(cb_fiber->getState() == Fiber::State::READY) {
-                    schedule(cb_fiber);
-                    // cb_fiber.reset();
+                if(state == Fiber::State::READY) {
+                    reschedule(cb_fiber);
                 }
-                // else if( cb_fiber->getState() == Fiber::State::EXCEPT
-                //         || cb_fiber->getState() == Fiber::State::TERM) {
-                //     // cb_fiber->reset(nullptr);
-                // }
-                // else {
-                //     cb_fiber->m_state = Fiber::State::HOLD;
-                //     // cb_fiber.reset();
-                // }
-                // usleep(5000);
+                else if(state == Fiber::State::TERM || state == Fiber::State::EXCEPT) {
+                    FiberPool::Put(cb_fiber);
+                }
+                cb_fiber.reset();       //HOLD 的协程由事件或定时器持有
             }
             else {
                 if(is_active) {
@@ -230,9 +1031,17 @@ namespace wyze {
                     break;
                 }
 
+                flushBatch(true);
                 ++m_idleThreadCount;
+#ifdef WYZE_SCHED_STATS
+                uint64_t idle_us = GetMonotonicUS();
+#endif
                 idle_fiber->swapIn();
                 --m_idleThreadCount;
+#ifdef WYZE_SCHED_STATS
+                stats.idles.add(1);
+                stats.idleUs.add(GetMonotonicUS() - idle_us);
+#endif
                 // if(idle_fiber->getState() != Fiber::State::TERM
                 //     && idle_fiber->getState() != Fiber::State::EXCEPT ) {
                 //     idle_fiber->m_state = Fiber::State::HOLD;   //这里便是让出了处理
@@ -242,26 +1051,261 @@ namespace wyze {
             
         }
 
+        if(t_searching) {
+            t_searching = false;
+            --m_searchingCount;
+        }
+        t_queueIndex = -1;
     }   
 
+    //让出的协程放回队列，本线程接下来就会取到，只有指定给其他线程时才唤醒
+    void Scheduler::reschedule(Fiber::ptr& fiber)
+    {
+        FiberAndThread ft(fiber, -1);
+        int target = enqueue(ft);
+        if(target >= 0) {
+            notify(target);
+        }
+    }
+
     //是否停止
     bool Scheduler::stopping()
     {
-        MutexType::Lock lock(m_mutex);
         return m_autoStop &&                //自动停止
                 m_stopping &&               //停止
-                m_fibers.empty() &&        //没有协程可以执行
+                m_pendingTasks == 0 &&      //没有协程可以执行
                 m_activeThreadCount == 0;   //没有活跃的线程
     }
 
-    //无协程对象执行，则执行空闲
+    //自旋只在上一次空闲之后执行过任务时进行：线程刚忙完，任务很可能马上会来。
+    //自旋期间等到任务则下次自旋时间加倍，超时则减半，避免在持续空闲时浪费 CPU。
+    //超时后由 parkBegin 退出找任务状态并再次检查队列，不会丢失唤醒
+    bool Scheduler::spinForWork()
+    {
+        if(!s_idle_spin_us || t_dispatches == t_spinDispatches) {
+            return false;
+        }
+        t_spinDispatches = t_dispatches;
+        if(t_spinUs == 0 || t_spinUs > s_idle_spin_us) {
+            t_spinUs = s_idle_spin_us;
+        }
+        if(!t_searching) {      //自旋的线程算作正在找任务，schedule 不用再唤醒停车的线程
+            t_searching = true;
+            ++m_searchingCount;
+        }
+
+        uint64_t start = GetMonotonicUS();
+        do {
+            for(int i = 0; i < 64; ++i) {
+                if(m_pendingTasks > 0) {
+                    ++m_spinHits;
+                    t_spinUs = std::min(t_spinUs * 2, s_idle_spin_us);
+                    return true;
+                }
+                if(m_stopping) {
+                    return false;
+                }
+                CpuRelax();
+            }
+        } while(GetMonotonicUS() - start < t_spinUs);
+
+        ++m_spinMisses;
+        t_spinUs = std::max(t_spinUs / 2, s_idle_spin_us / 16 + 1);
+        return false;
+    }
+
+    //忙轮询：不退避、不停车，反复检查队列并调用 poll 非阻塞地检查 IO 和定时器，poll 返回 true 表示产生了任务。
+    //和自旋一样算作正在找任务，schedule 不会去唤醒停车的线程。预算用完后照常停车，
+    //之后执行过任务才会再次忙轮询，持续空闲时不会一直占着 CPU
+    bool Scheduler::busyPoll(uint64_t budget_us, const std::function<bool()>& poll)
+    {
+        if(t_busyExhausted && t_dispatches == t_busyDispatches) {
+            return false;
+        }
+        t_busyExhausted = false;
+        if(!t_searching) {
+            t_searching = true;
+            ++m_searchingCount;
+        }
+
+        //只有本线程能取到的任务才算等到：全部指定给其他线程的任务会让调用者空转，跳过 sched_yield
+        int idx = t_queueIndex;
+        uint64_t start = GetMonotonicUS();
+        do {
+            bool polled = poll();
+            if((polled || m_pendingTasks > 0) && hasWork(idx)) {
+                return true;
+            }
+            if(m_stopping) {
+                return false;
+            }
+            sched_yield();      //和内核的忙轮询一样，同一个核上有其他线程要运行时先让给它，独占核时立即返回
+        } while(GetMonotonicUS() - start < budget_us);
+
+        t_busyExhausted = true;
+        t_busyDispatches = t_dispatches;
+        return false;
+    }
+
+    int Scheduler::parkTimeout(int max_ms) const
+    {
+        if(m_elastic && s_elastic_idle_ms && s_elastic_idle_ms < (uint64_t)max_ms) {
+            return s_elastic_idle_ms;
+        }
+        return max_ms;
+    }
+
+    //弹性模式下线程空闲超过 scheduler.elastic_idle_ms 后退出，不少于最小线程数。
+    //use_caller 的线程和执行过共享栈协程的线程不会退出
+    bool Scheduler::tryRetire(int idx)
+    {
+        if(!m_elastic || m_stopping || (m_rootThread != -1 && idx == 0)) {
+            return false;
+        }
+        WorkQueue* q = m_queues[idx];
+        if(q->sharedStack) {
+            return false;
+        }
+        size_t live = m_liveWorkers;
+        do {
+            if(live <= m_minWorkers) {
+                return false;
+            }
+        } while(!m_liveWorkers.compare_exchange_weak(live, live - 1));
+
+        int thread_id = GetThreadId();
+        {
+            MutexType::Lock lock(q->mutex);
+            if(!q->tasks.empty() || !q->pinned.empty()) {
+                ++m_liveWorkers;
+                return false;
+            }
+            q->threadId = -1;   //之后指定给该线程的任务由任意线程执行
+        }
+        {
+            MutexType::Lock lock(m_mutex);
+            for(auto& i : m_fibers) {
+                if(i.thread == thread_id) {
+                    i.thread = -1;
+                }
+            }
+            auto it = std::find(m_threadIds.begin(), m_threadIds.end(), thread_id);
+            if(it != m_threadIds.end()) {
+                m_threadIds.erase(it);
+            }
+        }
+        ++m_retired;
+        WYZE_LOG_INFO(g_logger) << "scheduler " << m_name << " retire idle thread " << thread_id
+                                << " workers=" << live - 1;
+        return true;
+    }
+
+    bool Scheduler::spawnWorker(int& idx)
+    {
+        int first = m_rootThread != -1 ? 1 : 0;
+        for(size_t i = first; i < m_queues.size(); ++i) {
+            WorkQueue* q = m_queues[i];
+            if(q->active) {
+                continue;
+            }
+            Thread::ptr& thr = m_threads[i - first];
+            if(thr) {
+                thr->join();    //退出的线程已经离开 run，这里很快返回
+                thr.reset();
+            }
+            {
+                MutexType::Lock lock(q->mutex);
+                q->threadId = -1;
+                q->sharedStack = false;
+            }
+            q->active = true;
+            ++m_liveWorkers;
+            thr.reset(new Thread(std::bind(&Scheduler::workerMain, this, (int)i)
+                                , m_name + "_" + std::to_string(i - first)));
+            m_threadIds.push_back(thr->getId());
+            idx = i;
+            return true;
+        }
+        return false;
+    }
+
+    //排队时间超过阈值，或者有线程卡在一个协程中(例如没有 hook 的阻塞调用)而还有任务在等待时，增加一个线程。
+    //每次检查最多增加一个，线程数由 watchdog 的检查周期限速
+    void Scheduler::checkElastic(uint64_t now_us)
+    {
+        if(!m_elastic || m_stopping) {
+            return;
+        }
+        uint64_t wait = m_maxQueueWaitUs.exchange(0);
+        if(m_liveWorkers >= m_maxWorkers || m_pendingTasks == 0) {
+            return;
+        }
+
+        size_t stuck = 0;
+        for(auto& q : m_queues) {
+            uint64_t start = SliceStart(q, now_us);
+            if(start && s_elastic_stuck_us && now_us >= start + s_elastic_stuck_us) {
+                ++stuck;
+            }
+        }
+        bool slow = s_elastic_queue_wait_us && wait >= s_elastic_queue_wait_us && m_idleThreadCount == 0;
+        if(!stuck && !slow) {
+            return;
+        }
+
+        MutexType::Lock lock(m_mutex);
+        int idx = -1;
+        if(m_stopping || m_liveWorkers >= m_maxWorkers || !spawnWorker(idx)) {
+            return;
+        }
+        if(stuck) {
+            ++m_growStuck;
+        }
+        else {
+            ++m_growQueueWait;
+        }
+        WYZE_LOG_INFO(g_logger) << "scheduler " << m_name << " add thread on queue " << idx
+                                << " workers=" << m_liveWorkers << " stuck=" << stuck
+                                << " max_queue_wait=" << wait << "us pending=" << m_pendingTasks;
+    }
+
+    //无协程对象执行，则执行空闲：先自旋，再停车等待 tickleWorker 唤醒
     void Scheduler::idle()
     {
-        while(!stopping()) {
-            // WYZE_LOG_INFO(g_logger) << "idle";
-            Fiber::YeildToHold();
+        static const int MAX_TIMEOUT = 5000;    //停止时会被 tickleAll 唤醒，超时只是兜底
+        int idx = GetWorkerIndex();
+        WYZE_ASSERT(idx >= 0 && idx < (int)m_queues.size());
+        WorkQueue* q = m_queues[idx];
+
+        while(true) {
+            if(stopping()) {
+                tickleAll();    //其他停车的线程也需要退出
+                break;
+            }
+            if(spinForWork()) {
+                Fiber::YeildToReady();
+                continue;
+            }
+
+            q->parkWord.store(0, std::memory_order_relaxed);
+            if(parkBegin(idx) != PARK_NONE) {
+                int timeout = parkTimeout(MAX_TIMEOUT);
+                struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000};
+                bool timed_out = false;
+                while(q->parkWord.load(std::memory_order_acquire) == 0) {
+                    int rt = syscall(SYS_futex, (int*)&q->parkWord, FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+                    if(rt && errno == ETIMEDOUT) {
+                        timed_out = true;
+                        break;
+                    }
+                }
+                if(!parkEnd(idx) && timed_out && tryRetire(idx)) {
+                    break;
+                }
+            }
+            Fiber::YeildToReady();
         }
-    }    
+    }
 
     //使当前线程保存 调度器对象  
     void Scheduler::setThis()
@@ -5,9 +5,12 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <deque>
 #include <atomic>
 #include "thread.h"
 #include "fiber.h"
+#include "callable.h"
+#include "schedstats.h"
 
 namespace wyze {
 
@@ -16,6 +19,15 @@ namespace wyze {
         using ptr = std::shared_ptr<Scheduler>;
         using MutexType = Mutex;
 
+        //任务优先级：高优先级任务先于普通任务执行，低优先级任务在没有其他任务或者等待过久时执行。
+        //只对没有指定线程的任务生效，指定线程的任务按放入顺序执行
+        enum Priority {
+            PRIORITY_INHERIT = -1,  //协程沿用上一次执行时的优先级，函数为 PRIORITY_NORMAL
+            PRIORITY_HIGH = 0,      //健康检查、管理接口等对延迟敏感的任务
+            PRIORITY_NORMAL = 1,
+            PRIORITY_LOW = 2,       //批量、后台任务
+        };
+
         Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "UNKNOW");
         virtual ~Scheduler();
 
@@ -24,87 +36,209 @@ namespace wyze {
         static Fiber* GetMainFiber();                   //获取 调度器创建的主协程对象
 
         void start();                                   //开始调度
+        size_t getWorkerCount() const { return m_queues.size(); }  //本地队列数，即最多的调度线程数
+        //参与调度的线程id，弹性模式下线程增减时会变化，返回的是调用时的副本
+        std::vector<int> getThreadIds() const;
         void stop();                                    //停止调度
 
+        struct WakeupStats {
+            uint64_t tickles = 0;       //发出的定向唤醒次数
+            uint64_t useful = 0;        //被唤醒后拿到任务的次数
+            uint64_t suppressed = 0;    //有线程正在找任务或没有空闲线程，省掉的唤醒
+            uint64_t promotions = 0;    //poller 离开时唤醒 follower 接替的次数
+            uint64_t spin_hits = 0;     //空闲自旋期间等到任务的次数
+            uint64_t spin_misses = 0;   //自旋超时后停车的次数
+            uint64_t parks = 0;         //阻塞等待的次数
+        };
+        WakeupStats getWakeupStats() const;             //唤醒和空闲统计
+
+        //排队时间、执行时间、切换次数等统计，编译时没有打开 WYZE_SCHED_STATS 时只有线程数和唤醒统计
+        SchedulerStats getStats() const;
+        //文本格式的统计，包含与上一次调用之间的速率
+        std::string dumpStats();
+
+        //函数对象转换成 Callable 后一路移动到执行它的协程，不拷贝
         template <class FiberOrCb>
-        void schedule(FiberOrCb fc, int thread = -1) {
-            bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                need_tickle = scheduleNolock(fc, thread);
+        void schedule(FiberOrCb fc, int thread = -1, Priority priority = PRIORITY_INHERIT) {
+            FiberAndThread ft(std::move(fc), thread);
+            ft.priority = priority;
+            if(ft.fiber || ft.cb) {
+                notify(enqueue(ft));
             }
-            if(need_tickle){
-                tickle();
+        }
+
+        void schedule(Callable&& cb, int thread = -1, Priority priority = PRIORITY_INHERIT) {
+            FiberAndThread ft(std::move(cb), thread);
+            ft.priority = priority;
+            if(ft.cb) {
+                notify(enqueue(ft));
             }
         }
 
         template<class InputIterator>
         void schedule(InputIterator begin, InputIterator end) {
-            bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                while(begin != end) {
-                    need_tickle = scheduleNolock(&*begin, -1) || need_tickle;
-                    ++begin;
-                }
-                if(need_tickle) {
-                    tickle();
+            bool wake_any = false;
+            while(begin != end) {
+                FiberAndThread ft(&*begin, -1);
+                if(ft.fiber || ft.cb) {
+                    int target = enqueue(ft);
+                    if(target == WAKE_ANY) {
+                        wake_any = true;
+                    }
+                    else {
+                        notify(target);
+                    }
                 }
+                ++begin;
+            }
+            if(wake_any) {
+                tickle();
             }
         }
 
     protected:
-        virtual void tickle();      //唤醒调度器
+        enum ParkRole {
+            PARK_NONE = 0,          //有任务或者正在停止，不需要阻塞
+            PARK_POLLER = 1,        //阻塞在事件等待上，同时负责 IO 和定时器
+            PARK_FOLLOWER = 2,      //阻塞在自己的唤醒句柄上
+        };
+
+        virtual void tickle();      //唤醒一个空闲线程，有线程正在找任务时不唤醒
+        virtual void tickleWorker(int idx, bool poller);    //唤醒指定下标的停车线程，子类实现具体的唤醒方式
         void run();                 //调度核心
         virtual bool stopping();    //是否停止
         virtual void idle();        //无协程对象执行，则执行空闲
+        virtual void flushBatch(bool idle) {}   //每个任务切回后和进入 idle 前调用，子类在这里提交攒下的批量请求
         void setThis();             //使当前线程保存 调度器对象
         bool hasIdleThreads() const { return m_idleThreadCount > 0; }   //是否有空闲线程
 
-    private:
-
-        template<class FiberOrCb>
-        bool scheduleNolock(FiberOrCb fc, int thread) {
-            bool need_tickle = m_fibers.empty();
-            FiberAndThread ft(fc, thread);
-            if(ft.fiber || ft.cb) {
-                m_fibers.push_back(ft);
-            }
-
-            return need_tickle;   //返回是否唤醒
-        }
+        static int GetWorkerIndex();            //当前线程在调度器中的下标，不是调度线程返回 -1
+        ParkRole parkBegin(int idx);            //进入停车栈，并再次检查是否有任务
+        bool parkEnd(int idx);                  //离开停车栈，返回是否是被定向唤醒
+        void promotePoller();                   //poller 去执行任务时，唤醒一个 follower 接替
+        void ticklePoller();                    //唤醒 poller 重新计算超时时间
+        void tickleAll();                       //唤醒所有停车的线程，停止时使用
+        bool spinForWork();                     //停车前自旋等待任务，返回是否等到
+        bool busyPoll(uint64_t budget_us, const std::function<bool()>& poll);   //预算内不停车，反复调用 poll 检查事件，返回是否有任务
+        int parkTimeout(int max_ms) const;      //停车的超时时间，弹性模式下空闲这么久后退出线程
+        bool tryRetire(int idx);                //停车超时且没有被唤醒时调用，返回 true 时 idle 需要退出
+        bool isElastic() const { return m_elastic; }
+        bool hasRootThread() const { return m_rootThread != -1; }   //use_caller 时下标 0 为 root 线程
+        int getWorkerThread(int idx) const { return m_queues[idx]->threadId; }  //下标对应的线程id，线程还没启动时为 -1
 
+    private:
         struct FiberAndThread {
             Fiber::ptr fiber;           //当调度器传入的协程对象
-            std::function<void()> cb;   //当调度器传入的是函数，在内部会生成一个协程对象
+            Callable cb;                //当调度器传入的是函数，在内部会生成一个协程对象
             int thread;                 //指定 哪个线程运行该对象
+            int priority = PRIORITY_INHERIT;    //enqueue 时确定为具体的优先级
+            uint64_t enqueueUs = 0;     //放入队列的时间，打开 WYZE_SCHED_STATS 或者是低优先级任务时记录
 
             FiberAndThread(Fiber::ptr f, int thr)
-                : fiber(f), thread(thr) { }
+                : fiber(std::move(f)), thread(thr) { }
             FiberAndThread(Fiber::ptr* f, int thr)      //避免只能指针计数累加，内部运行完毕会释放该对象
                 : thread(thr) { fiber.swap(*f); }   
-            FiberAndThread(std::function<void()> f, int thr) 
-                : cb(f), thread(thr) { }
-            FiberAndThread(std::function<void()> *f, int thr)   //这里感觉没有必要
+            FiberAndThread(Callable f, int thr) 
+                : cb(std::move(f)), thread(thr) { }
+            FiberAndThread(Callable* f, int thr)        //取走 *f，定时器和 IO 事件批量调度时使用
                 : thread(thr) { cb.swap(*f); }
+            FiberAndThread(std::function<void()>* f, int thr)
+                : cb(std::move(*f)), thread(thr) { *f = nullptr; }
             FiberAndThread()                        //默认构造函数，在容器中会用到
                 : thread(-1) { }
             void rest() {
                 fiber = nullptr;
                 cb = nullptr;
                 thread = -1;
+                priority = PRIORITY_INHERIT;
             }
         };
 
+        //每个调度线程的本地队列，本线程从头部取任务，其他线程从尾部窃取
+        struct WorkQueue {
+            MutexType mutex;
+            std::deque<FiberAndThread> tasks;   //可被其他线程窃取的任务
+            std::deque<FiberAndThread> pinned;  //指定在该线程执行的任务，不会被窃取
+            std::atomic<int> threadId = {-1};   //队列所属的线程id
+            bool parked = false;                //是否在停车栈中，由 m_idleMutex 保护
+            bool tickled = false;               //是否已经被定向唤醒，由 m_idleMutex 保护
+            SchedThreadCounters stats;          //只由所属线程写入，打开 WYZE_SCHED_STATS 时记录
+            std::atomic<uint64_t> sliceStartUs = {0};   //当前任务开始执行的时间，没有执行任务时为 0，没有读取时钟时为 1
+            std::atomic<uint64_t> sliceFiberId = {0};   //当前执行的协程id
+            std::atomic<bool> sliceReported = {false};  //本次执行是否已经被 watchdog 报告过
+            std::atomic<int> parkWord = {0};    //基类 idle 停车使用的 futex，被唤醒时置 1
+            std::atomic<bool> active = {false}; //是否有线程在使用该队列，弹性模式下退出的线程会空出队列
+            bool sharedStack = false;           //执行过共享栈协程，协程只能回到该线程，不能退出
+        };
+
+        enum {
+            WAKE_NONE = -2,     //不需要唤醒
+            WAKE_ANY = -1,      //唤醒任意一个空闲线程
+        };
+
+        int enqueue(FiberAndThread& ft);            //放入任务，返回需要唤醒的线程下标或 WAKE_NONE/WAKE_ANY
+        void notify(int target);                    //根据 enqueue 的结果唤醒
+        bool dequeue(int idx, FiberAndThread& ft);  //取出任务
+        bool takeInjected(int idx, FiberAndThread& ft);
+        bool takePriority(int priority, FiberAndThread& ft, bool aged_only);   //从高/低优先级队列取任务
+        bool steal(int idx, FiberAndThread& ft);
+        bool hasWork(int idx);                      //停车前检查是否有当前线程可以执行的任务
+        void foundWork();                           //拿到任务，结束找任务的状态
+        void reschedule(Fiber::ptr& fiber);         //run 中把让出的协程放回队列
+        void wakeLocked(int idx);                   //持有 m_idleMutex 时唤醒停车栈中的线程
+        int getWorkerIndex(int thread) const;                   //根据线程id 找到本地队列下标
+        static bool TakeRunnable(std::deque<FiberAndThread>& dq, FiberAndThread& ft);
+        void beginSlice(WorkQueue* q, Fiber* fiber, uint64_t start_us);    //切入任务前记录开始时间
+        void endSlice(WorkQueue* q, Fiber* fiber);      //切回后统计耗时，超过阈值时告警
+        static uint64_t SliceStart(WorkQueue* q, uint64_t now_us);  //watchdog 读取任务开始时间，没有记录时记为 now_us
+        void checkSlices(uint64_t now_us, uint64_t warn_us);    //watchdog 线程检查正在执行的任务
+        void checkElastic(uint64_t now_us);     //watchdog 线程检查是否需要增加线程
+        bool spawnWorker(int& idx);             //在空闲的队列上启动一个线程，持有 m_mutex 时调用
+        void workerMain(int idx);               //start/spawnWorker 创建的线程入口
+
+        friend struct SliceWatchdog;
+
     private:
-        MutexType m_mutex;      //锁多个线程会同时去获取执行对象
-        std::vector<Thread::ptr> m_threads; //线程池
-        std::list<FiberAndThread> m_fibers; //协程对象池
+        mutable MutexType m_mutex;      //保护 m_fibers、m_threads 和 m_threadIds
+        std::vector<Thread::ptr> m_threads; //线程池，下标为本地队列下标减去 use_caller 占用的 0 号
+        std::list<FiberAndThread> m_fibers; //全局注入队列，非调度线程 schedule 的任务放在这里
+        std::vector<WorkQueue*> m_queues;   //每个调度线程的本地队列，use_caller 时下标 0 为 root 线程
+        std::atomic<size_t> m_pendingTasks = {0};   //所有队列中等待执行的任务数
+        MutexType m_priorityMutex;                  //保护高/低优先级队列
+        std::deque<FiberAndThread> m_highTasks;     //没有指定线程的高优先级任务，所有线程共享
+        std::deque<FiberAndThread> m_lowTasks;      //没有指定线程的低优先级任务
+        std::atomic<size_t> m_priorityPending = {0};    //高/低优先级队列中的任务数，为 0 时不加锁检查
+        std::atomic<uint64_t> m_highDispatches = {0};
+        std::atomic<uint64_t> m_lowDispatches = {0};
+        std::atomic<uint64_t> m_lowAged = {0};      //等待过久、先于普通任务执行的低优先级任务数
+        MutexType m_idleMutex;                      //保护停车栈和 poller
+        std::vector<int> m_idleStack;               //停车线程的下标，后停的先唤醒
+        int m_pollerIndex = -1;                     //阻塞在事件等待上的线程下标
+        std::atomic<int> m_searchingCount = {0};    //刚被唤醒、正在找任务的线程数
+        std::atomic<uint64_t> m_tickleCount = {0};
+        std::atomic<uint64_t> m_usefulWakeups = {0};
+        std::atomic<uint64_t> m_suppressedWakeups = {0};
+        std::atomic<uint64_t> m_promotions = {0};
+        std::atomic<uint64_t> m_spinHits = {0};
+        std::atomic<uint64_t> m_spinMisses = {0};
+        std::atomic<uint64_t> m_parks = {0};
+        MutexType m_statsMutex;                     //保护 m_lastStats
+        SchedulerStats m_lastStats;                 //上一次 dumpStats 的快照
         Fiber::ptr m_rootFiber;     //当想要创建Scheduler 对象的线程也进行调度时，该对象会被创建
         int m_rootThread = 0;       //rootThread 线程id
         std::string m_name;         //调度器的名称，调度器创建的线程名 等于调度器名+ 序号
+        std::vector<std::vector<int>> m_cpuGroups;  //scheduler.cpus 中本调度器的绑核配置，start 时读取
+        bool m_elastic = false;                     //scheduler.elastic 中配置了本调度器，构造时读取
+        bool m_timeDispatch = false;                //取任务时读取时钟：打开 WYZE_SCHED_STATS 或弹性模式需要排队时间
+        size_t m_minWorkers = 0;                    //弹性模式下创建的线程数范围，不含 use_caller 的线程
+        size_t m_maxWorkers = 0;
+        std::atomic<size_t> m_liveWorkers = {0};    //正在运行的创建的线程数
+        std::atomic<uint64_t> m_maxQueueWaitUs = {0};   //watchdog 两次检查之间任务的最长排队时间
+        std::atomic<uint64_t> m_growQueueWait = {0};    //因为排队时间过长增加线程的次数
+        std::atomic<uint64_t> m_growStuck = {0};        //因为线程卡在一个协程中增加线程的次数
+        std::atomic<uint64_t> m_retired = {0};          //空闲退出的线程数
     protected:
-        std::vector<int> m_threadIds;     //每个线程对应的线程id
+        std::vector<int> m_threadIds;     //每个线程对应的线程id，弹性模式下随线程增减变化
         size_t m_threadCount = 0;       //需要创建的线程数
         std::atomic<size_t> m_activeThreadCount = {0};
         std::atomic<size_t> m_idleThreadCount = {0};
@@ -113,6 +247,9 @@ namespace wyze {
                
     };
 
+    //协作式让出检查点：当前协程本次执行中从第一次调用起超过 scheduler.slice_budget_us 时让出，返回是否让出。
+    //不在调度器的协程中调用时什么都不做，适合放在计算密集的循环中
+    bool maybe_yield();
 
 }
 
@@ -17,6 +17,7 @@ TcpServer::TcpServer(IOManager* worker, IOManager* acceptWorker )
     , m_recvTimeout(g_tcp_server_read_timeout->getValue())
     , m_name("wyze/1.0.0")
     , m_isStop(true)
+    , m_sharedStack(false)
 {
 }
 
@@ -114,8 +115,16 @@ void TcpServer::startAccept(Socket::ptr sock)
             continue;       //accept 里面打印了，这里就不需要打印
         
         client->setRecvTimeout(m_recvTimeout);
-        m_worker->schedule(std::bind(&TcpServer::handleClient,
-                shared_from_this(), client));
+        m_worker->setSocketBusyPoll(client->getSocket());
+        int thread = m_worker->getOwnerThread(client->getSocket());    //多 reactor 模式下交给连接所属的线程
+        if(m_sharedStack) {
+            m_worker->schedule(Fiber::ptr(new Fiber(std::bind(&TcpServer::handleClient,
+                    shared_from_this(), client), 0, false, true)), thread);
+        }
+        else {
+            m_worker->schedule(std::bind(&TcpServer::handleClient,
+                    shared_from_this(), client), thread);
+        }
     }
 }   
 
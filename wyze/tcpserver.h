@@ -29,6 +29,9 @@ public:
     void setRecvTimeout(uint64_t v) { m_recvTimeout = v; }
     void setName(const std::string v) { m_name = v; }
     bool isStop() const { return m_isStop; }
+    //handleClient 运行在线程共享栈上，适合大量空闲的长连接
+    void setSharedStack(bool v) { m_sharedStack = v; }
+    bool isSharedStack() const { return m_sharedStack; }
 
 protected:
     virtual void handleClient(Socket::ptr client);      //接收到一个socket 则创建一个携程，并携带该socket类
@@ -41,6 +44,7 @@ private:
     uint64_t m_recvTimeout;
     std::string m_name;
     bool m_isStop;
+    bool m_sharedStack;
 };
 
 }
@@ -78,10 +78,19 @@ namespace wyze {
     }
 
     //创建新的定时器
-    Timer::Timer(uint64_t ms, std::function<void()> cb
+    //只能移动的回调被多次执行时共享同一个对象
+    struct SharedCallback {
+        std::shared_ptr<Callable> cb;
+        void operator()() { (*cb)(); }
+    };
+
+    Timer::Timer(uint64_t ms, Callable cb
                     ,bool recurring, TimerManager* manager)
-        : m_ms(ms), m_cb(cb), m_recurring(recurring), m_manager(manager)
+        : m_ms(ms), m_cb(std::move(cb)), m_recurring(recurring), m_manager(manager)
     {
+        if(m_recurring && m_cb && !m_cb.copyable()) {
+            m_cb = SharedCallback{std::make_shared<Callable>(std::move(m_cb))};
+        }
         m_next = GetCurrentMS() + m_ms;
     }
 
@@ -94,29 +103,15 @@ namespace wyze {
 
     TimerManager::~TimerManager() { }
 
-    Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb
+    Timer::ptr TimerManager::addTimer(uint64_t ms, Callable cb
                             , bool recurring)
     {
-        Timer::ptr timer(new Timer(ms, cb, recurring, this));
+        Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this));
         RWMutexType::WriteLock wlock(m_mutex);
         addTimer(timer, wlock);
         return timer;
     }
 
-    static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
-    {
-        std::shared_ptr<void> tmp = weak_cond.lock();   //获取地址
-        if(tmp) {
-            cb();
-        }
-    }
-    
-    Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
-                            , std::weak_ptr<void> weak_cond, bool recurring)
-    {
-        return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
-    }
-
     //获取当前时间距离下一次唤醒的时间段
     uint64_t TimerManager::getNextTimer()
     {
@@ -134,7 +129,7 @@ namespace wyze {
     } 
 
     //唤醒后获取那些超时的任务
-    void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs)
+    void TimerManager::listExpiredCb(std::vector<Callable>& cbs)
     {
         uint64_t now_ms = GetCurrentMS();
         std::vector<Timer::ptr> expired;
@@ -163,13 +158,13 @@ namespace wyze {
         cbs.reserve(expired.size());
 
         for(auto& timer: expired) {     //取出任务，且判断是否循环
-            cbs.push_back(timer->m_cb);
             if(timer->m_recurring) {
+                cbs.push_back(timer->m_cb.clone());
                 timer->m_next = now_ms + timer->m_ms;
                 m_timers.insert(timer);
             }
             else {
-                timer->m_cb = nullptr;
+                cbs.push_back(std::move(timer->m_cb));
             }
         }
     }
@@ -7,6 +7,7 @@
 #include <set>
 
 #include "thread.h"
+#include "callable.h"
 
 namespace wyze {
 
@@ -20,13 +21,13 @@ namespace wyze {
         bool reset(uint64_t ms, bool from_now = true); //从新设置定时器
 
     private:
-        Timer(uint64_t ms, std::function<void()> cb
+        Timer(uint64_t ms, Callable cb
                 ,bool recurring, TimerManager* manager);    //创建新的定时器
         Timer(uint64_t next);                               //这个在查找哪些定时器超时使用，外部不会用
 
     private:
         uint64_t m_ms = 0;                      //执行周期
-        std::function<void()> m_cb = nullptr;   //超时执行的任务
+        Callable m_cb;                          //超时执行的任务，循环定时器每次超时取出一份拷贝
         bool m_recurring = false;               //是否循环定时
         TimerManager* m_manager = nullptr;      //管理该定时器的对象
         uint64_t m_next = 0;                    //精确的执行时间
@@ -43,12 +44,16 @@ namespace wyze {
         TimerManager();
         virtual ~TimerManager();    //接口类，需要继承
 
-        Timer::ptr addTimer(uint64_t ms, std::function<void()> cb
+        Timer::ptr addTimer(uint64_t ms, Callable cb
                                 , bool recurring = false);
-        Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb
-                                , std::weak_ptr<void> weak_cond, bool recurring = false);
+        //weak_cond 失效后超时不再执行 cb。条件和回调放在同一个函数对象中，常见的回调不需要额外分配
+        template<class F>
+        Timer::ptr addConditionTimer(uint64_t ms, F cb
+                                , std::weak_ptr<void> weak_cond, bool recurring = false) {
+            return addTimer(ms, ConditionCallback<F>(std::move(weak_cond), std::move(cb)), recurring);
+        }
         uint64_t getNextTimer();    //获取当前时间距离下一次唤醒的时间段
-        void listExpiredCb(std::vector<std::function<void()>>& cbs);    //唤醒后获取那些超时的任务
+        void listExpiredCb(std::vector<Callable>& cbs);    //唤醒后获取那些超时的任务
         bool hasTimer();    //是否有定时器任务
 
     protected:
@@ -56,6 +61,20 @@ namespace wyze {
         void addTimer(Timer::ptr val, RWMutexType::WriteLock& wlock);   //向set集合插入timer
 
     private:
+        template<class F>
+        struct ConditionCallback {
+            ConditionCallback(std::weak_ptr<void> c, F f)
+                : cond(std::move(c)), cb(std::move(f)) { }
+            void operator()() {
+                std::shared_ptr<void> tmp = cond.lock();    //条件还存在才执行
+                if(tmp) {
+                    cb();
+                }
+            }
+            std::weak_ptr<void> cond;
+            F cb;
+        };
+
         bool detectClockRollover(uint64_t now_ms);  //检测时间是否被修改
 
     private:
@@ -51,6 +51,13 @@ uint64_t GetCurrentUS()
     return tv.tv_sec * 1000ul * 1000ul + tv.tv_usec;
 }
 
+uint64_t GetMonotonicUS()
+{
+    struct timespec ts = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul * 1000ul + ts.tv_nsec / 1000;
+}
+
 
 static std::string demangle(const char* str) 
 {
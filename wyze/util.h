@@ -14,6 +14,7 @@ namespace wyze {
     uint32_t GetFiberId();
     uint64_t GetCurrentMS();
     uint64_t GetCurrentUS();
+    uint64_t GetMonotonicUS();   //单调时钟，用于统计耗时
     void Backtrace(std::vector<std::string>& vec, int size, int skip);
     std::string BacktraceToString(int size = 64, 
             int skip = 2, const std::string& prefix = "    ");
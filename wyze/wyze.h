@@ -2,14 +2,20 @@
 # define _WYZE_H_
 
 #include "address.h"
+#include "affinity.h"
 #include "application.h"
 #include "bytearray.h"
+#include "callable.h"
+#include "cancel.h"
+#include "channel.h"
 #include "config.h"
 #include "crypt.h"
 #include "daemon.h"
 #include "db/mysqlconn.h"
 #include "env.h"
 #include "fiber.h"
+#include "fiberlocal.h"
+#include "fibersync.h"
 #include "hook.h"
 #include "http/http.h"
 #include "http/http_parser.h"
@@ -18,8 +24,11 @@
 #include "http/servlet.h"
 #include "http/http_connection.h"
 #include "iomanager.h"
+#include "iouring.h"
 #include "log.h"
 #include "macro.h"
+#include "offload.h"
+#include "parallel.h"
 #include "scheduler.h"
 #include "singleton.h"
 #include "socket.h"